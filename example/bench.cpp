@@ -0,0 +1,2210 @@
+// Benchmarks for the reactor model.
+//
+// usage: example_bench [benchmark ...]
+// Runs the named benchmarks, or all of them when no name is given. Exits
+// nonzero if any of their self-checks fails.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "scheduler.h"
+
+#include "components.h"
+#include "core.h"
+#include "corebatch.h"
+#include "ensemble.h"
+#include "events.h"
+#include "plantgraph.h"
+#include "properties.h"
+#include "publisher.h"
+#include "recorder.h"
+#include "replay.h"
+#include "simserver.h"
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	inline double seconds_since(Clock::time_point start)
+	{
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	// Relative difference, treating two zeros as equal
+	inline double relative_error(double a, double b)
+	{
+		double scale = std::fabs(a) > std::fabs(b) ? std::fabs(a) : std::fabs(b);
+		return scale > 0.0 ? std::fabs(a - b) / scale : 0.0;
+	}
+
+	// Returns whether double lanes agree with Core to a few ulps; float lanes
+	// drift by design and are only reported
+	template<typename Real>
+	bool run_batch(CoreBatchBase::Kernel kernel, const std::vector<Core::Inputs>& inputs, const std::vector<Core>& cores,
+		unsigned frames, double frame_time, double reactor_steps, double scalar_rate)
+	{
+		BasicCoreBatch<Real> batch(inputs.size());
+		batch.set_kernel(kernel);
+		for(size_t i = 0; i < inputs.size(); ++i)
+		{
+			batch.set_inputs(i, inputs[i]);
+		}
+
+		auto start = Clock::now();
+		for(unsigned f = 0; f < frames; ++f)
+		{
+			batch.simulate(frame_time);
+		}
+		double rate = reactor_steps / seconds_since(start);
+
+		double error = 0.0;
+		for(size_t i = 0; i < inputs.size(); ++i)
+		{
+			double e = relative_error(batch.get_flux(i), cores[i].get_flux());
+			error = e > error ? e : error;
+		}
+
+		printf("corebatch: %-8s %-6s %12.0f reactor-steps/s  x%.2f  max rel err vs core %g\n",
+			CoreBatchBase::kernel_name(kernel), sizeof(Real) == sizeof(float) ? "float" : "double",
+			rate, rate / scalar_rate, error);
+		return sizeof(Real) == sizeof(float) || error <= 1e-14;
+	}
+
+	bool bench_corebatch()
+	{
+		constexpr size_t Reactors = 4096;
+		constexpr unsigned Frames = 60;
+		constexpr double FrameTime = 1.0;
+
+		const double steps_per_frame = std::floor(FrameTime / Core::FixedTimestep);
+		const double reactor_steps = Reactors * Frames * steps_per_frame;
+
+		// spread the starting rod positions so lanes do not all agree
+		std::vector<Core::Inputs> inputs(Reactors);
+		{
+			Core core;
+			for(size_t i = 0; i < Reactors; ++i)
+			{
+				inputs[i] = core.get_inputs();
+				inputs[i].RodPosition = 2.25 * (double)i / Reactors;
+			}
+		}
+
+		double scalar_rate = 0.0;
+		std::vector<Core> cores(Reactors);
+		{
+			for(size_t i = 0; i < Reactors; ++i)
+			{
+				cores[i].set_inputs(inputs[i]);
+			}
+
+			auto start = Clock::now();
+			for(unsigned f = 0; f < Frames; ++f)
+			{
+				for(Core& core : cores)
+				{
+					core.simulate(FrameTime);
+				}
+			}
+			scalar_rate = reactor_steps / seconds_since(start);
+			printf("corebatch: %-8s %12.0f reactor-steps/s\n", "core", scalar_rate);
+		}
+
+		bool ok = true;
+		CoreBatch::Kernel kernels[] = { CoreBatch::Kernel_Scalar, CoreBatch::Kernel_AVX2, CoreBatch::Kernel_AVX512 };
+		for(CoreBatch::Kernel kernel : kernels)
+		{
+			if(kernel > CoreBatch::best_kernel())
+			{
+				printf("corebatch: %-8s not supported\n", CoreBatch::kernel_name(kernel));
+				continue;
+			}
+
+			ok = run_batch<double>(kernel, inputs, cores, Frames, FrameTime, reactor_steps, scalar_rate) && ok;
+			ok = run_batch<float>(kernel, inputs, cores, Frames, FrameTime, reactor_steps, scalar_rate) && ok;
+		}
+
+		// a core the kernels would step as a different model is refused
+		CoreBatch batch(1);
+		Core other;
+		other.set_integrator(Core::Integrator_Rosenbrock);
+		bool refused = !batch.load(0, other);
+		other = Core();
+		other.set_neutronics_substeps(4);
+		refused = refused && !batch.load(0, other);
+		other = Core();
+		other.set_rod_drive(false);
+		refused = refused && !batch.load(0, other);
+		other = Core();
+		other.set_timestep(0.1);
+		refused = refused && !batch.load(0, other) && batch.load(0, Core());
+		printf("corebatch: cores the kernels do not implement %s\n", refused ? "refused" : "ACCEPTED");
+		return ok && refused;
+	}
+
+	bool bench_parallel()
+	{
+		constexpr size_t Reactors = 4096;
+		constexpr unsigned Frames = 30;
+		constexpr double FrameTime = 1.0;
+
+		const double reactor_steps = Reactors * Frames * std::floor(FrameTime / Core::FixedTimestep);
+		const unsigned hw_threads = std::thread::hardware_concurrency();
+
+		double single_rate = 0.0;
+		for(unsigned threads = 1; threads <= (hw_threads ? hw_threads : 1); threads *= 2)
+		{
+			sched_size needed_memory;
+			struct scheduler sched;
+			scheduler_init(&sched, &needed_memory, threads, 0);
+			void* memory = calloc(needed_memory, 1);
+			scheduler_start(&sched, memory);
+
+			std::vector<Core> cores(Reactors);
+			auto start = Clock::now();
+			for(unsigned f = 0; f < Frames; ++f)
+			{
+				Core::simulate_parallel(cores.data(), cores.size(), FrameTime, &sched);
+			}
+			double rate = reactor_steps / seconds_since(start);
+			if(threads == 1)
+			{
+				single_rate = rate;
+			}
+
+			scheduler_stop(&sched);
+			free(memory);
+
+			printf("parallel: %2u threads %12.0f reactor-steps/s  speedup x%.2f\n", threads, rate, rate / single_rate);
+		}
+		return true;
+	}
+
+	// Runs a core from the constructor defaults for the given plant time,
+	// sampling the flux every second. The timestep must divide one second.
+	std::vector<double> run_flux(Core::Integrator integrator, double timestep, double duration)
+	{
+		Core core;
+		core.set_integrator(integrator);
+		core.set_timestep(timestep);
+
+		// step explicitly so every scheme is sampled at the same plant time
+		const unsigned steps_per_sample = (unsigned)std::lround(1.0 / timestep);
+
+		std::vector<double> samples;
+		for(double t = 0.0; t < duration; t += 1.0)
+		{
+			for(unsigned s = 0; s < steps_per_sample; ++s)
+			{
+				core.step();
+			}
+			samples.push_back(core.get_flux());
+		}
+		return samples;
+	}
+
+	bool bench_integrators()
+	{
+		constexpr double Duration = 300.0;
+
+		const char* names[] = { "euler", "exp-euler", "rosenbrock" };
+		const Core::Integrator integrators[] = { Core::Integrator_Euler, Core::Integrator_ExponentialEuler, Core::Integrator_Rosenbrock };
+		const double timesteps[] = { 1.0 / 240.0, 1.0 / 60.0, 1.0 / 30.0, 1.0 / 10.0, 0.5, 1.0 };
+
+		// forward Euler is well inside its stability limit at this step and
+		// serves as the reference for every scheme
+		std::vector<double> reference = run_flux(Core::Integrator_Euler, 1.0 / 7680.0, Duration);
+
+		printf("integrators: %-10s %10s %14s %14s\n", "scheme", "step (s)", "max rel err", "wall (ms)");
+		for(size_t i = 0; i < sizeof(integrators) / sizeof(integrators[0]); ++i)
+		{
+			for(double timestep : timesteps)
+			{
+				auto start = Clock::now();
+				std::vector<double> samples = run_flux(integrators[i], timestep, Duration);
+				double wall = seconds_since(start);
+
+				double error = 0.0;
+				for(size_t s = 0; s < samples.size(); ++s)
+				{
+					double e = std::isfinite(samples[s]) ? relative_error(samples[s], reference[s]) : INFINITY;
+					error = e > error ? e : error;
+				}
+
+				printf("integrators: %-10s %10.5f %14.3e %14.3f\n", names[i], timestep, error, wall * 1e3);
+			}
+		}
+		return true;
+	}
+
+	// Like run_flux, but with each step of timestep split into substeps
+	std::vector<double> run_substeps(Core::Coupling coupling, unsigned substeps, double timestep, double duration)
+	{
+		Core core;
+		core.set_coupling(coupling);
+		core.set_neutronics_substeps(substeps);
+		core.set_timestep(timestep);
+
+		const unsigned steps_per_sample = (unsigned)std::lround(1.0 / timestep);
+
+		std::vector<double> samples;
+		for(double t = 0.0; t < duration; t += 1.0)
+		{
+			for(unsigned s = 0; s < steps_per_sample; ++s)
+			{
+				core.step();
+			}
+			samples.push_back(core.get_flux());
+		}
+		return samples;
+	}
+
+	bool bench_substeps()
+	{
+		constexpr double Duration = 300.0;
+		constexpr double Timestep = 1.0 / 60.0;
+
+		// the flux does not depend on the thermal state, so with the rods
+		// moved across the step, k substeps of h/k are the fixed step of h/k
+		// up to rounding summed over up to 288000 steps; frozen rods lag by
+		// up to one step of rod travel, about 5e-5 of the flux here
+		const char* names[] = { "interpolated", "frozen" };
+		const Core::Coupling couplings[] = { Core::Coupling_Interpolated, Core::Coupling_Frozen };
+		const double bounds[] = { 1e-10, 1e-4 };
+		const unsigned substeps[] = { 2, 4, 16 };
+
+		printf("substeps: %-12s %4s %14s %10s\n", "coupling", "k", "max rel err", "bound");
+		bool ok = true;
+		for(unsigned k : substeps)
+		{
+			std::vector<double> reference = run_substeps(Core::Coupling_Interpolated, 1, Timestep / k, Duration);
+			for(size_t c = 0; c < sizeof(couplings) / sizeof(couplings[0]); ++c)
+			{
+				std::vector<double> samples = run_substeps(couplings[c], k, Timestep, Duration);
+
+				double error = samples.size() == reference.size() ? 0.0 : INFINITY;
+				for(size_t s = 0; s < samples.size() && s < reference.size(); ++s)
+				{
+					double e = std::isfinite(samples[s]) ? relative_error(samples[s], reference[s]) : INFINITY;
+					error = e > error ? e : error;
+				}
+
+				printf("substeps: %-12s %4u %14.3e %10.0e  %s\n", names[c], k, error, bounds[c], error <= bounds[c] ? "within" : "ABOVE");
+				ok = ok && error <= bounds[c];
+			}
+		}
+		return ok;
+	}
+
+	bool bench_recorder()
+	{
+		// the ring holds the whole run so nothing is dropped, even when the
+		// writer thread shares a cpu with the simulation
+		constexpr unsigned Steps = 1 << 18;
+		const char* filename = "bench_recording.bin";
+
+		const uint32_t masks[] = {
+			Recorder::channel_bit(Recorder::Channel_N),
+			(1u << Recorder::Channel_Count) - 1,
+		};
+
+		double step_time = 0.0;
+		{
+			Core core;
+			auto start = Clock::now();
+			for(unsigned s = 0; s < Steps; ++s)
+			{
+				core.step();
+			}
+			step_time = seconds_since(start);
+		}
+
+		bool all_ok = true;
+		for(uint32_t mask : masks)
+		{
+			Recorder recorder;
+			if(!recorder.open(filename, mask, 4096, Steps))
+			{
+				printf("recorder: unable to open %s\n", filename);
+				return false;
+			}
+
+			Core core;
+			auto start = Clock::now();
+			for(unsigned s = 0; s < Steps; ++s)
+			{
+				core.step();
+				recorder.record(s * core.get_timestep(), core);
+			}
+			double record_time = seconds_since(start) - step_time;
+			bool ok = recorder.close();
+
+			// replay the run to check the recording is lossless
+			std::vector<double> flux;
+			Core replay;
+			for(unsigned s = 0; s < Steps; ++s)
+			{
+				replay.step();
+				flux.push_back(replay.get_flux());
+			}
+
+			std::vector<double> readback;
+			ok = ok && Recorder::read_channel(filename, Recorder::Channel_N, readback) && readback == flux;
+
+			double bytes = 0.0;
+			if(FILE* file = fopen(filename, "rb"))
+			{
+				fseek(file, 0, SEEK_END);
+				bytes = (double)ftell(file);
+				fclose(file);
+			}
+			remove(filename);
+
+			unsigned channels = __builtin_popcount(mask);
+			printf("recorder: %2u channels %8.1f ns/record  dropped %llu  %.2f bytes/value  readback %s\n",
+				channels, record_time / Steps * 1e9, (unsigned long long)recorder.get_dropped(),
+				bytes / ((channels + 1.0) * Steps), ok ? "ok" : "MISMATCH");
+			all_ok = all_ok && ok;
+		}
+
+		// a full disk has to show up in close(), not as a short file
+		bool full_reported = false;
+		{
+			Recorder recorder;
+			if(recorder.open("/dev/full", (1u << Recorder::Channel_Count) - 1, 4096, Steps))
+			{
+				Core core;
+				for(unsigned s = 0; s < 3 * 4096; ++s)
+				{
+					core.step();
+					recorder.record(s * core.get_timestep(), core);
+				}
+				full_reported = !recorder.close();
+			}
+		}
+
+		// a column claiming more bytes than the file holds is refused
+		// without allocating them
+		bool oversized_refused = false;
+		if(FILE* file = fopen(filename, "wb"))
+		{
+			const uint32_t words[] = { Recorder::Magic, Recorder::Version, Recorder::channel_bit(Recorder::Channel_N), 4096, 1, 0xFFFFFFF0u };
+			fwrite(words, sizeof(words), 1, file);
+			fclose(file);
+
+			std::vector<double> readback;
+			oversized_refused = !Recorder::read_channel(filename, Recorder::Channel_Count, readback);
+			remove(filename);
+		}
+
+		printf("recorder: write to a full disk %s, oversized column %s\n",
+			full_reported ? "reported" : "NOT REPORTED", oversized_refused ? "refused" : "ACCEPTED");
+		return all_ok && full_reported && oversized_refused;
+	}
+
+	bool bench_ensemble()
+	{
+		constexpr double Duration = 10.0;
+
+		Ensemble ensemble;
+		Ensemble::Axis axis;
+		if(!Ensemble::parse_axis("RodParams[2]=-4e-4:-1e-4:64", axis) || !ensemble.add_axis(axis)
+			|| !Ensemble::parse_axis("KtSG1=8e6:1e7:8", axis) || !ensemble.add_axis(axis)
+			|| !Ensemble::parse_axis("Cpsi=1e7:2e7:8", axis) || !ensemble.add_axis(axis))
+		{
+			printf("ensemble: bad sweep\n");
+			return false;
+		}
+
+		// every run must match a lone core of the same plant
+		BasicCore<RuntimePlant> check(ensemble.get_plant(ensemble.get_run_count() - 1));
+		for(unsigned long long s = 0; s < (unsigned long long)std::llround(Duration / check.get_timestep()); ++s)
+		{
+			check.step();
+		}
+
+		const unsigned hw_threads = std::thread::hardware_concurrency();
+		double single_rate = 0.0;
+		bool all_ok = true;
+		for(unsigned threads = 1; threads <= (hw_threads ? hw_threads : 1); threads *= 2)
+		{
+			sched_size needed_memory;
+			struct scheduler sched;
+			scheduler_init(&sched, &needed_memory, threads, 0);
+			void* memory = calloc(needed_memory, 1);
+			scheduler_start(&sched, memory);
+
+			auto start = Clock::now();
+			ensemble.run(Duration, &sched);
+			double rate = ensemble.get_run_count() / seconds_since(start);
+			if(threads == 1)
+			{
+				single_rate = rate;
+			}
+
+			scheduler_stop(&sched);
+			free(memory);
+
+			const Ensemble::Result& last = ensemble.get_results().back();
+			bool ok = last.final_flux == check.get_flux() && last.final_power == check.get_outputs().Wr;
+			printf("ensemble: %2u threads %8zu runs %10.1f runs/s  speedup x%.2f  %s\n",
+				threads, ensemble.get_run_count(), rate, rate / single_rate, ok ? "ok" : "MISMATCH");
+			all_ok = all_ok && ok;
+		}
+		return all_ok;
+	}
+
+	bool bench_steady()
+	{
+		// warm-up the way scenarios used to: step with the rods held until the
+		// flux stops changing
+		Core warm;
+		warm.set_rod_drive(false);
+		auto start = Clock::now();
+		unsigned long long steps = 0;
+		for(double previous = -1.0; warm.get_flux() != previous && steps < 100000000ull; ++steps)
+		{
+			previous = warm.get_flux();
+			warm.step();
+		}
+		double warm_time = seconds_since(start);
+
+		Core core;
+		Core::State steady;
+		start = Clock::now();
+		bool ok = core.solve_steady_state(core.get_inputs(), steady);
+		double solve_time = seconds_since(start);
+
+		printf("steady: warm-up %llu steps (%.1f s plant time) %10.3f ms  solve %8.3f ms  rel err %.3e  %s\n",
+			steps, steps * warm.get_timestep(), warm_time * 1e3, solve_time * 1e3,
+			relative_error(steady.N, warm.get_flux()), ok ? "converged" : "FAILED");
+		return ok;
+	}
+
+	// One day of plant time, unattended and checked once a minute: the rods
+	// withdraw for a few minutes and then sit still, and at noon the
+	// operator drops them back in. Returns the flux at each check.
+	std::vector<double> run_day(Core& core)
+	{
+		std::vector<double> flux;
+		for(unsigned minute = 0; minute < 24 * 60; ++minute)
+		{
+			if(minute == 12 * 60)
+			{
+				Core::Inputs inputs = core.get_inputs();
+				inputs.RodPosition = 1.0;
+				core.set_inputs(inputs);
+			}
+			core.simulate(60.0);
+			flux.push_back(core.get_flux());
+		}
+		return flux;
+	}
+
+	// The same day with the rod drive off while the operator eases the rods
+	// in from 2 to 1 a little every minute. The flux never quite settles,
+	// so each step has a real error for the adaptive mode to control.
+	std::vector<double> run_ramp(Core& core)
+	{
+		core.set_rod_drive(false);
+		std::vector<double> flux;
+		for(unsigned minute = 0; minute < 24 * 60; ++minute)
+		{
+			Core::Inputs inputs = core.get_inputs();
+			inputs.RodPosition = 2.0 - minute / (24.0 * 60.0);
+			core.set_inputs(inputs);
+			core.simulate(60.0);
+			flux.push_back(core.get_flux());
+		}
+		return flux;
+	}
+
+	bool bench_adaptive()
+	{
+		Core fixed;
+		fixed.set_integrator(Core::Integrator_ExponentialEuler);
+		auto start = Clock::now();
+		std::vector<double> reference = run_day(fixed);
+		double fixed_time = seconds_since(start);
+
+		printf("adaptive: %-9s %10s %8s %12s %14s\n", "tolerance", "steps", "rejected", "wall (ms)", "max rel err");
+		printf("adaptive: %-9s %10llu %8u %12.3f %14.3e\n", "fixed", (unsigned long long)fixed.get_step_count(), 0u, fixed_time * 1e3, 0.0);
+
+		const double tolerances[] = { 1e-4, 1e-6, 1e-8 };
+		for(double tolerance : tolerances)
+		{
+			Core core;
+			core.set_integrator(Core::Integrator_ExponentialEuler);
+			core.set_adaptive(true);
+			core.set_adaptive_tolerance(tolerance);
+
+			start = Clock::now();
+			std::vector<double> flux = run_day(core);
+			double adaptive_time = seconds_since(start);
+
+			double error = 0.0;
+			for(size_t i = 0; i < flux.size(); ++i)
+			{
+				error = std::fmax(error, relative_error(flux[i], reference[i]));
+			}
+
+			printf("adaptive: %-9.0e %10llu %8llu %12.3f %14.3e  x%.1f\n", tolerance,
+				(unsigned long long)core.get_step_count(), (unsigned long long)core.get_rejected_steps(),
+				adaptive_time * 1e3, error, fixed_time / adaptive_time);
+		}
+
+		// exp-euler is exact for the held inputs above, so its error estimate
+		// is zero and the tolerance never comes into it. Euler on the ramp
+		// has a real error: a tighter tolerance should take more steps,
+		// reject some, and land closer to the fixed step run.
+		Core ramp_fixed;
+		ramp_fixed.set_integrator(Core::Integrator_Euler);
+		start = Clock::now();
+		reference = run_ramp(ramp_fixed);
+		fixed_time = seconds_since(start);
+		printf("adaptive: euler ramp  %-9s %10llu %8u %12.3f %14.3e\n", "fixed",
+			(unsigned long long)ramp_fixed.get_step_count(), 0u, fixed_time * 1e3, 0.0);
+
+		const double ramp_tolerances[] = { 1e-3, 1e-4, 1e-5, 1e-6 };
+		uint64_t last_steps = 0;
+		double last_error = INFINITY;
+		uint64_t rejected = 0;
+		bool controlled = true;
+		for(double tolerance : ramp_tolerances)
+		{
+			Core core;
+			core.set_integrator(Core::Integrator_Euler);
+			core.set_adaptive(true);
+			core.set_adaptive_tolerance(tolerance);
+
+			start = Clock::now();
+			std::vector<double> flux = run_ramp(core);
+			double adaptive_time = seconds_since(start);
+
+			double error = 0.0;
+			for(size_t i = 0; i < flux.size(); ++i)
+			{
+				error = std::fmax(error, relative_error(flux[i], reference[i]));
+			}
+
+			printf("adaptive: euler ramp  %-9.0e %10llu %8llu %12.3f %14.3e  x%.1f\n", tolerance,
+				(unsigned long long)core.get_step_count(), (unsigned long long)core.get_rejected_steps(),
+				adaptive_time * 1e3, error, fixed_time / adaptive_time);
+
+			// the error is per step, so over the day it may run past the
+			// tolerance, but not by an order of magnitude
+			controlled = controlled && core.get_step_count() > last_steps && error < last_error && error < 10.0 * tolerance;
+			last_steps = core.get_step_count();
+			last_error = error;
+			rejected += core.get_rejected_steps();
+		}
+		printf("adaptive: euler ramp  tolerance %s\n",
+			(controlled && rejected > 0) ? "controls steps and error" : "NOT EFFECTIVE");
+		return controlled && rejected > 0;
+	}
+
+	// Low flux trip for the events benchmark: knock the rods back in to
+	// 0.5 and let the drive carry on withdrawing them
+	constexpr double TripFlux = 28.0;
+	constexpr double TripDuration = 1000.0;
+
+	void trip(Core& core, void*)
+	{
+		Core::Inputs inputs = core.get_inputs();
+		inputs.RodPosition = 0.5;
+		core.set_inputs(inputs);
+	}
+
+	Core trip_start()
+	{
+		Core core;
+		core.set_integrator(Core::Integrator_ExponentialEuler);
+		Core::State steady;
+		if(core.solve_steady_state(core.get_inputs(), steady))
+		{
+			core.set_state(steady);
+		}
+		return core;
+	}
+
+	// The trip checked after every fixed step
+	std::vector<double> poll_trips(double timestep, uint64_t& steps)
+	{
+		Core core = trip_start();
+		core.set_timestep(timestep);
+
+		std::vector<double> times;
+		const unsigned long long count = (unsigned long long)std::llround(TripDuration / timestep);
+		for(unsigned long long s = 1; s <= count; ++s)
+		{
+			const double before = core.get_flux();
+			core.step();
+			if(before > TripFlux && core.get_flux() <= TripFlux)
+			{
+				times.push_back(s * timestep);
+				trip(core, nullptr);
+			}
+		}
+		steps = core.get_step_count();
+		return times;
+	}
+
+	bool bench_events()
+	{
+		uint64_t steps;
+		const std::vector<double> reference = poll_trips(1.0 / 7680.0, steps);
+
+		// the error of the first trip time only, later trips also carry the
+		// drift of the rods from the earlier ones
+		printf("events: %-20s %6s %10s %10s %14s %10s\n", "method", "trips", "steps", "locating", "first trip err", "wall (ms)");
+
+		const double poll_steps[] = { 1.0 / 60.0, 1.0 };
+		for(double timestep : poll_steps)
+		{
+			auto start = Clock::now();
+			std::vector<double> times = poll_trips(timestep, steps);
+			double wall = seconds_since(start);
+
+			double error = (!times.empty() && !reference.empty()) ? std::fabs(times[0] - reference[0]) : INFINITY;
+			printf("events: poll every %-9.5f s %6zu %10llu %10u %14.3e %10.3f\n",
+				timestep, times.size(), (unsigned long long)steps, 0u, error, wall * 1e3);
+		}
+
+		// every located run must find the trips the reference run does
+		bool ok = true;
+		double setpoint = TripFlux;
+		// a zero tolerance is floored rather than bisecting forever
+		const double event_steps[][2] = { { 1.0, 1e-6 }, { 10.0, 1e-6 }, { 10.0, 0.0 } };
+		for(const double* event_step : event_steps)
+		{
+			const double timestep = event_step[0];
+			Core core = trip_start();
+			core.set_timestep(timestep);
+
+			EventMonitor monitor;
+			monitor.set_time_tolerance(event_step[1]);
+			unsigned low_flux = monitor.add_event("low flux", EventMonitor::flux_minus_setpoint, EventMonitor::Direction_Falling, trip, &setpoint);
+
+			std::vector<double> times;
+			uint64_t calls = 0;
+			auto start = Clock::now();
+			for(double t = 0.0; t < TripDuration; t += timestep, ++calls)
+			{
+				const uint64_t before = monitor.get_event(low_flux).count;
+				monitor.simulate(core, timestep);
+				if(monitor.get_event(low_flux).count != before)
+				{
+					times.push_back(monitor.get_event(low_flux).last_time);
+				}
+			}
+			double wall = seconds_since(start);
+
+			double error = (!times.empty() && !reference.empty()) ? std::fabs(times[0] - reference[0]) : INFINITY;
+			printf("events: events every %-7.5g s %6zu %10llu %10llu %14.3e %10.3f  (%llu localizations, tolerance %g s)\n",
+				timestep, times.size(), (unsigned long long)core.get_step_count(),
+				(unsigned long long)monitor.get_localization_steps(), error, wall * 1e3,
+				(unsigned long long)monitor.get_localizations(), event_step[1]);
+			// located crossings must not add steps to the count replay keys on
+			ok = ok && times.size() == reference.size() && core.get_step_count() == calls;
+		}
+
+		// 0.1 s is not a whole number of 1/60 s steps in binary, and the
+		// leftover must not become an extra step each time
+		bool whole_steps = true;
+		{
+			Core core = trip_start();
+			EventMonitor monitor;
+			monitor.add_event("low flux", EventMonitor::flux_minus_setpoint, EventMonitor::Direction_Falling, nullptr, &setpoint);
+			for(unsigned i = 0; i < 60; ++i)
+			{
+				monitor.simulate(core, 0.1);
+			}
+			whole_steps = core.get_step_count() == 360;
+			printf("events: 60 x 0.1 s in 1/60 s steps took %llu steps\n", (unsigned long long)core.get_step_count());
+		}
+		printf("events: located runs %s, step count %s\n", ok ? "find every trip" : "MISS TRIPS",
+			whole_steps && ok ? "follows plant time" : "DRIFTS from plant time");
+		return ok && whole_steps;
+	}
+
+	bool bench_properties()
+	{
+		constexpr size_t Count = 1 << 20;
+		constexpr double MinX = 1e-3;
+		constexpr double MaxX = 1e3;
+		constexpr double Tolerance = 1e-12;
+
+		// log-uniform magnitudes across the table, either sign, plus a few
+		// values outside it that must fall back to pow
+		std::vector<double> x(Count);
+		srand(1);
+		for(size_t i = 0; i < Count; ++i)
+		{
+			double magnitude = MinX * std::pow(MaxX / MinX, (double)rand() / RAND_MAX);
+			x[i] = (rand() % 4 == 0) ? -magnitude : magnitude;
+		}
+		const double outside[] = { 0.0, -0.0, 1e-9, 1e9, INFINITY, -INFINITY, NAN, 5e-324 };
+		for(size_t i = 0; i < sizeof(outside) / sizeof(outside[0]); ++i)
+		{
+			x[i * 1000] = outside[i];
+		}
+
+		std::vector<double> reference(Count), result(Count);
+		bool all_ok = true;
+
+		const char* names[] = { "alpha", "beta" };
+		const double exponents[] = { PlantParams::alpha, PlantParams::beta };
+		for(size_t e = 0; e < sizeof(exponents) / sizeof(exponents[0]); ++e)
+		{
+			auto start = Clock::now();
+			for(size_t i = 0; i < Count; ++i)
+			{
+				reference[i] = Properties::my_pow(x[i], exponents[e]);
+			}
+			double pow_time = seconds_since(start);
+
+			PowerTable table;
+			if(!table.build(exponents[e], MinX, MaxX, Tolerance))
+			{
+				printf("properties: unable to build a table for %s\n", names[e]);
+				all_ok = false;
+				continue;
+			}
+			printf("properties: pow %-5s %4u segments  bound %.3e  %8.1f Mevals/s\n",
+				names[e], table.get_segment_count(), table.get_error_bound(), Count / pow_time * 1e-6);
+
+			for(int k = PowerTable::Kernel_Scalar; k <= PowerTable::best_kernel(); ++k)
+			{
+				table.set_kernel((PowerTable::Kernel)k);
+
+				start = Clock::now();
+				table.evaluate(x.data(), result.data(), Count);
+				double table_time = seconds_since(start);
+
+				// the fallback values must match exactly, the rest within the bound
+				double error = 0.0;
+				bool exact = true;
+				for(size_t i = 0; i < Count; ++i)
+				{
+					if(std::fabs(x[i]) >= MinX && std::fabs(x[i]) < 2.0 * MaxX)
+					{
+						double e = relative_error(result[i], reference[i]);
+						error = e > error ? e : error;
+					}
+					else if(memcmp(&result[i], &reference[i], sizeof(double)) != 0)
+					{
+						exact = false;
+					}
+				}
+
+				printf("properties: %-6s %-5s max rel err %.3e  %8.1f Mevals/s  x%.2f  %s\n",
+					PowerTable::kernel_name(table.get_kernel()), names[e], error, Count / table_time * 1e-6,
+					pow_time / table_time, (error <= table.get_error_bound() && exact) ? "ok" : "OUT OF BOUND");
+				all_ok = all_ok && error <= table.get_error_bound() && exact;
+			}
+		}
+
+		std::vector<double> temperature(Count);
+		for(size_t i = 0; i < Count; ++i)
+		{
+			temperature[i] = 200.0 + 150.0 * rand() / RAND_MAX;
+		}
+
+		auto start = Clock::now();
+		Properties::water_density(temperature.data(), result.data(), Count);
+		double density_time = seconds_since(start);
+		start = Clock::now();
+		Properties::saturated_vapor_pressure(temperature.data(), reference.data(), Count);
+		double pressure_time = seconds_since(start);
+
+		bool ok = true;
+		for(size_t i = 0; i < Count; ++i)
+		{
+			ok = ok && result[i] == Properties::water_density(temperature[i]) && reference[i] == Properties::saturated_vapor_pressure(temperature[i]);
+		}
+		printf("properties: water_density %8.1f Mevals/s  saturated_vapor_pressure %8.1f Mevals/s  %s\n",
+			Count / density_time * 1e-6, Count / pressure_time * 1e-6, ok ? "ok" : "MISMATCH");
+		return all_ok && ok;
+	}
+
+	// Steps a fresh core of the given plant type, returning the wall time
+	template<typename CoreType>
+	double time_plant(Core::Integrator integrator, unsigned steps, double& flux)
+	{
+		CoreType core;
+		core.set_integrator(integrator);
+		core.set_rod_drive(false);
+
+		auto start = Clock::now();
+		for(unsigned s = 0; s < steps; ++s)
+		{
+			core.step();
+		}
+		double elapsed = seconds_since(start);
+
+		flux = core.get_flux();
+		return elapsed;
+	}
+
+	bool bench_plants()
+	{
+		constexpr unsigned Steps = 1 << 20;
+
+		const char* names[] = { "euler", "exp-euler", "rosenbrock" };
+		const Core::Integrator integrators[] = { Core::Integrator_Euler, Core::Integrator_ExponentialEuler, Core::Integrator_Rosenbrock };
+
+		bool ok = true;
+		for(size_t i = 0; i < sizeof(integrators) / sizeof(integrators[0]); ++i)
+		{
+			// best of a few alternating runs, so neither side gets a colder cache
+			double tunable_flux, constant_flux;
+			double tunable = INFINITY, constant = INFINITY;
+			for(int run = 0; run < 3; ++run)
+			{
+				tunable = std::min(tunable, time_plant<BasicCore<TunablePlant>>(integrators[i], Steps, tunable_flux));
+				constant = std::min(constant, time_plant<Core>(integrators[i], Steps, constant_flux));
+			}
+
+			printf("plants: %-10s tunable %7.1f ns/step  constexpr %7.1f ns/step  %.2fx  flux %s\n",
+				names[i], tunable / Steps * 1e9, constant / Steps * 1e9, tunable / constant,
+				tunable_flux == constant_flux ? "matches" : "MISMATCH");
+			ok = ok && tunable_flux == constant_flux;
+		}
+		return ok;
+	}
+
+	bool bench_replay()
+	{
+		constexpr unsigned Steps = 1 << 18;
+		const char* filename = "bench_inputs.bin";
+
+		// a synthetic operator session: the rod drive is off and the operator
+		// moves the rods and the flows now and then
+		std::vector<double> flux;
+		InputTimeline timeline;
+		{
+			Core core;
+			core.set_rod_drive(false);
+			timeline.begin(core);
+
+			srand(1);
+			for(unsigned s = 0; s < Steps; ++s)
+			{
+				if(rand() % 64 == 0)
+				{
+					Core::Inputs inputs = core.get_inputs();
+					inputs.RodPosition = 2.25 * rand() / RAND_MAX;
+					if(rand() % 4 == 0)
+					{
+						inputs.Min = 10.0 * rand() / RAND_MAX;
+						inputs.Msgin = 10.0 * rand() / RAND_MAX;
+					}
+					timeline.record(core, inputs);
+					core.set_inputs(inputs);
+				}
+				core.step();
+				flux.push_back(core.get_flux());
+			}
+		}
+
+		InputTimeline loaded;
+		bool ok = timeline.save(filename) && loaded.load(filename);
+
+		// a corrupt file must be refused, not allocated or read past
+		bool rejects = false;
+		{
+			std::vector<uint8_t> bytes;
+			FILE* file = fopen(filename, "rb");
+			if(file)
+			{
+				int c;
+				while((c = fgetc(file)) != EOF)
+				{
+					bytes.push_back((uint8_t)c);
+				}
+				fclose(file);
+			}
+
+			auto loads = [&](const std::vector<uint8_t>& data)
+			{
+				FILE* out = fopen(filename, "wb");
+				bool written = out && fwrite(data.data(), 1, data.size(), out) == data.size();
+				if(out)
+				{
+					fclose(out);
+				}
+				InputTimeline check;
+				return written && check.load(filename);
+			};
+
+			const size_t events = 8 + 2 * sizeof(uint64_t) + sizeof(Core::Snapshot);
+			if(bytes.size() > events)
+			{
+				std::vector<uint8_t> huge = bytes;
+				const uint64_t size = ~(uint64_t)0 >> 4;
+				memcpy(&huge[8 + sizeof(uint64_t)], &size, sizeof(size));
+
+				std::vector<uint8_t> mask = bytes;
+				size_t pos = events;
+				while(mask[pos] & 0x80)
+				{
+					++pos;
+				}
+				mask[pos + 1] |= 0x80;
+
+				std::vector<uint8_t> varint = bytes;
+				varint.insert(varint.begin() + events, 12, 0xFF);
+				uint64_t grown;
+				memcpy(&grown, &varint[8 + sizeof(uint64_t)], sizeof(grown));
+				grown += 12;
+				memcpy(&varint[8 + sizeof(uint64_t)], &grown, sizeof(grown));
+
+				rejects = loads(bytes) && !loads(huge) && !loads(mask) && !loads(varint);
+			}
+		}
+		remove(filename);
+
+		Core core;
+		InputReplay replay(loaded);
+		ok = ok && replay.start(core);
+
+		std::vector<double> replayed;
+		replayed.reserve(Steps);
+		auto start = Clock::now();
+		for(unsigned s = 0; s < Steps; ++s)
+		{
+			replay.apply_pending(core);
+			core.step();
+			replayed.push_back(core.get_flux());
+		}
+		double elapsed = seconds_since(start);
+		ok = ok && replayed == flux && replay.is_finished();
+
+		printf("replay: %llu events %.2f bytes/event  %.0f steps/s  flux %s  corrupt files %s\n",
+			(unsigned long long)loaded.get_event_count(),
+			(double)loaded.get_encoded_size() / loaded.get_event_count(),
+			Steps / elapsed, ok ? "matches" : "MISMATCH", rejects ? "rejected" : "ACCEPTED");
+		return ok && rejects;
+	}
+
+	bool bench_snapshot()
+	{
+		constexpr unsigned Repeats = 1000000;
+		const char* filename = "bench_snapshot.bin";
+
+		Core core;
+		core.set_integrator(Core::Integrator_ExponentialEuler);
+		core.set_neutronics_substeps(4);
+		core.simulate(100.5);
+
+		auto start = Clock::now();
+		Core::Snapshot snapshot;
+		Core restored;
+		bool ok = true;
+		for(unsigned r = 0; r < Repeats; ++r)
+		{
+			snapshot = core.get_snapshot();
+			ok = restored.restore_snapshot(snapshot) && ok;
+		}
+		const double round_trip = seconds_since(start) / Repeats;
+
+		Core loaded;
+		ok = ok && core.save_snapshot(filename) && loaded.load_snapshot(filename);
+		restored.simulate(60.0);
+		loaded.simulate(60.0);
+		core.simulate(60.0);
+		ok = ok && restored.get_flux() == core.get_flux() && loaded.get_flux() == core.get_flux();
+
+		// an adaptive core resumes adaptive, with its step where it left it
+		Core adaptive;
+		adaptive.set_integrator(Core::Integrator_ExponentialEuler);
+		adaptive.set_adaptive(true);
+		adaptive.set_adaptive_tolerance(1e-5);
+		adaptive.simulate(600.0);
+		Core resumed;
+		ok = ok && resumed.restore_snapshot(adaptive.get_snapshot()) && resumed.get_adaptive()
+			&& resumed.get_adaptive_step() == adaptive.get_adaptive_step();
+		adaptive.simulate(600.0);
+		resumed.simulate(600.0);
+		ok = ok && resumed.get_flux() == adaptive.get_flux() && resumed.get_step_count() == adaptive.get_step_count();
+
+		// settings a core cannot run must be refused rather than hang
+		// simulate() or a step, straight or through a file
+		auto rejects = [&](void (*corrupt)(Core::Snapshot&))
+		{
+			Core::Snapshot bad = core.get_snapshot();
+			corrupt(bad);
+			FILE* file = fopen(filename, "wb");
+			bool written = file && fwrite(&bad, sizeof(bad), 1, file) == 1;
+			if(file)
+			{
+				fclose(file);
+			}
+			Core check;
+			return written && !check.restore_snapshot(bad) && !check.load_snapshot(filename);
+		};
+		void (*const corruptions[])(Core::Snapshot&) =
+		{
+			[](Core::Snapshot& s) { s.magic = 0; },
+			[](Core::Snapshot& s) { s.version = Core::Snapshot::Version + 1; },
+			[](Core::Snapshot& s) { s.integrator = Core::Integrator_Rosenbrock + 1; },
+			[](Core::Snapshot& s) { s.timestep = 0.0; },
+			[](Core::Snapshot& s) { s.timestep = -Core::FixedTimestep; },
+			[](Core::Snapshot& s) { s.timestep = NAN; },
+			[](Core::Snapshot& s) { s.timestep = INFINITY; },
+			[](Core::Snapshot& s) { s.timebank = -1.0; },
+			[](Core::Snapshot& s) { s.timebank = NAN; },
+			[](Core::Snapshot& s) { s.timebank = INFINITY; },
+			[](Core::Snapshot& s) { s.neutronics_substeps = 0xFFFFFFF0u; },
+			[](Core::Snapshot& s) { s.adaptive_tolerance = NAN; },
+			[](Core::Snapshot& s) { s.max_timestep = 0.0; },
+		};
+		unsigned rejected = 0;
+		for(auto corrupt : corruptions)
+		{
+			rejected += rejects(corrupt) ? 1 : 0;
+		}
+		remove(filename);
+
+		Core clamped;
+		clamped.set_neutronics_substeps(~0u);
+		const unsigned corrupt_count = sizeof(corruptions) / sizeof(corruptions[0]);
+		const bool refused = rejected == corrupt_count && clamped.get_neutronics_substeps() == Core::MaxNeutronicsSubsteps;
+
+		printf("snapshot: %zu bytes  get and restore %.1f ns  resumed run %s  corrupt snapshots rejected %u of %u%s\n",
+			sizeof(Core::Snapshot), round_trip * 1e9, ok ? "matches" : "MISMATCH", rejected, corrupt_count,
+			refused ? "" : "  ACCEPTED");
+		return ok && refused;
+	}
+
+	bool bench_graph()
+	{
+		constexpr unsigned Steps = 600;
+		constexpr double Power = 100.0 * PlantParams::Cpsi;
+		// the vessel sees the loops through loose links a step late
+		constexpr double CouplingTolerance = 2e-3;
+
+		bool all_ok = true;
+		for(unsigned loops : { 4u, 64u, 512u })
+		{
+			// the same plant on the calling thread, against which every
+			// threaded run must match exactly
+			PlantGraph serial;
+			MultiLoopPlant indices = build_multiloop_plant(serial, loops, Power, true);
+			serial.set_substeps(10);
+			auto start = Clock::now();
+			for(unsigned s = 0; s < Steps; ++s)
+			{
+				serial.step(1.0);
+			}
+			double serial_rate = Steps / seconds_since(start);
+			const double Tpc = serial.get_state(indices.vessel)[ReactorVessel::State_Tpc];
+
+			// the coupling error of splitting the loops from the vessel
+			PlantGraph whole;
+			build_multiloop_plant(whole, loops, Power, false);
+			whole.set_substeps(10);
+			for(unsigned s = 0; s < Steps; ++s)
+			{
+				whole.step(1.0);
+			}
+
+			const double coupling_error = relative_error(Tpc, whole.get_state(indices.vessel)[ReactorVessel::State_Tpc]);
+			printf("graph: %3u loops %4zu subsystems  serial %9.1f steps/s  Tpc %.3f  loose coupling rel err %.3e  %s %.0e\n",
+				loops, serial.get_subsystem_count(), serial_rate, Tpc, coupling_error,
+				coupling_error <= CouplingTolerance ? "within" : "ABOVE", CouplingTolerance);
+			all_ok = all_ok && coupling_error <= CouplingTolerance;
+
+			const unsigned hw_threads = std::thread::hardware_concurrency();
+			for(unsigned threads = 1; threads <= (hw_threads ? hw_threads : 1); threads *= 2)
+			{
+				sched_size needed_memory;
+				struct scheduler sched;
+				scheduler_init(&sched, &needed_memory, threads, 0);
+				void* memory = calloc(needed_memory, 1);
+				scheduler_start(&sched, memory);
+
+				PlantGraph graph;
+				build_multiloop_plant(graph, loops, Power, true);
+				graph.set_substeps(10);
+				start = Clock::now();
+				for(unsigned s = 0; s < Steps; ++s)
+				{
+					graph.step(1.0, &sched);
+				}
+				double rate = Steps / seconds_since(start);
+
+				scheduler_stop(&sched);
+				free(memory);
+
+				bool ok = graph.get_state(indices.vessel)[ReactorVessel::State_Tpc] == Tpc;
+				printf("graph: %3u loops %2u threads %9.1f steps/s  speedup x%.2f  %s\n",
+					loops, threads, rate, rate / serial_rate, ok ? "ok" : "MISMATCH");
+				all_ok = all_ok && ok;
+			}
+		}
+		return all_ok;
+	}
+
+	bool bench_jacobian()
+	{
+		constexpr unsigned Repeats = 200000;
+		// central differences at these deltas are good to about 1e-9
+		constexpr double Tolerance = 1e-7;
+		typedef Core::StepJacobian Jacobian;
+
+		bool ok = true;
+
+		const char* names[] = { "euler", "exp-euler", "rosenbrock" };
+		for(int integrator = Core::Integrator_Euler; integrator <= Core::Integrator_Rosenbrock; ++integrator)
+		{
+			Core core;
+			core.set_integrator((Core::Integrator)integrator);
+			core.set_neutronics_substeps(4);
+			for(unsigned s = 0; s < 600; ++s)
+			{
+				core.step();
+			}
+
+			auto start = Clock::now();
+			Core stepped;
+			for(unsigned r = 0; r < Repeats; ++r)
+			{
+				stepped = core;
+				stepped.step();
+			}
+			const double step_time = seconds_since(start) / Repeats;
+
+			Jacobian jacobian;
+			start = Clock::now();
+			for(unsigned r = 0; r < Repeats; ++r)
+			{
+				core.get_step_jacobian(jacobian);
+			}
+			const double jacobian_time = seconds_since(start) / Repeats;
+
+			// central differences on the two columns the step depends on,
+			// against which the dual numbers must agree to truncation error
+			auto difference = [&](int column, double delta)
+			{
+				Core plus = core, minus = core;
+				Core::Inputs inputs = core.get_inputs();
+				Core::State state = core.get_state();
+				double* field = (column < Core::InputCount) ? (double*)&inputs + column : (double*)&state + column - Core::InputCount;
+				const double centre = *field;
+
+				*field = centre + delta;
+				plus.set_inputs(inputs);
+				plus.set_state(state);
+				*field = centre - delta;
+				minus.set_inputs(inputs);
+				minus.set_state(state);
+				plus.step();
+				minus.step();
+				return (plus.get_outputs().Wr - minus.get_outputs().Wr) / (2.0 * delta);
+			};
+			const int rod = 0, flux = Core::InputCount;
+			const double error = std::max(relative_error(jacobian.outputs[0][rod], difference(rod, 1e-6)),
+				relative_error(jacobian.outputs[0][flux], difference(flux, 1e-6 * core.get_flux())));
+
+			printf("jacobian: %-10s step %7.1f ns  jacobian %7.1f ns (x%.2f, finite differences x%d)  rel err %.2e  %s\n",
+				names[integrator], step_time * 1e9, jacobian_time * 1e9, jacobian_time / step_time, Jacobian::Columns + 1, error,
+				error <= Tolerance ? "ok" : "MISMATCH");
+			ok = ok && error <= Tolerance;
+		}
+		return ok;
+	}
+
+	bool bench_publish()
+	{
+		constexpr unsigned Frames = 1000000;
+		const char* name = "/nuke-sim-bench";
+
+		// replacing whatever a crashed earlier run left behind
+		StatePublisher publisher;
+		StateSubscriber subscriber;
+		if(!publisher.open(name, 64, true) || !subscriber.open(name))
+		{
+			printf("publish: unable to create shared memory\n");
+			return false;
+		}
+
+		// a reader polling the newest frame as fast as it can; a torn copy
+		// would show as a power that does not match the flux or a step count
+		// that does not match the frame
+		std::atomic_bool running(true);
+		unsigned long long reads = 0, torn = 0;
+		std::thread reader([&]()
+		{
+			StateSubscriber::Frame frame;
+			while(running.load(std::memory_order_relaxed))
+			{
+				if(subscriber.read_latest(frame))
+				{
+					++reads;
+					if(frame.outputs.Wr != PlantParams::Cpsi * frame.state.N || frame.step_count != frame.frame + 1)
+					{
+						++torn;
+					}
+				}
+			}
+		});
+
+		// and a logger that wants every frame, catching up every 32 frames
+		StateSubscriber logger;
+		logger.open(name);
+		StateSubscriber::Frame frame;
+		unsigned long long logged = 0;
+
+		Core core;
+		double step_time = 0.0, publish_time = 0.0;
+		for(unsigned f = 0; f < Frames; ++f)
+		{
+			auto start = Clock::now();
+			core.step();
+			auto middle = Clock::now();
+			publisher.publish((f + 1) * core.get_timestep(), core);
+			auto end = Clock::now();
+			step_time += std::chrono::duration<double>(middle - start).count();
+			publish_time += std::chrono::duration<double>(end - middle).count();
+
+			if(f % 32 == 31)
+			{
+				while(logger.read_next(frame))
+				{
+					++logged;
+				}
+			}
+		}
+		running = false;
+		reader.join();
+		while(logger.read_next(frame))
+		{
+			++logged;
+		}
+
+		// a second publisher under the same name is refused, and the first
+		// one's readers keep getting its frames; asking to replace it works
+		StatePublisher second;
+		bool name_kept = !second.open(name, 64);
+		publisher.publish((Frames + 1) * core.get_timestep(), core);
+		name_kept = name_kept && logger.read_next(frame) && frame.frame == Frames;
+		const bool replaced = second.open(name, 64, true);
+
+		printf("publish: %u frames, step %.1f ns  publish %.1f ns  reader %llu reads, %llu torn\n",
+			Frames, step_time / Frames * 1e9, publish_time / Frames * 1e9, reads, torn);
+		printf("publish: logger read %llu frames, %llu dropped\n", logged, (unsigned long long)logger.get_dropped());
+		printf("publish: a second publisher on the name %s, replacing it %s\n",
+			name_kept ? "is refused" : "TAKES IT OVER", replaced ? "works" : "FAILS");
+		return torn == 0 && logged + logger.get_dropped() == Frames && name_kept && replaced;
+	}
+
+	bool bench_outputs()
+	{
+		constexpr unsigned Cores = 64;
+		constexpr unsigned Frames = 2000;
+		constexpr double FrameTime = 0.1;
+
+		// a display that shows every output after each frame against one that
+		// only plots the flux; the derived outputs cost nothing in the second
+		bool ok = true;
+		for(int pattern = 0; pattern < 2; ++pattern)
+		{
+			std::vector<Core> cores(Cores);
+			double sink = 0.0;
+			unsigned stale = 0;
+
+			auto start = Clock::now();
+			for(unsigned f = 0; f < Frames; ++f)
+			{
+				for(Core& core : cores)
+				{
+					core.simulate(FrameTime);
+					if(pattern == 0)
+					{
+						Core::Outputs outputs = core.get_outputs();
+						sink += outputs.Wr + outputs.Mpr + outputs.Ppr + outputs.Lpr + outputs.Psg + outputs.Tout;
+						stale += outputs.Wr != PlantParams::Cpsi * core.get_flux();
+					}
+					else
+					{
+						sink += core.get_flux();
+					}
+				}
+			}
+			double elapsed = seconds_since(start);
+
+			const double steps = (double)Cores * Frames * std::round(FrameTime / Core::FixedTimestep);
+			printf("outputs: %-9s %6.1f ns/step  %u stale  (%g)\n",
+				pattern == 0 ? "all" : "flux only", elapsed / steps * 1e9, stale, sink);
+			ok = ok && stale == 0;
+		}
+		return ok;
+	}
+
+	// One frame of a sim, render, log pipeline: the cores are stepped, render
+	// ops are built from them and a logger folds the ops into a checksum
+	struct Pipeline;
+
+	struct PipelineFrame
+	{
+		Pipeline* pipeline;
+		unsigned index;
+		struct sched_task sim, render, log;
+		struct sched_dependency sim_after_render, sim_after_log, render_after_sim, log_after_render, log_after_log;
+		Clock::time_point submitted;
+	};
+
+	struct Pipeline
+	{
+		static constexpr unsigned StepsPerFrame = 4;
+		static constexpr unsigned OpsPerCore = 4;
+
+		std::vector<Core> cores;
+		// double buffered, frame n renders into ops[n % 2]
+		std::vector<double> ops[2];
+		uint64_t checksum;
+		std::vector<double> latency;
+	};
+
+	void pipeline_sim(void* pArg, struct scheduler*, sched_uint begin, sched_uint end, sched_uint)
+	{
+		Pipeline* pipeline = ((PipelineFrame*)pArg)->pipeline;
+		for(sched_uint i = begin; i < end; ++i)
+		{
+			for(unsigned s = 0; s < Pipeline::StepsPerFrame; ++s)
+			{
+				pipeline->cores[i].step();
+			}
+		}
+	}
+
+	void pipeline_render(void* pArg, struct scheduler*, sched_uint begin, sched_uint end, sched_uint)
+	{
+		PipelineFrame* frame = (PipelineFrame*)pArg;
+		Pipeline* pipeline = frame->pipeline;
+		double* ops = pipeline->ops[frame->index % 2].data();
+		for(sched_uint i = begin; i < end; ++i)
+		{
+			const Core& core = pipeline->cores[i];
+			const Core::Outputs outputs = core.get_outputs();
+			double* op = ops + i * Pipeline::OpsPerCore;
+			op[0] = std::log10(outputs.Wr);
+			op[1] = core.get_inputs().RodPosition / CoreBase::RodEndStop;
+			op[2] = std::sqrt(core.get_flux());
+			op[3] = core.get_reactivity();
+		}
+	}
+
+	void pipeline_log(void* pArg, struct scheduler*, sched_uint, sched_uint, sched_uint)
+	{
+		PipelineFrame* frame = (PipelineFrame*)pArg;
+		Pipeline* pipeline = frame->pipeline;
+		for(double op : pipeline->ops[frame->index % 2])
+		{
+			uint64_t bits;
+			memcpy(&bits, &op, sizeof(bits));
+			pipeline->checksum = (pipeline->checksum ^ bits) * 1099511628211ull;
+		}
+		pipeline->latency.push_back(seconds_since(frame->submitted));
+	}
+
+	void spin_for(double seconds)
+	{
+		auto start = Clock::now();
+		while(seconds_since(start) < seconds)
+		{
+		}
+	}
+
+	bool bench_pipeline()
+	{
+		constexpr unsigned Cores = 1024;
+		constexpr unsigned Frames = 600;
+		// most frames in flight when the stages are chained by dependencies
+		constexpr unsigned Slots = 3;
+		// empty tasks each depending on the last, all finished by one call
+		constexpr unsigned ChainLength = 1000000;
+		// the join chain, then dependencies with one frame in flight, whose
+		// latency compares with the join chain's, then with Slots in flight
+		const char* const modes[] = { "join chain", "dependencies", "dependencies" };
+		const unsigned in_flight[] = { 1, 1, Slots };
+		// the caller's own work each frame, input and the like
+		constexpr double CallerWork = 200e-6;
+
+		bool ok = true;
+		const unsigned hw_threads = std::thread::hardware_concurrency();
+		for(unsigned threads = 1; threads <= (hw_threads ? hw_threads : 1); threads *= 2)
+		{
+			sched_size needed_memory;
+			struct scheduler sched;
+			scheduler_init(&sched, &needed_memory, threads, 0);
+			void* memory = calloc(needed_memory, 1);
+			scheduler_start(&sched, memory);
+
+			uint64_t checksums[3];
+			for(int mode = 0; mode < 3; ++mode)
+			{
+				const bool chained = mode > 0;
+				const unsigned slots = in_flight[mode];
+				Pipeline pipeline;
+				pipeline.cores.resize(Cores);
+				for(unsigned i = 0; i < Cores; ++i)
+				{
+					Core::Inputs inputs = pipeline.cores[i].get_inputs();
+					inputs.RodPosition = 2.0 * i / Cores;
+					pipeline.cores[i].set_inputs(inputs);
+				}
+				pipeline.ops[0].resize(Cores * Pipeline::OpsPerCore);
+				pipeline.ops[1].resize(Cores * Pipeline::OpsPerCore);
+				pipeline.checksum = 14695981039346656037ull;
+				pipeline.latency.reserve(Frames);
+
+				PipelineFrame frames[Slots];
+				for(PipelineFrame& frame : frames)
+				{
+					frame.pipeline = &pipeline;
+				}
+
+				double blocked = 0.0;
+				auto start = Clock::now();
+				for(unsigned n = 0; n < Frames; ++n)
+				{
+					PipelineFrame& frame = frames[n % slots];
+					if(!chained)
+					{
+						// each stage waits for the last, and so does the caller
+						frame.index = n;
+						frame.submitted = Clock::now();
+						scheduler_add(&frame.sim, &sched, pipeline_sim, &frame, Cores);
+						scheduler_join(&sched, &frame.sim);
+						scheduler_add(&frame.render, &sched, pipeline_render, &frame, Cores);
+						scheduler_join(&sched, &frame.render);
+						scheduler_add(&frame.log, &sched, pipeline_log, &frame, 1);
+						scheduler_join(&sched, &frame.log);
+						blocked += seconds_since(frame.submitted);
+						spin_for(CallerWork);
+						continue;
+					}
+
+					// the slot is free once all of frame n - slots has finished
+					if(n >= slots)
+					{
+						auto wait = Clock::now();
+						scheduler_join(&sched, &frame.sim);
+						scheduler_join(&sched, &frame.render);
+						scheduler_join(&sched, &frame.log);
+						blocked += seconds_since(wait);
+					}
+
+					frame.index = n;
+					scheduler_prepare(&frame.sim, pipeline_sim, &frame, Cores);
+					scheduler_prepare(&frame.render, pipeline_render, &frame, Cores);
+					scheduler_prepare(&frame.log, pipeline_log, &frame, 1);
+
+					// stepping the cores has to wait for the last frame's render
+					// to read them, rendering into a buffer for the log two
+					// frames back to be done with it, and the logger for the
+					// last frame to be logged. Frames that left their slot
+					// were joined above.
+					if(n >= 1 && slots > 1)
+					{
+						scheduler_depend(&frame.sim, &frames[(n - 1) % slots].render, &frame.sim_after_render);
+						scheduler_depend(&frame.log, &frames[(n - 1) % slots].log, &frame.log_after_log);
+					}
+					if(n >= 2 && slots > 2)
+					{
+						scheduler_depend(&frame.sim, &frames[(n - 2) % slots].log, &frame.sim_after_log);
+					}
+					scheduler_depend(&frame.render, &frame.sim, &frame.render_after_sim);
+					scheduler_depend(&frame.log, &frame.render, &frame.log_after_render);
+
+					frame.submitted = Clock::now();
+					scheduler_submit(&frame.sim, &sched);
+					scheduler_submit(&frame.render, &sched);
+					scheduler_submit(&frame.log, &sched);
+					spin_for(CallerWork);
+				}
+				for(unsigned i = 0; chained && i < slots; ++i)
+				{
+					scheduler_join(&sched, &frames[i].sim);
+					scheduler_join(&sched, &frames[i].render);
+					scheduler_join(&sched, &frames[i].log);
+				}
+				double elapsed = seconds_since(start);
+				checksums[mode] = pipeline.checksum;
+
+				std::vector<double>& latency = pipeline.latency;
+				double mean = 0.0;
+				for(double l : latency)
+				{
+					mean += l / latency.size();
+				}
+				std::sort(latency.begin(), latency.end());
+
+				printf("pipeline: %2u threads  %-12s %u in flight  %7.3f ms/frame  latency mean %7.3f ms  p99 %7.3f ms  caller blocked %5.1f%%\n",
+					threads, modes[mode], slots, elapsed / Frames * 1e3, mean * 1e3,
+					latency[latency.size() * 99 / 100] * 1e3, blocked / elapsed * 100.0);
+			}
+
+			// a long chain of tasks that run in full as they are started, all
+			// finished by the submit of the first, must not grow the stack
+			std::vector<struct sched_task> chain(ChainLength);
+			std::vector<struct sched_dependency> links(ChainLength);
+			for(unsigned i = 0; i < ChainLength; ++i)
+			{
+				scheduler_prepare(&chain[i], [](void*, struct scheduler*, sched_uint, sched_uint, sched_uint) {}, nullptr, 0);
+				if(i > 0)
+				{
+					scheduler_depend(&chain[i], &chain[i - 1], &links[i]);
+					scheduler_submit(&chain[i], &sched);
+				}
+			}
+			scheduler_submit(&chain[0], &sched);
+			scheduler_join(&sched, &chain[ChainLength - 1]);
+			const bool chain_done = sched_task_done(&chain[0]) && sched_task_done(&chain[ChainLength - 1]);
+
+			scheduler_stop(&sched);
+			free(memory);
+
+			const bool match = checksums[0] == checksums[1] && checksums[0] == checksums[2];
+			printf("pipeline: %2u threads  results %s  chain of %u empty tasks %s\n", threads,
+				match ? "match" : "DIFFER", ChainLength, chain_done ? "finished" : "NOT FINISHED");
+			ok = ok && match && chain_done;
+		}
+		return ok;
+	}
+
+	struct FanoutTask
+	{
+		struct sched_task task;
+		double result;
+	};
+
+	void fanout_work(void* pArg, struct scheduler*, sched_uint, sched_uint, sched_uint)
+	{
+		// a little arithmetic standing in for a small job
+		FanoutTask* task = (FanoutTask*)pArg;
+		double x = 1.0;
+		for(int i = 0; i < 400; ++i)
+		{
+			x = x * 1.0000001 + 1e-9;
+		}
+		task->result = x;
+	}
+
+	bool bench_fanout()
+	{
+		// bursts of small tasks added from one thread before any is joined;
+		// a queue that fills up makes the adding thread run the rest itself
+		const unsigned bursts[] = { 256, 4096, 65536 };
+
+		const unsigned hw_threads = std::thread::hardware_concurrency();
+		for(unsigned threads = 1; threads <= (hw_threads ? hw_threads : 1); threads *= 2)
+		{
+			sched_size needed_memory;
+			struct scheduler sched;
+			scheduler_init(&sched, &needed_memory, threads, 0);
+			void* memory = calloc(needed_memory, 1);
+			scheduler_start(&sched, memory);
+
+			for(unsigned burst : bursts)
+			{
+				std::vector<FanoutTask> tasks(burst);
+				double add_time = 0.0, total_time = 0.0;
+				unsigned long long done_while_adding = 0;
+				constexpr unsigned Rounds = 8;
+				for(unsigned r = 0; r < Rounds; ++r)
+				{
+					auto start = Clock::now();
+					for(FanoutTask& task : tasks)
+					{
+						scheduler_add(&task.task, &sched, fanout_work, &task, 1);
+					}
+					add_time += seconds_since(start);
+
+					for(FanoutTask& task : tasks)
+					{
+						done_while_adding += sched_task_done(&task.task) ? 1 : 0;
+					}
+					for(FanoutTask& task : tasks)
+					{
+						scheduler_join(&sched, &task.task);
+					}
+					total_time += seconds_since(start);
+				}
+
+				printf("fanout: %2u threads  %6u tasks  add %8.1f ns/task  total %8.1f ns/task  done while adding %5.1f%%\n",
+					threads, burst, add_time / Rounds / burst * 1e9, total_time / Rounds / burst * 1e9,
+					100.0 * done_while_adding / ((double)Rounds * burst));
+			}
+
+			scheduler_stop(&sched);
+			free(memory);
+		}
+		return true;
+	}
+
+	struct PartitionArgs
+	{
+		double* data;
+		unsigned cost;
+	};
+
+	void partition_work(void* pArg, struct scheduler*, sched_uint begin, sched_uint end, sched_uint)
+	{
+		// cost dependent multiply-adds per element
+		PartitionArgs* args = (PartitionArgs*)pArg;
+		for(sched_uint i = begin; i < end; ++i)
+		{
+			double x = args->data[i];
+			for(unsigned k = 0; k < args->cost; ++k)
+			{
+				x = x * 1.0000001 + 1e-9;
+			}
+			args->data[i] = x;
+		}
+	}
+
+	bool bench_partition()
+	{
+		// per element cost in multiply-adds, from a few ns to a few us
+		const unsigned costs[] = { 1, 32, 1024 };
+		const unsigned sizes[] = { 16, 1024, 65536, 1u << 20 };
+		// roughly how much work each case runs, in multiply-adds
+		constexpr double Work = 1 << 25;
+
+		bool all_ok = true;
+		const unsigned hw_threads = std::thread::hardware_concurrency();
+		for(unsigned threads = 1; threads <= (hw_threads ? hw_threads : 1); threads *= 2)
+		{
+			sched_size needed_memory;
+			struct scheduler sched;
+			scheduler_init(&sched, &needed_memory, threads, 0);
+			void* memory = calloc(needed_memory, 1);
+			scheduler_start(&sched, memory);
+
+			for(unsigned cost : costs)
+			{
+				// enough elements per call to hide its overhead for the cheap ones
+				const unsigned grain = std::max(1u, 4096u / cost);
+				for(unsigned size : sizes)
+				{
+					std::vector<double> data(size, 1.0);
+					PartitionArgs args = { data.data(), cost };
+					const unsigned rounds = std::max(1u, (unsigned)(Work / ((double)size * cost)));
+
+					auto start = Clock::now();
+					for(unsigned r = 0; r < rounds; ++r)
+					{
+						partition_work(&args, &sched, 0, size, 0);
+					}
+					double serial = seconds_since(start);
+
+					double times[2];
+					for(int g = 0; g < 2; ++g)
+					{
+						start = Clock::now();
+						for(unsigned r = 0; r < rounds; ++r)
+						{
+							struct sched_task task;
+							scheduler_add_range(&task, &sched, partition_work, &args, size, g ? grain : 1);
+							scheduler_join(&sched, &task);
+						}
+						times[g] = seconds_since(start);
+					}
+
+					// every element went through the same arithmetic, unless one
+					// was skipped or run twice
+					const bool ok = std::count(data.begin(), data.end(), data[0]) == (ptrdiff_t)size;
+
+					const double elements = (double)rounds * size;
+					printf("partition: %2u threads  cost %4u  %7u elements  serial %7.2f ns  grain 1 %7.2f ns (x%.2f)  grain %4u %7.2f ns (x%.2f)  %s\n",
+						threads, cost, size, serial / elements * 1e9,
+						times[0] / elements * 1e9, serial / times[0],
+						grain, times[1] / elements * 1e9, serial / times[1], ok ? "ok" : "MISMATCH");
+					all_ok = all_ok && ok;
+				}
+			}
+
+			scheduler_stop(&sched);
+			free(memory);
+		}
+		return all_ok;
+	}
+
+	struct Background
+	{
+		std::vector<struct sched_task> jobs;
+		std::atomic_bool stop;
+		std::atomic_uint done;
+	};
+
+	void background_job(void* pArg, struct scheduler*, sched_uint, sched_uint, sched_uint)
+	{
+		// a slice of a long job like an asset decode or an ensemble run
+		Background* background = (Background*)pArg;
+		if(!background->stop.load(std::memory_order_relaxed))
+		{
+			spin_for(200e-6);
+			background->done.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void frame_work(void* pArg, struct scheduler*, sched_uint begin, sched_uint end, sched_uint thread)
+	{
+		for(sched_uint i = begin; i < end; ++i)
+		{
+			spin_for(20e-6);
+		}
+
+		// items the joining thread had to run itself
+		if(thread == 0)
+		{
+			((std::atomic_uint*)pArg)->fetch_add(end - begin, std::memory_order_relaxed);
+		}
+	}
+
+	bool bench_priority()
+	{
+		// frames of short items joined by the caller, like game_frame, while
+		// the workers chew through background jobs queued ahead of them
+		constexpr unsigned Frames = 300;
+		constexpr unsigned FrameItems = 64;
+		const char* const modes[] = { "idle", "background", "background low" };
+
+		const unsigned hw_threads = std::thread::hardware_concurrency();
+		for(unsigned threads = 1; threads <= (hw_threads ? hw_threads : 1); threads *= 2)
+		{
+			sched_size needed_memory;
+			struct scheduler sched;
+			scheduler_init(&sched, &needed_memory, threads, 0);
+			void* memory = calloc(needed_memory, 1);
+			scheduler_start(&sched, memory);
+
+			for(int mode = 0; mode < 3; ++mode)
+			{
+				Background background;
+				background.jobs.resize(mode ? 1024 * threads : 0);
+				background.stop = false;
+				background.done = 0;
+				for(struct sched_task& job : background.jobs)
+				{
+					scheduler_prepare(&job, background_job, &background, 1);
+					job.priority = (mode == 2) ? SCHED_PRIORITY_LOW : SCHED_PRIORITY_HIGH;
+					scheduler_submit(&job, &sched);
+				}
+
+				std::atomic_uint caller_items(0);
+				std::vector<double> frame_times(Frames);
+				for(double& frame_time : frame_times)
+				{
+					auto start = Clock::now();
+					struct sched_task frame;
+					scheduler_add(&frame, &sched, frame_work, &caller_items, FrameItems);
+					scheduler_join(&sched, &frame);
+					frame_time = seconds_since(start);
+				}
+
+				background.stop = true;
+				const unsigned done = background.done;
+				for(struct sched_task& job : background.jobs)
+				{
+					scheduler_join(&sched, &job);
+				}
+
+				std::sort(frame_times.begin(), frame_times.end());
+				printf("priority: %2u threads  %-14s  frame p50 %6.3f ms  p99 %6.3f ms  max %6.3f ms  run by caller %5.1f%%  background jobs done %5u\n",
+					threads, modes[mode], frame_times[Frames / 2] * 1e3, frame_times[Frames * 99 / 100] * 1e3,
+					frame_times.back() * 1e3, 100.0 * caller_items / ((double)Frames * FrameItems), done);
+			}
+
+			scheduler_stop(&sched);
+			free(memory);
+		}
+		return true;
+	}
+
+	struct Asset
+	{
+		struct sched_task decode;
+		struct sched_task upload;
+		struct sched_dependency after_decode;
+		std::thread::id caller;
+		double decoded;
+		double uploaded;
+		bool on_caller;
+	};
+
+	void decode_asset(void* pArg, struct scheduler*, sched_uint, sched_uint, sched_uint)
+	{
+		// reading and decompressing a texture, say, on any worker
+		Asset* asset = (Asset*)pArg;
+		spin_for(100e-6);
+		asset->decoded = 1.0;
+	}
+
+	void upload_asset(void* pArg, struct scheduler*, sched_uint, sched_uint, sched_uint thread)
+	{
+		// stands in for the GL calls, which have to come from the caller
+		Asset* asset = (Asset*)pArg;
+		spin_for(10e-6);
+		asset->uploaded = asset->decoded;
+		asset->on_caller = thread == 0 && std::this_thread::get_id() == asset->caller;
+	}
+
+	bool bench_pinned()
+	{
+		// every frame the caller asks for a few assets to be decoded by the
+		// pool and then uploaded from its own thread, alongside its own work
+		constexpr unsigned Frames = 200;
+		constexpr double CallerWork = 500e-6;
+
+		bool ok = true;
+		const unsigned hw_threads = std::thread::hardware_concurrency();
+		for(unsigned threads = 1; threads <= (hw_threads ? hw_threads : 1); threads *= 2)
+		{
+			sched_size needed_memory;
+			struct scheduler sched;
+			scheduler_init(&sched, &needed_memory, threads, 0);
+			void* memory = calloc(needed_memory, 1);
+			scheduler_start(&sched, memory);
+
+			const unsigned per_frame = 2 * threads;
+			for(int pinned = 0; pinned < 2; ++pinned)
+			{
+				std::vector<Asset> assets(Frames * per_frame);
+				for(Asset& asset : assets)
+				{
+					asset.caller = std::this_thread::get_id();
+					asset.decoded = asset.uploaded = 0.0;
+					asset.on_caller = false;
+				}
+
+				std::vector<double> frame_times(Frames);
+				double blocked = 0.0;
+				auto start = Clock::now();
+				for(unsigned frame = 0; frame < Frames; ++frame)
+				{
+					auto frame_start = Clock::now();
+					Asset* requested = &assets[frame * per_frame];
+					for(unsigned i = 0; i < per_frame; ++i)
+					{
+						Asset& asset = requested[i];
+						scheduler_prepare(&asset.decode, decode_asset, &asset, 1);
+						if(pinned)
+						{
+							// the upload follows the decode on its own and
+							// waits for the caller to pick it up
+							scheduler_prepare(&asset.upload, upload_asset, &asset, 1);
+							asset.upload.thread = 0;
+							scheduler_depend(&asset.upload, &asset.decode, &asset.after_decode);
+							scheduler_submit(&asset.upload, &sched);
+						}
+						scheduler_submit(&asset.decode, &sched);
+					}
+
+					spin_for(CallerWork);
+
+					auto wait_start = Clock::now();
+					if(pinned)
+					{
+						scheduler_run_pinned(&sched);
+					}
+					else
+					{
+						for(unsigned i = 0; i < per_frame; ++i)
+						{
+							scheduler_join(&sched, &requested[i].decode);
+							upload_asset(&requested[i], &sched, 0, 1, 0);
+						}
+					}
+					blocked += seconds_since(wait_start);
+					frame_times[frame] = seconds_since(frame_start);
+				}
+				for(Asset& asset : assets)
+				{
+					if(pinned)
+					{
+						scheduler_join(&sched, &asset.upload);
+					}
+				}
+				const double total = seconds_since(start);
+
+				const size_t uploaded = std::count_if(assets.begin(), assets.end(),
+					[](const Asset& asset) { return asset.uploaded == 1.0 && asset.on_caller; });
+
+				std::sort(frame_times.begin(), frame_times.end());
+				printf("pinned: %2u threads  %-12s  total %7.1f ms  frame p50 %6.3f ms  p99 %6.3f ms  caller waiting %5.1f%%  uploaded on caller %5zu of %5zu\n",
+					threads, pinned ? "pinned tasks" : "join", total * 1e3, frame_times[Frames / 2] * 1e3,
+					frame_times[Frames * 99 / 100] * 1e3, 100.0 * blocked / total, uploaded, assets.size());
+				ok = ok && uploaded == assets.size();
+			}
+
+			scheduler_stop(&sched);
+			free(memory);
+		}
+		return ok;
+	}
+
+	bool bench_server()
+	{
+		constexpr unsigned Sessions = 256;
+		constexpr unsigned Rounds = 20;
+		constexpr uint32_t StepsPerRound = 60;
+		constexpr unsigned Pings = 2000;
+		const char* path = "/tmp/nuke-sim-bench.sock";
+
+		sched_size needed_memory;
+		struct scheduler sched;
+		scheduler_init(&sched, &needed_memory, SCHED_DEFAULT, 0);
+		void* memory = calloc(needed_memory, 1);
+		scheduler_start(&sched, memory);
+
+		SimServer server;
+		SimClient client;
+		if(!server.open(path))
+		{
+			printf("server: unable to listen on %s\n", path);
+			scheduler_stop(&sched);
+			free(memory);
+			return false;
+		}
+		std::thread serving([&]() { server.run(&sched); });
+
+		std::vector<uint32_t> sessions(Sessions);
+		bool ok = client.connect(path);
+		for(unsigned i = 0; i < Sessions; ++i)
+		{
+			client.create();
+		}
+		ok = ok && client.execute();
+		for(unsigned i = 0; ok && i < Sessions; ++i)
+		{
+			sessions[i] = client.get_session(i);
+		}
+
+		// every session gets its own rod position, steps a second and reports
+		// back, one batch per round; the same cores run locally to check
+		std::vector<Core> local(Sessions);
+		double batched = 0.0;
+		unsigned mismatched = 0;
+		for(unsigned r = 0; ok && r < Rounds; ++r)
+		{
+			std::vector<unsigned> reads(Sessions);
+			for(unsigned i = 0; i < Sessions; ++i)
+			{
+				Core::Inputs inputs = local[i].get_inputs();
+				inputs.RodPosition = 2.0 * (i + 1) / Sessions * (r + 1) / Rounds;
+				local[i].set_inputs(inputs);
+				for(uint32_t s = 0; s < StepsPerRound; ++s)
+				{
+					local[i].step();
+				}
+
+				client.set_inputs(sessions[i], inputs);
+				client.step(sessions[i], StepsPerRound);
+				reads[i] = client.get_outputs(sessions[i]);
+			}
+
+			auto start = Clock::now();
+			ok = client.execute();
+			batched += seconds_since(start);
+
+			for(unsigned i = 0; ok && i < Sessions; ++i)
+			{
+				Core::Outputs outputs = client.get_outputs_result(reads[i]);
+				Core::Outputs expected = local[i].get_outputs();
+				if(client.get_status(reads[i]) != SimProtocol::Status_Ok || memcmp(&outputs, &expected, sizeof(outputs)) != 0)
+				{
+					++mismatched;
+				}
+			}
+		}
+
+		// one small request per round trip, the worst case for batching
+		auto start = Clock::now();
+		for(unsigned p = 0; ok && p < Pings; ++p)
+		{
+			client.get_outputs(sessions[p % Sessions]);
+			ok = client.execute();
+		}
+		double ping = seconds_since(start) / Pings;
+
+		// a snapshot taken from one session and restored into another
+		unsigned taken = client.get_snapshot(sessions[0]);
+		ok = ok && client.execute();
+		Core::Snapshot snapshot = client.get_snapshot_result(taken);
+		client.restore(sessions[1], snapshot);
+		unsigned read = client.get_outputs(sessions[1]);
+		ok = ok && client.execute();
+		Core::Outputs outputs = client.get_outputs_result(read);
+		Core::Outputs expected = local[0].get_outputs();
+		bool restored = ok && memcmp(&outputs, &expected, sizeof(outputs)) == 0;
+
+		// requests run in order, so nothing after a destroy finds the session
+		unsigned created = client.create();
+		ok = ok && client.execute();
+		const uint32_t doomed = client.get_session(created);
+		const unsigned ordered[] =
+		{
+			client.step(doomed, 1), client.destroy(doomed), client.step(doomed, 1),
+			client.get_outputs(doomed), client.destroy(doomed),
+		};
+		ok = ok && client.execute();
+		const SimProtocol::Status expected_status[] =
+		{
+			SimProtocol::Status_Ok, SimProtocol::Status_Ok, SimProtocol::Status_NoSession,
+			SimProtocol::Status_NoSession, SimProtocol::Status_NoSession,
+		};
+		bool in_order = ok;
+		for(unsigned i = 0; ok && i < 5; ++i)
+		{
+			in_order = in_order && client.get_status(ordered[i]) == expected_status[i];
+		}
+
+		// steps past the round's cap are refused, not run, and the ones
+		// before them still count towards it
+		Core capped_local = local[2];
+		for(uint32_t s = 0; s < SimProtocol::MaxStepsPerRound - 1; ++s)
+		{
+			capped_local.step();
+		}
+		const unsigned capped[] =
+		{
+			client.step(sessions[2], (uint32_t)-1), client.step(sessions[2], SimProtocol::MaxStepsPerRound - 1),
+			client.step(sessions[2], 2), client.get_outputs(sessions[2]),
+		};
+		ok = ok && client.execute();
+		outputs = ok ? client.get_outputs_result(capped[3]) : Core::Outputs{};
+		expected = capped_local.get_outputs();
+		bool steps_capped = ok && client.get_status(capped[0]) == SimProtocol::Status_TooManySteps &&
+			client.get_status(capped[1]) == SimProtocol::Status_Ok &&
+			client.get_status(capped[2]) == SimProtocol::Status_TooManySteps &&
+			memcmp(&outputs, &expected, sizeof(outputs)) == 0;
+
+		// a small batch asking for more response than a batch may hold is
+		// refused without disturbing anyone else
+		SimClient greedy;
+		bool greedy_refused = greedy.connect(path);
+		const size_t greedy_requests = SimProtocol::MaxBatchBytes / SimProtocol::response_size(SimProtocol::Op_GetSnapshot) + 1;
+		for(size_t i = 0; i < greedy_requests; ++i)
+		{
+			greedy.get_snapshot(sessions[0]);
+		}
+		greedy_refused = greedy_refused && !greedy.execute();
+		greedy.close();
+
+		// a client that sends a large batch and never reads the responses
+		// must not hold up the others
+		SimClient stalled;
+		bool others_served = stalled.connect(path);
+		for(unsigned i = 0; i < 100000; ++i)
+		{
+			stalled.get_snapshot(sessions[0]);
+		}
+		others_served = others_served && stalled.send();
+		for(unsigned p = 0; ok && p < 100; ++p)
+		{
+			client.get_outputs(sessions[p % Sessions]);
+			ok = client.execute();
+		}
+		others_served = others_served && ok;
+		stalled.close();
+
+		for(unsigned i = 0; i < Sessions; ++i)
+		{
+			client.destroy(sessions[i]);
+		}
+		ok = ok && client.execute();
+
+		client.close();
+		server.stop();
+		serving.join();
+		server.close();
+		scheduler_stop(&sched);
+		free(memory);
+
+		if(!ok)
+		{
+			printf("server: connection failed\n");
+			return false;
+		}
+
+		const double session_steps = (double)Sessions * StepsPerRound * Rounds;
+		printf("server: %u sessions, %u steps per round, %.2f ms per round  %.0f session-steps/s  %u mismatched\n",
+			Sessions, StepsPerRound, batched / Rounds * 1e3, session_steps / batched, mismatched);
+		printf("server: %.1f us per single request round trip, snapshot restore %s, %zu sessions left\n",
+			ping * 1e6, restored ? "exact" : "differs", server.get_session_count());
+		printf("server: requests after a destroy %s, a client not reading %s\n",
+			in_order ? "find no session" : "still RUN", others_served ? "holds up no one" : "BLOCKS the others");
+		printf("server: steps past %u per round %s, a batch with a %.0f MB response %s\n",
+			SimProtocol::MaxStepsPerRound, steps_capped ? "refused" : "RUN",
+			greedy_requests * SimProtocol::response_size(SimProtocol::Op_GetSnapshot) / 1048576.0,
+			greedy_refused ? "refused" : "ACCEPTED");
+		return mismatched == 0 && restored && server.get_session_count() == 0 && in_order && others_served &&
+			steps_capped && greedy_refused;
+	}
+
+	struct Benchmark
+	{
+		const char* name;
+		// false if any of its checks failed
+		bool (*run)();
+	};
+
+	const Benchmark benchmarks[] =
+	{
+		{ "corebatch", bench_corebatch },
+		{ "parallel",  bench_parallel },
+		{ "integrators", bench_integrators },
+		{ "substeps",  bench_substeps },
+		{ "recorder",  bench_recorder },
+		{ "replay",    bench_replay },
+		{ "snapshot",  bench_snapshot },
+		{ "plants",    bench_plants },
+		{ "properties", bench_properties },
+		{ "ensemble",  bench_ensemble },
+		{ "steady",    bench_steady },
+		{ "adaptive",  bench_adaptive },
+		{ "events",    bench_events },
+		{ "graph",     bench_graph },
+		{ "jacobian",  bench_jacobian },
+		{ "publish",   bench_publish },
+		{ "server",    bench_server },
+		{ "outputs",   bench_outputs },
+		{ "pipeline",  bench_pipeline },
+		{ "fanout",    bench_fanout },
+		{ "partition", bench_partition },
+		{ "priority",  bench_priority },
+		{ "pinned",    bench_pinned },
+	};
+}
+
+int main(int argc, char** argv)
+{
+	int failed = 0;
+	for(const Benchmark& benchmark : benchmarks)
+	{
+		bool selected = (argc < 2);
+		for(int i = 1; i < argc; ++i)
+		{
+			selected = selected || (strcmp(argv[i], benchmark.name) == 0);
+		}
+
+		if(selected && !benchmark.run())
+		{
+			printf("%s: FAILED\n", benchmark.name);
+			++failed;
+		}
+	}
+
+	return failed ? 1 : 0;
+}
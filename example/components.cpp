@@ -0,0 +1,208 @@
+#include "components.h"
+
+#include "plant.h"
+#include "properties.h"
+
+using Properties::my_pow;
+using Properties::saturated_vapor_pressure;
+
+namespace
+{
+	// Not in the reference plant; chosen for a four loop plant of its size
+	constexpr double LoopFlow       = 4700.0;	// kg/s
+	constexpr double PumpSpinTime   = 20.0;		// s
+	constexpr double HotLegTransit  = 2.0;		// s
+	constexpr double ColdLegTransit = 4.0;		// s
+	constexpr double Mpr            = 30000.0;	// kg, pressurizer water
+	constexpr double KsurgePR       = 2.0e5;	// W/K, surge line
+
+	constexpr double Mpc0 = 200000.0;
+	constexpr double Tpc0 = 290.0;
+	constexpr double Tpr0 = 326.57;
+}
+
+HeatSource::HeatSource(double power)
+	: Component("heat", 0, 0, 1)
+	, power_(power)
+{
+}
+
+void HeatSource::initial_state(double*) const
+{
+}
+
+void HeatSource::outputs(const double*, double* outputs) const
+{
+	outputs[Output_Power] = power_;
+}
+
+void HeatSource::derivatives(const double*, const double*, double*) const
+{
+}
+
+ReactorVessel::ReactorVessel(unsigned loops)
+	: Component("vessel", 2, 1 + 2 * loops, 2)
+	, loops_(loops)
+{
+}
+
+void ReactorVessel::initial_state(double* state) const
+{
+	state[State_Mpc] = Mpc0;
+	state[State_Tpc] = Tpc0;
+}
+
+void ReactorVessel::outputs(const double* state, double* outputs) const
+{
+	outputs[Output_Tpc] = state[State_Tpc];
+	outputs[Output_Mpc] = state[State_Mpc];
+}
+
+void ReactorVessel::derivatives(const double* state, const double* inputs, double* rate) const
+{
+	const double Tpc = state[State_Tpc];
+
+	double loops_heat = 0.0;
+	for(unsigned loop = 0; loop < loops_; ++loop)
+	{
+		loops_heat += inputs[input_flow(loop)] * PlantParams::CpPC * (inputs[input_cold_leg(loop)] - Tpc);
+	}
+
+	rate[State_Mpc] = PlantParams::min - PlantParams::mout;
+	rate[State_Tpc] = 1.0 / (PlantParams::CpPC * state[State_Mpc]) * (PlantParams::CpPC * PlantParams::min * (-PlantParams::TpcLoss)
+				+ inputs[Input_Power]
+				+ PlantParams::CpPC * PlantParams::mout * 15.0
+				+ loops_heat
+				- PlantParams::KlossPC * (Tpc - PlantParams::ToutPC));
+}
+
+Pipe::Pipe(const char* name, double transit_time, double initial)
+	: Component(name, 1, 1, 1)
+	, transit_time_(transit_time)
+	, initial_(initial)
+{
+}
+
+void Pipe::initial_state(double* state) const
+{
+	state[State_T] = initial_;
+}
+
+void Pipe::outputs(const double* state, double* outputs) const
+{
+	outputs[Output_T] = state[State_T];
+}
+
+void Pipe::derivatives(const double* state, const double* inputs, double* rate) const
+{
+	rate[State_T] = (inputs[Input_T] - state[State_T]) / transit_time_;
+}
+
+Pump::Pump(double rated_flow, double spin_time)
+	: Component("pump", 1, 0, 1)
+	, rated_flow_(rated_flow)
+	, spin_time_(spin_time)
+	, speed_(1.0)
+{
+}
+
+void Pump::initial_state(double* state) const
+{
+	state[State_Speed] = speed_;
+}
+
+void Pump::outputs(const double* state, double* outputs) const
+{
+	outputs[Output_Flow] = rated_flow_ * state[State_Speed];
+}
+
+void Pump::derivatives(const double* state, const double*, double* rate) const
+{
+	rate[State_Speed] = (speed_ - state[State_Speed]) / spin_time_;
+}
+
+SteamGenerator::SteamGenerator()
+	: Component("steam generator", 2, 2, 3)
+{
+}
+
+void SteamGenerator::initial_state(double* state) const
+{
+	state[State_Tp] = Tpc0;
+	state[State_Ts] = PlantParams::Tw0;
+}
+
+void SteamGenerator::outputs(const double* state, double* outputs) const
+{
+	outputs[Output_Heat] = PlantParams::KtSG1 * my_pow(state[State_Tp] - state[State_Ts], PlantParams::alpha);
+	outputs[Output_Tp] = state[State_Tp];
+	outputs[Output_Ts] = state[State_Ts];
+}
+
+void SteamGenerator::derivatives(const double* state, const double* inputs, double* rate) const
+{
+	const double heat = PlantParams::KtSG1 * my_pow(state[State_Tp] - state[State_Ts], PlantParams::alpha);
+	const double steam = PlantParams::Ktsg2 * (state[State_Ts] - PlantParams::Tw0);
+
+	rate[State_Tp] = (inputs[Input_Flow] * PlantParams::CpPC * (inputs[Input_T] - state[State_Tp]) - heat)
+				/ (PlantParams::CpPC * PlantParams::Msg0);
+	rate[State_Ts] = (heat - steam) / PlantParams::CpWMw;
+}
+
+Pressurizer::Pressurizer()
+	: Component("pressurizer", 1, 1, 1)
+	, heater_power_(PlantParams::WlossPR)
+{
+}
+
+void Pressurizer::initial_state(double* state) const
+{
+	state[State_Tpr] = Tpr0;
+}
+
+void Pressurizer::outputs(const double* state, double* outputs) const
+{
+	outputs[Output_Ppr] = saturated_vapor_pressure(state[State_Tpr]);
+}
+
+void Pressurizer::derivatives(const double* state, const double* inputs, double* rate) const
+{
+	rate[State_Tpr] = (KsurgePR * (inputs[Input_Tpc] - state[State_Tpr]) + heater_power_ - PlantParams::WlossPR)
+				/ (PlantParams::CpPR * Mpr);
+}
+
+MultiLoopPlant build_multiloop_plant(PlantGraph& graph, unsigned loops, double power, bool loose_loops)
+{
+	MultiLoopPlant plant;
+	plant.heat = graph.add_component(std::unique_ptr<Component>(new HeatSource(power)));
+	plant.vessel = graph.add_component(std::unique_ptr<Component>(new ReactorVessel(loops)));
+	plant.pressurizer = graph.add_component(std::unique_ptr<Component>(new Pressurizer()));
+
+	graph.link(plant.heat, HeatSource::Output_Power, plant.vessel, ReactorVessel::Input_Power, true);
+	graph.link(plant.vessel, ReactorVessel::Output_Tpc, plant.pressurizer, Pressurizer::Input_Tpc, true);
+
+	const ReactorVessel& vessel = (const ReactorVessel&)graph.get_component(plant.vessel);
+	const bool tight = !loose_loops;
+	for(unsigned loop = 0; loop < loops; ++loop)
+	{
+		const unsigned hot = graph.add_component(std::unique_ptr<Component>(new Pipe("hot leg", HotLegTransit, Tpc0)));
+		const unsigned generator = graph.add_component(std::unique_ptr<Component>(new SteamGenerator()));
+		const unsigned cold = graph.add_component(std::unique_ptr<Component>(new Pipe("cold leg", ColdLegTransit, Tpc0)));
+		const unsigned pump = graph.add_component(std::unique_ptr<Component>(new Pump(LoopFlow, PumpSpinTime)));
+
+		graph.link(plant.vessel, ReactorVessel::Output_Tpc, hot, Pipe::Input_T, tight);
+		graph.link(hot, Pipe::Output_T, generator, SteamGenerator::Input_T, true);
+		graph.link(pump, Pump::Output_Flow, generator, SteamGenerator::Input_Flow, true);
+		graph.link(generator, SteamGenerator::Output_Tp, cold, Pipe::Input_T, true);
+		graph.link(cold, Pipe::Output_T, plant.vessel, vessel.input_cold_leg(loop), tight);
+		graph.link(pump, Pump::Output_Flow, plant.vessel, vessel.input_flow(loop), tight);
+
+		plant.hot_legs.push_back(hot);
+		plant.generators.push_back(generator);
+		plant.cold_legs.push_back(cold);
+		plant.pumps.push_back(pump);
+	}
+
+	graph.build();
+	return plant;
+}
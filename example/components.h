@@ -0,0 +1,159 @@
+#pragma once
+
+#include <vector>
+
+#include "plantgraph.h"
+
+// Thermal-hydraulic components of the primary circuit for PlantGraph,
+// worked up from the reference plant's thermal model in core.cpp.
+// Temperatures are in deg C, masses in kg, flows in kg/s and heat in W.
+
+// Reactor heat into the coolant. Stateless; the power is set from outside,
+// e.g. from a core's outputs.
+class HeatSource : public Component
+{
+	double power_;
+
+public:
+	enum { Output_Power };
+
+	explicit HeatSource(double power);
+
+	inline void set_power(double power)
+	{
+		power_ = power;
+	}
+
+	void initial_state(double*) const override;
+	void outputs(const double* state, double* outputs) const override;
+	void derivatives(const double* state, const double* inputs, double* rate) const override;
+};
+
+// Coolant in the reactor vessel, mixing the reactor's heat with the cold
+// leg return of every loop, plus charging, letdown and losses
+class ReactorVessel : public Component
+{
+	unsigned loops_;
+
+public:
+	enum { State_Mpc, State_Tpc };
+	enum { Input_Power };
+	enum { Output_Tpc, Output_Mpc };
+
+	explicit ReactorVessel(unsigned loops);
+
+	// each loop has a cold leg temperature and flow input
+	inline unsigned input_cold_leg(unsigned loop) const
+	{
+		return 1 + 2 * loop;
+	}
+
+	inline unsigned input_flow(unsigned loop) const
+	{
+		return 2 + 2 * loop;
+	}
+
+	void initial_state(double* state) const override;
+	void outputs(const double* state, double* outputs) const override;
+	void derivatives(const double* state, const double* inputs, double* rate) const override;
+};
+
+// Transport lag: the outlet follows the inlet temperature with the pipe's
+// transit time
+class Pipe : public Component
+{
+	double transit_time_;
+	double initial_;
+
+public:
+	enum { State_T };
+	enum { Input_T };
+	enum { Output_T };
+
+	Pipe(const char* name, double transit_time, double initial);
+
+	void initial_state(double* state) const override;
+	void outputs(const double* state, double* outputs) const override;
+	void derivatives(const double* state, const double* inputs, double* rate) const override;
+};
+
+// Reactor coolant pump, spinning up or down towards its set speed
+class Pump : public Component
+{
+	double rated_flow_;
+	double spin_time_;
+	double speed_;
+
+public:
+	enum { State_Speed };
+	enum { Output_Flow };
+
+	Pump(double rated_flow, double spin_time);
+
+	// Fraction of rated speed
+	inline void set_speed(double speed)
+	{
+		speed_ = speed;
+	}
+
+	void initial_state(double* state) const override;
+	void outputs(const double* state, double* outputs) const override;
+	void derivatives(const double* state, const double* inputs, double* rate) const override;
+};
+
+// Primary water in the tubes passing heat to the secondary water, which
+// loses it to steam
+class SteamGenerator : public Component
+{
+public:
+	enum { State_Tp, State_Ts };
+	enum { Input_T, Input_Flow };
+	enum { Output_Heat, Output_Tp, Output_Ts };
+
+	SteamGenerator();
+
+	void initial_state(double* state) const override;
+	void outputs(const double* state, double* outputs) const override;
+	void derivatives(const double* state, const double* inputs, double* rate) const override;
+};
+
+// Pressurizer water, following the coolant temperature through the surge
+// line and kept hot by its heaters
+class Pressurizer : public Component
+{
+	double heater_power_;
+
+public:
+	enum { State_Tpr };
+	enum { Input_Tpc };
+	enum { Output_Ppr };
+
+	Pressurizer();
+
+	inline void set_heater_power(double power)
+	{
+		heater_power_ = power;
+	}
+
+	void initial_state(double* state) const override;
+	void outputs(const double* state, double* outputs) const override;
+	void derivatives(const double* state, const double* inputs, double* rate) const override;
+};
+
+// Indices of a plant built by build_multiloop_plant
+struct MultiLoopPlant
+{
+	unsigned heat;
+	unsigned vessel;
+	unsigned pressurizer;
+	std::vector<unsigned> hot_legs;
+	std::vector<unsigned> generators;
+	std::vector<unsigned> cold_legs;
+	std::vector<unsigned> pumps;
+};
+
+// Adds a reactor vessel with loops of hot leg, steam generator, cold leg
+// and pump to graph, and builds it. Each loop is tightly linked inside and,
+// when loose_loops is set, loosely linked to the vessel so that the loops
+// are separate subsystems; otherwise the whole plant is one subsystem.
+MultiLoopPlant build_multiloop_plant(PlantGraph& graph, unsigned loops, double power, bool loose_loops);
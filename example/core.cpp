@@ -2,68 +2,278 @@
 
 #include <cmath>
 #include <cstring>
+#include <utility>
+#include <fstream>
 
-namespace Constants
-{
-	double RodParams [3] = { -1.36e-4, -6.05e-5, -2.88e-4 };
-	double Lambda  = 1.0e-5;	// 
-	double S       = 2859.0;	// %/s
-	double CpPC    = 5281.0;	// J/kg/K
-	double KtSG1   = 9.19e6;	// W/K
-	double KlossPC = 3.0e6;		// W/K
-	double alpha   = 1.097;		// --
-	double Msg0    = 31810.0;	// kg
-	double CpSG    = 4651.1;	// J/kg/K
-	double KlossSG = 1.52e8;	// W
-	double Ktsg2   = 3.30e6;	// W/K
-	double beta    = 2.004;		// --
-	double CpWMw   = 2.031e7;	// J/K
-	double Tw0     = 267.9;		// deg C
-	double CpPR    = 5895.4;  	// J/kg/K
-	double WlossPR = 1.48e5;   	// W
-	double Cpsi    = 13.75e6;   // W / %
-	double Apr     = 4.52;		// m^2
-	double V0pc    = 242.0;     // m^3
-	double mout    = 2.9722;    // kg/s
-	double min     = 1.4222;    // kg/s
-	double TpcLoss = 10.0;		// temperature loss between Tpc,CL and Tpci
-	double ToutPC  = 293.0;
-	double Msg     = 120.56;	// mass of steam / water through steam-generator
-}
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "scheduler.h"
+
+#include "dual.h"
+#include "properties.h"
+
+static_assert(sizeof(CoreBase::Snapshot) == 224, "CoreBase::Snapshot layout changed, bump Snapshot::Version");
+static_assert(offsetof(CoreBase::Snapshot, step_count) == 32, "CoreBase::Snapshot must not contain padding");
+static_assert(offsetof(CoreBase::Snapshot, inputs) == 56, "CoreBase::Snapshot must not contain padding");
+static_assert(sizeof(CoreBase::State) == 7 * sizeof(double), "CoreBase::State must only hold doubles");
+
+double TunablePlant::RodParams [3] = { PlantParams::RodParams[0], PlantParams::RodParams[1], PlantParams::RodParams[2] };
+double TunablePlant::Lambda  = PlantParams::Lambda;
+double TunablePlant::S       = PlantParams::S;
+double TunablePlant::CpPC    = PlantParams::CpPC;
+double TunablePlant::KtSG1   = PlantParams::KtSG1;
+double TunablePlant::KlossPC = PlantParams::KlossPC;
+double TunablePlant::alpha   = PlantParams::alpha;
+double TunablePlant::Msg0    = PlantParams::Msg0;
+double TunablePlant::CpSG    = PlantParams::CpSG;
+double TunablePlant::KlossSG = PlantParams::KlossSG;
+double TunablePlant::Ktsg2   = PlantParams::Ktsg2;
+double TunablePlant::beta    = PlantParams::beta;
+double TunablePlant::CpWMw   = PlantParams::CpWMw;
+double TunablePlant::Tw0     = PlantParams::Tw0;
+double TunablePlant::CpPR    = PlantParams::CpPR;
+double TunablePlant::WlossPR = PlantParams::WlossPR;
+double TunablePlant::Cpsi    = PlantParams::Cpsi;
+double TunablePlant::Apr     = PlantParams::Apr;
+double TunablePlant::V0pc    = PlantParams::V0pc;
+double TunablePlant::mout    = PlantParams::mout;
+double TunablePlant::min     = PlantParams::min;
+double TunablePlant::TpcLoss = PlantParams::TpcLoss;
+double TunablePlant::ToutPC  = PlantParams::ToutPC;
+double TunablePlant::Msg     = PlantParams::Msg;
 
 namespace
 {
-	// Estimates the water density at a given temperature kelvin
-	inline double water_density(double temperature)
+	using Properties::water_density;
+	using Properties::saturated_vapor_pressure;
+	using Properties::my_pow;
+
+	// The model's arithmetic is written for any number type T, double for
+	// stepping and Dual for its derivatives (see get_step_jacobian)
+
+	// Reactivity of the rods at a given position
+	template<typename Plant, typename T>
+	inline T rod_reactivity(const Plant& plant, const T& rod_position)
 	{
-		constexpr double C0 = 581.2;
-		constexpr double C1 = 2.98;
-		constexpr double C2 = -0.00848;
+		return plant.RodParams[0] * my_pow(rod_position, 2.0) + plant.RodParams[1] * rod_position + plant.RodParams[2];
+	}
+
+	// Reactivity of the rods divided by the neutron generation time
+	template<typename Plant, typename T>
+	inline T flux_kinetics(const Plant& plant, const T& rod_position)
+	{
+		return (1.0 / plant.Lambda) * rod_reactivity(plant, rod_position);
+	}
 
-		return C0 + C1 * temperature + C2 * temperature * temperature;
+	// dN/dt = kinetics * N + S
+	template<typename Plant, typename T>
+	inline T flux_rate(const Plant& plant, const T& flux, const T& rod_position)
+	{
+		return flux_kinetics(plant, rod_position) * flux + plant.S;
 	}
 
-	// Estimates the saturated vapor pressure using centigrade
-	// returns in units of kPa
-	inline double saturated_vapor_pressure(double temperature)
+	// The rods are withdrawn at a fixed rate until fully out
+	template<typename T>
+	inline T rod_position_after(T rod_position, double dt)
 	{
-		return 28884.78 - 258.01*temperature + 0.63*temperature*temperature;
+		rod_position += 1e-2 * dt;
+		if(rod_position > CoreBase::RodEndStop) rod_position = CoreBase::RodEndStop;
+		return rod_position;
 	}
 
-	inline double my_pow(double x, double y)
+	constexpr int StateSize = CoreBase::StateCount;
+	constexpr int InputSize = CoreBase::InputCount;
+	constexpr int OutputSize = CoreBase::OutputCount;
+
+	// Field numbers, counting doubles from the start of each struct
+	constexpr int StateN = offsetof(CoreBase::State, N) / sizeof(double);
+	constexpr int InputRodPosition = offsetof(CoreBase::Inputs, RodPosition) / sizeof(double);
+	constexpr int OutputWr = offsetof(CoreBase::Outputs, Wr) / sizeof(double);
+
+	// The columns of CoreBase::StepJacobian a step depends on, the input and
+	// state fields it reads; it carries every other field through unchanged.
+	// Extend this as the thermal model is brought in.
+	constexpr int StepReads[] = { InputRodPosition, InputSize + StateN };
+	constexpr int StepReadCount = sizeof(StepReads) / sizeof(StepReads[0]);
+
+	// Rate of change of every state field; only the flux is evolved for
+	// now, see step_thermal
+	template<typename Plant, typename T>
+	inline void derivatives(const Plant& plant, const T* state, const T* inputs, T* rate)
 	{
-		if(x < 0.0f)
+		for(int i = 0; i < StateSize; ++i)
 		{
-			return -1.0 * pow(-x, y);
+			rate[i] = T(0.0);
 		}
-		else
+		rate[StateN] = flux_rate(plant, state[StateN], inputs[InputRodPosition]);
+	}
+
+	inline double* fields(CoreBase::State& state)
+	{
+		return (double*)&state;
+	}
+
+	inline const double* fields(const CoreBase::State& state)
+	{
+		return (const double*)&state;
+	}
+
+	inline const double* fields(const CoreBase::Inputs& inputs)
+	{
+		return (const double*)&inputs;
+	}
+
+	// Solves a x = b in place by Gaussian elimination with partial pivoting,
+	// leaving x in b. a is n by n, row major.
+	bool solve_dense(double* a, double* b, int n)
+	{
+		for(int col = 0; col < n; ++col)
+		{
+			int pivot = col;
+			for(int row = col + 1; row < n; ++row)
+			{
+				if(std::fabs(a[row * n + col]) > std::fabs(a[pivot * n + col]))
+				{
+					pivot = row;
+				}
+			}
+			if(a[pivot * n + col] == 0.0)
+			{
+				return false;
+			}
+			if(pivot != col)
+			{
+				for(int k = 0; k < n; ++k)
+				{
+					std::swap(a[pivot * n + k], a[col * n + k]);
+				}
+				std::swap(b[pivot], b[col]);
+			}
+
+			for(int row = col + 1; row < n; ++row)
+			{
+				const double factor = a[row * n + col] / a[col * n + col];
+				for(int k = col; k < n; ++k)
+				{
+					a[row * n + k] -= factor * a[col * n + k];
+				}
+				b[row] -= factor * b[col];
+			}
+		}
+
+		for(int row = n - 1; row >= 0; --row)
+		{
+			double sum = b[row];
+			for(int k = row + 1; k < n; ++k)
+			{
+				sum -= a[row * n + k] * b[k];
+			}
+			b[row] = sum / a[row * n + row];
+		}
+		return true;
+	}
+
+	// (exp(a * h) - 1) / a, the exponential Euler step weight for dx/dt = a x + b
+	template<typename T>
+	inline T phi1(const T& a, double h)
+	{
+		const T ah = a * h;
+		if(ah == 0.0)
+		{
+			return h;
+		}
+		return h * (expm1(ah) / ah);
+	}
+
+	// Integrate flux, dN/dt = kinetics * N + S. Euler looks at the rods at
+	// the start of the step, the other schemes at its middle.
+	template<typename Plant, typename T>
+	inline void step_neutronics(const Plant& plant, CoreBase::Integrator integrator, double h, const T& rod_begin, const T& rod_mid, T& flux)
+	{
+		switch(integrator)
 		{
-			return pow(x,y);
+			case CoreBase::Integrator_ExponentialEuler:
+			{
+				const T kinetics = flux_kinetics(plant, rod_mid);
+				flux = flux + phi1(kinetics, h) * (kinetics * flux + plant.S);
+				break;
+			}
+
+			case CoreBase::Integrator_Rosenbrock:
+			{
+				const T kinetics = flux_kinetics(plant, rod_mid);
+				flux = flux + h * (kinetics * flux + plant.S) / (1.0 - h * kinetics);
+				break;
+			}
+
+			default:
+			{
+				const T dN = flux_rate(plant, flux, rod_begin);
+				flux = flux + dN * h;
+				break;
+			}
 		}
 	}
+
+	// The flux evolves orders of magnitude faster than the thermal state,
+	// so it is subcycled within each thermal step of h. Returns the flux
+	// the thermal step sees.
+	template<typename Plant, typename T>
+	T step_flux(const Plant& plant, CoreBase::Integrator integrator, CoreBase::Coupling coupling, bool rod_drive, unsigned substeps, double h, const T& rod, T& flux)
+	{
+		const double h_fast = h / substeps;
+		T flux_sum = 0.0;
+		for(unsigned i = 0; i < substeps; ++i)
+		{
+			if(coupling == CoreBase::Coupling_Interpolated && rod_drive)
+			{
+				const double t = i * h_fast;
+				step_neutronics(plant, integrator, h_fast, (i == 0) ? rod : rod_position_after(rod, t), rod_position_after(rod, t + 0.5 * h_fast), flux);
+			}
+			else
+			{
+				step_neutronics(plant, integrator, h_fast, rod, rod, flux);
+			}
+			flux_sum += flux;
+		}
+
+		return (coupling == CoreBase::Coupling_Interpolated) ? flux_sum / (double)substeps : flux;
+	}
+
+	// What step_thermal does to the rods
+	template<typename T>
+	inline void step_rods(bool rod_drive, double h, T& rod)
+	{
+		if(rod_drive)
+		{
+			rod = rod_position_after(rod, h);
+		}
+	}
+
+	// The outputs derived from the state, see update_outputs
+	template<typename Plant, typename T>
+	inline T reactor_power(const Plant& plant, const T& flux)
+	{
+		return plant.Cpsi * flux;
+	}
 }
 
-Core::Core()
+template<typename Plant>
+BasicCore<Plant>::BasicCore(const Plant& plant)
+	: plant_(plant)
+	, outputs_valid_(false)
+	, timebank_(0.0)
+	, integrator_(Integrator_Euler)
+	, timestep_(FixedTimestep)
+	, neutronics_substeps_(1)
+	, coupling_(Coupling_Interpolated)
+	, step_count_(0)
+	, rod_drive_(true)
+	, adaptive_(false)
+	, adaptive_tolerance_(1e-6)
+	, max_timestep_(60.0)
+	, adaptive_step_(FixedTimestep)
+	, rejected_steps_(0)
 {
 	memset(&inputs_, 0, sizeof(inputs_));
 	memset(&state_, 0, sizeof(state_));
@@ -73,7 +283,7 @@ Core::Core()
 	outputs_.Tout = 200.0;
 
 	state_.Tpc = 200.0;
-	state_.Tw = Constants::Tw0;
+	state_.Tw = plant_.Tw0;
 	state_.Mpc = 200000.0;
 	state_.Tpr = 326.57;
 	state_.N   = 10.0;
@@ -81,52 +291,452 @@ Core::Core()
 	outputs_.Mpr = 19400;
 	outputs_.Lpr = 4.80;
 
+	last_inputs_ = inputs_;
+
+}
+
+template<typename Plant>
+void BasicCore<Plant>::update_outputs() const
+{
+	outputs_.Wr = reactor_power(plant_, state_.N);
+	outputs_valid_ = true;
+}
+
+template<typename Plant>
+double BasicCore<Plant>::get_reactivity() const
+{
+	return rod_reactivity(plant_, inputs_.RodPosition);
 }
 
-void Core::simulate(double dt)
+template<typename Plant>
+CoreBase::State BasicCore<Plant>::get_derivatives(const State& state, const Inputs& inputs) const
 {
-	static double timebank = 0.0;
-	timebank += dt;
+	State rate;
+	derivatives(plant_, fields(state), fields(inputs), fields(rate));
+	return rate;
+}
 
-	constexpr double FixedTimestep = 1.0 / 60.0;
+template<typename Plant>
+void BasicCore<Plant>::get_step_jacobian(StepJacobian& jacobian) const
+{
+	// Forward mode costs one derivative per direction carried, so only the
+	// fields the step reads are differentiated and every other column is
+	// that of a field passed through
+	typedef Dual<StepReadCount> D;
 
-	while(timebank > FixedTimestep)
+	D inputs[InputSize], state[StateSize], outputs[OutputSize];
+	for(int i = 0; i < InputSize; ++i)
+	{
+		inputs[i] = fields(inputs_)[i];
+	}
+	for(int i = 0; i < StateSize; ++i)
 	{
-		timebank -= FixedTimestep;
+		state[i] = fields(state_)[i];
+	}
+	const Outputs current = get_outputs();
+	for(int i = 0; i < OutputSize; ++i)
+	{
+		outputs[i] = ((const double*)&current)[i];
+	}
+	for(int k = 0; k < StepReadCount; ++k)
+	{
+		D& field = (StepReads[k] < InputSize) ? inputs[StepReads[k]] : state[StepReads[k] - InputSize];
+		field = D::variable(field.value, k);
+	}
 
-		// Integrate flux
-		double dN = (1.0 / Constants::Lambda) * (Constants::RodParams[0] * my_pow(inputs_.RodPosition, 2.0) + Constants::RodParams[1] * inputs_.RodPosition + Constants::RodParams[2]) * state_.N + Constants::S;
-		state_.N = state_.N + dN * FixedTimestep;
+	step_flux(plant_, integrator_, coupling_, rod_drive_, neutronics_substeps_, timestep_, inputs[InputRodPosition], state[StateN]);
+	step_rods(rod_drive_, timestep_, inputs[InputRodPosition]);
+	outputs[OutputWr] = reactor_power(plant_, state[StateN]);
 
-		double reactor_thermal_output = Constants::Cpsi * state_.N;
+	memset(&jacobian, 0, sizeof(jacobian));
+	for(int i = 0; i < InputSize; ++i)
+	{
+		jacobian.inputs[i][i] = 1.0;
+	}
+	for(int i = 0; i < StateSize; ++i)
+	{
+		jacobian.state[i][InputSize + i] = 1.0;
+	}
+	for(int k = 0; k < StepReadCount; ++k)
+	{
+		const int col = StepReads[k];
+		for(int row = 0; row < InputSize; ++row)
+		{
+			jacobian.inputs[row][col] = inputs[row].d[k];
+		}
+		for(int row = 0; row < StateSize; ++row)
+		{
+			jacobian.state[row][col] = state[row].d[k];
+		}
+		for(int row = 0; row < OutputSize; ++row)
+		{
+			jacobian.outputs[row][col] = outputs[row].d[k];
+		}
+	}
+}
 
-		// Integrate Mpc
-		//double dMpc = Constants::min - Constants::mout;
-		//state_.Mpc = state_.Mpc + dMpc * FixedTimestep;
+template<typename Plant>
+bool BasicCore<Plant>::solve_steady_state(const Inputs& inputs, State& steady) const
+{
+	constexpr int MaxIterations = 100;
+	constexpr double Tolerance = 1e-12;
 
-		// Integrate Tpc
-		//double dTpc = 1.0 / (Constants::CpPC * state_.Mpc) * (Constants::CpPC * Constants::min * (-Constants::TpcLoss) 
-		//			+ outputs_.Wr 
-		//			+ Constants::CpPC * Constants::mout * 15.0
-		//			- 6.0 * Constants::KtSG1*my_pow(state_.Tpc - state_.Tw, Constants::alpha)
-		//			- Constants::KlossPC * (state_.Tpc - Constants::ToutPC));
-		//state_.Tpc += state_.Tpc * FixedTimestep * dTpc;
+	// Pseudo-transient continuation: each iteration is an implicit Euler
+	// step of size dtau, solving (I / dtau - J) dx = f, with dtau growing
+	// as the residual falls until the steps are plain Newton steps. Early
+	// on this damps Newton the way the dynamics would, and fields with no
+	// dynamics (zero rows of J) are simply held.
+	State x = state_;
+	State f = get_derivatives(x, inputs);
+	double dtau = timestep_;
 
-		// Integrate Tsg
-		//const double Msgin = Msg - 100;
-		//double dTsg = 1.0 / (Constants::CpSG * state_.Msg) * (Constants::CpSG * Msg)
+	auto norm = [](State& v)
+	{
+		double largest = 0.0;
+		for(int i = 0; i < StateSize; ++i)
+		{
+			largest = std::fmax(largest, std::fabs(fields(v)[i]));
+		}
+		return largest;
+	};
 
-		// Integrate Mpr
-		//outputs_.Mpr = (Constants::min - Constants::mout) - Constants::V0pc * water_density(dTpc);
+	for(int iteration = 0; iteration < MaxIterations; ++iteration)
+	{
+		// Jacobian of the derivatives, by forward mode differentiation
+		double jacobian[StateSize * StateSize];
+		{
+			typedef Dual<StateSize> D;
+			D xd[StateSize], inputs_d[InputSize], rate[StateSize];
+			for(int i = 0; i < StateSize; ++i)
+			{
+				xd[i] = D::variable(fields(x)[i], i);
+			}
+			for(int i = 0; i < InputSize; ++i)
+			{
+				inputs_d[i] = fields(inputs)[i];
+			}
+			derivatives(plant_, xd, inputs_d, rate);
+			for(int row = 0; row < StateSize; ++row)
+			{
+				for(int col = 0; col < StateSize; ++col)
+				{
+					jacobian[row * StateSize + col] = rate[row].d[col];
+				}
+			}
+		}
+
+		double a[StateSize * StateSize];
+		double dx[StateSize];
+		for(int row = 0; row < StateSize; ++row)
+		{
+			for(int col = 0; col < StateSize; ++col)
+			{
+				a[row * StateSize + col] = ((row == col) ? 1.0 / dtau : 0.0) - jacobian[row * StateSize + col];
+			}
+			dx[row] = fields(f)[row];
+		}
+		if(!solve_dense(a, dx, StateSize))
+		{
+			return false;
+		}
 
-		inputs_.RodPosition += 1e-2 * FixedTimestep;
-		if(inputs_.RodPosition > 2.25) inputs_.RodPosition = 2.25f;
+		bool converged = true;
+		for(int i = 0; i < StateSize; ++i)
+		{
+			fields(x)[i] += dx[i];
+			converged = converged && std::fabs(dx[i]) <= Tolerance * std::fmax(std::fabs(fields(x)[i]), 1.0);
+		}
 
-		// update outputs
-		outputs_.Wr  = Constants::Cpsi * state_.N;
-		//outputs_.Psg = saturated_vapor_pressure(state_.Tpr);
-		//outputs_.Lpr = (1.0 / Constants::Apr) * ((state_.Mpc / water_density(state_.Tpc)) - Constants::V0pc);
-		//outputs_.Ppr = saturated_vapor_pressure(state_.Tpr);
+		const double residual = norm(f);
+		f = get_derivatives(x, inputs);
+		const double next_residual = norm(f);
+		if(!std::isfinite(next_residual))
+		{
+			return false;
+		}
+
+		// a tiny step only means convergence once the steps are Newton steps
+		if((converged && dtau >= 1e6) || next_residual == 0.0)
+		{
+			if(x.N < 0.0)
+			{
+				return false;
+			}
+			steady = x;
+			return true;
+		}
+
+		// switched evolution relaxation
+		dtau = std::fmin(dtau * residual / next_residual, 1e12);
+	}
+
+	return false;
+}
+
+template<typename Plant>
+CoreBase::Snapshot BasicCore<Plant>::get_snapshot() const
+{
+	Snapshot snapshot;
+	memset(&snapshot, 0, sizeof(snapshot));
+
+	snapshot.magic               = Snapshot::Magic;
+	snapshot.version             = Snapshot::Version;
+	snapshot.size                = sizeof(Snapshot);
+	snapshot.integrator          = integrator_;
+	snapshot.coupling            = coupling_;
+	snapshot.neutronics_substeps = neutronics_substeps_;
+	snapshot.rod_drive           = rod_drive_ ? 1 : 0;
+	snapshot.adaptive            = adaptive_ ? 1 : 0;
+	snapshot.step_count          = step_count_;
+	snapshot.timestep            = timestep_;
+	snapshot.timebank            = timebank_;
+	snapshot.inputs              = inputs_;
+	snapshot.state               = state_;
+	snapshot.outputs             = get_outputs();
+	snapshot.adaptive_tolerance  = adaptive_tolerance_;
+	snapshot.max_timestep        = max_timestep_;
+	snapshot.adaptive_step       = adaptive_step_;
+	return snapshot;
+}
+
+template<typename Plant>
+bool BasicCore<Plant>::restore_snapshot(const Snapshot& snapshot)
+{
+	if(snapshot.magic != Snapshot::Magic || snapshot.version != Snapshot::Version || snapshot.size != sizeof(Snapshot))
+	{
+		return false;
+	}
+
+	if(snapshot.integrator > Integrator_Rosenbrock || snapshot.coupling > Coupling_Frozen
+		|| snapshot.neutronics_substeps > MaxNeutronicsSubsteps)
+	{
+		return false;
+	}
+
+	// simulate() would never drain the timebank with a step like these
+	if(!(std::isfinite(snapshot.timestep) && snapshot.timestep > 0.0)
+		|| !(std::isfinite(snapshot.timebank) && snapshot.timebank >= 0.0))
+	{
+		return false;
+	}
+	if(!(std::isfinite(snapshot.adaptive_tolerance) && snapshot.adaptive_tolerance > 0.0)
+		|| !(std::isfinite(snapshot.max_timestep) && snapshot.max_timestep > 0.0)
+		|| !(std::isfinite(snapshot.adaptive_step) && snapshot.adaptive_step > 0.0))
+	{
+		return false;
+	}
+
+	integrator_ = (Integrator)snapshot.integrator;
+	coupling_   = (Coupling)snapshot.coupling;
+	set_neutronics_substeps(snapshot.neutronics_substeps);
+	rod_drive_  = snapshot.rod_drive != 0;
+	step_count_ = snapshot.step_count;
+	timestep_   = snapshot.timestep;
+	timebank_   = snapshot.timebank;
+	inputs_     = snapshot.inputs;
+	state_      = snapshot.state;
+	outputs_    = snapshot.outputs;
+	outputs_valid_ = false;
+
+	adaptive_           = snapshot.adaptive != 0;
+	adaptive_tolerance_ = snapshot.adaptive_tolerance;
+	max_timestep_       = snapshot.max_timestep;
+	adaptive_step_      = snapshot.adaptive_step;
+	last_inputs_        = inputs_;
+	return true;
+}
+
+template<typename Plant>
+bool BasicCore<Plant>::save_snapshot(const std::string& filename) const
+{
+	const Snapshot snapshot = get_snapshot();
+
+	std::ofstream out(filename.c_str(), std::ios_base::binary | std::ios_base::trunc);
+	out.write((const char*)&snapshot, sizeof(snapshot));
+	return out.good();
+}
+
+template<typename Plant>
+bool BasicCore<Plant>::load_snapshot(const std::string& filename)
+{
+	try
+	{
+		boost::iostreams::mapped_file_source file(filename);
+		if(!file.is_open() || file.size() < sizeof(Snapshot))
+		{
+			return false;
+		}
+
+		// the file is the struct, so it is used straight from the mapping
+		return restore_snapshot(*(const Snapshot*)file.data());
+	}
+	catch(const std::exception&)
+	{
+		return false;
+	}
+}
+
+template<typename Plant>
+void BasicCore<Plant>::simulate(double dt)
+{
+	timebank_ += dt;
+
+	if(adaptive_)
+	{
+		simulate_adaptive();
+		return;
+	}
+
+	while(timebank_ > timestep_)
+	{
+		timebank_ -= timestep_;
+		step();
+	}
+}
+
+template<typename Plant>
+void BasicCore<Plant>::simulate_adaptive()
+{
+	// a derivative this small relative to its field, per second, counts as
+	// settled
+	constexpr double QuiescentRate = 1e-4;
+
+	if(memcmp(&inputs_, &last_inputs_, sizeof(Inputs)) != 0)
+	{
+		adaptive_step_ = timestep_;
+	}
+
+	while(timebank_ > timestep_)
+	{
+		State rate = get_derivatives(state_, inputs_);
+		bool quiescent = true;
+		for(int i = 0; i < StateSize; ++i)
+		{
+			quiescent = quiescent && std::fabs(fields(rate)[i]) <= QuiescentRate * std::fmax(std::fabs(fields(state_)[i]), 1.0);
+		}
+
+		if(!quiescent || adaptive_step_ <= timestep_)
+		{
+			timebank_ -= timestep_;
+			advance(timestep_);
+			adaptive_step_ = quiescent ? 2.0 * timestep_ : timestep_;
+			continue;
+		}
+
+		// one step of h against two of h / 2, keeping the more accurate pair
+		const double h = std::fmin(std::fmin(adaptive_step_, max_timestep_), timebank_);
+		BasicCore full(*this);
+		full.advance(h);
+		BasicCore half(*this);
+		half.advance(0.5 * h);
+		half.advance(0.5 * h);
+
+		double error = 0.0;
+		for(int i = 0; i < StateSize; ++i)
+		{
+			const double scale = adaptive_tolerance_ * std::fmax(std::fabs(fields(half.state_)[i]), 1.0);
+			error = std::fmax(error, std::fabs(fields(full.state_)[i] - fields(half.state_)[i]) / scale);
+		}
+
+		// first order schemes, so the error goes as h^2
+		const double factor = (error > 0.0) ? 0.9 / std::sqrt(error) : 2.0;
+		if(error <= 1.0 && std::isfinite(error))
+		{
+			timebank_ -= h;
+			inputs_  = half.inputs_;
+			state_   = half.state_;
+			outputs_valid_ = false;
+			++step_count_;
+			adaptive_step_ = h * std::fmin(factor, 2.0);
+		}
+		else
+		{
+			++rejected_steps_;
+			adaptive_step_ = std::isfinite(error) ? h * std::fmax(factor, 0.2) : timestep_;
+		}
+		adaptive_step_ = std::fmin(std::fmax(adaptive_step_, timestep_), max_timestep_);
 	}
 
-}
\ No newline at end of file
+	last_inputs_ = inputs_;
+}
+
+template<typename Plant>
+void BasicCore<Plant>::step()
+{
+	advance(timestep_);
+}
+
+template<typename Plant>
+void BasicCore<Plant>::advance(double h)
+{
+	const double flux = step_flux(plant_, integrator_, coupling_, rod_drive_, neutronics_substeps_, h, inputs_.RodPosition, state_.N);
+	step_thermal(h, flux);
+
+	++step_count_;
+}
+
+template<typename Plant>
+void BasicCore<Plant>::step_thermal(double h, double flux)
+{
+	double reactor_thermal_output = plant_.Cpsi * flux;
+
+	// Integrate Mpc
+	//double dMpc = plant_.min - plant_.mout;
+	//state_.Mpc = state_.Mpc + dMpc * h;
+
+	// Integrate Tpc
+	//double dTpc = 1.0 / (plant_.CpPC * state_.Mpc) * (plant_.CpPC * plant_.min * (-plant_.TpcLoss) 
+	//			+ reactor_thermal_output
+	//			+ plant_.CpPC * plant_.mout * 15.0
+	//			- 6.0 * plant_.KtSG1*my_pow(state_.Tpc - state_.Tw, plant_.alpha)
+	//			- plant_.KlossPC * (state_.Tpc - plant_.ToutPC));
+	//state_.Tpc += state_.Tpc * h * dTpc;
+
+	// Integrate Tsg
+	//const double Msgin = Msg - 100;
+	//double dTsg = 1.0 / (plant_.CpSG * state_.Msg) * (plant_.CpSG * Msg)
+
+	// Integrate Mpr
+	//outputs_.Mpr = (plant_.min - plant_.mout) - plant_.V0pc * water_density(dTpc);
+
+	// move the rods; the outputs follow the new state when next read
+	step_rods(rod_drive_, h, inputs_.RodPosition);
+	outputs_valid_ = false;
+	//outputs_.Psg = saturated_vapor_pressure(state_.Tpr);
+	//outputs_.Lpr = (1.0 / plant_.Apr) * ((state_.Mpc / water_density(state_.Tpc)) - plant_.V0pc);
+	//outputs_.Ppr = saturated_vapor_pressure(state_.Tpr);
+}
+
+namespace
+{
+	template<typename CoreType>
+	struct ParallelArgs
+	{
+		CoreType* cores;
+		double dt;
+	};
+
+	template<typename CoreType>
+	void simulate_range(void* pArg, struct scheduler*, sched_uint begin, sched_uint end, sched_uint)
+	{
+		ParallelArgs<CoreType>* args = (ParallelArgs<CoreType>*)pArg;
+		for(sched_uint i = begin; i < end; ++i)
+		{
+			args->cores[i].simulate(args->dt);
+		}
+	}
+}
+
+template<typename Plant>
+void BasicCore<Plant>::simulate_parallel(BasicCore* cores, size_t count, double dt, struct scheduler* sched)
+{
+	ParallelArgs<BasicCore> args = { cores, dt };
+
+	struct sched_task task;
+	scheduler_add(&task, sched, simulate_range<BasicCore>, &args, (sched_uint)count);
+	scheduler_join(sched, &task);
+}
+
+template class BasicCore<PlantParams>;
+template class BasicCore<TunablePlant>;
+template class BasicCore<RuntimePlant>;
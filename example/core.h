@@ -1,7 +1,15 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
 
-class Core
+#include "plant.h"
+
+struct scheduler;
+
+// Types shared by every plant configuration
+class CoreBase
 {
 public:
 	struct Inputs
@@ -34,13 +42,139 @@ public:
 		double Tw;
 	};
 
+	// Number of fields in each, all doubles
+	static constexpr int InputCount = sizeof(Inputs) / sizeof(double);
+	static constexpr int OutputCount = sizeof(Outputs) / sizeof(double);
+	static constexpr int StateCount = sizeof(State) / sizeof(double);
+
+	// Derivatives of the inputs, state and outputs after one step by the
+	// inputs and state before it. Column c is by input field c for
+	// c < InputCount, then by state field c - InputCount, with fields
+	// numbered in declaration order. Fields the step leaves alone have unit
+	// rows; outputs it does not compute have zero rows.
+	struct StepJacobian
+	{
+		static constexpr int Columns = InputCount + StateCount;
+
+		double inputs[InputCount][Columns];
+		double state[StateCount][Columns];
+		double outputs[OutputCount][Columns];
+	};
+
+	// Scheme used to advance the state over one step
+	enum Integrator
+	{
+		// forward Euler, only stable for steps well below Lambda / |rho|
+		Integrator_Euler,
+		// exact for the flux equation while the rod position is held over
+		// the step, so the step size is limited only by the rod motion
+		Integrator_ExponentialEuler,
+		// linearly implicit (Rosenbrock) Euler, L-stable for any step size
+		Integrator_Rosenbrock,
+	};
+
+	// How the subcycled flux and the thermal step exchange state
+	enum Coupling
+	{
+		// the flux substeps see the rods move across the thermal step, and
+		// the thermal step sees the mean flux over the substeps
+		Coupling_Interpolated,
+		// the flux substeps see the rods as they were at the start of the
+		// thermal step, and the thermal step sees the final flux
+		Coupling_Frozen,
+	};
+
+	// Everything needed to resume a core exactly where it left off. The
+	// layout is fixed (little endian, no padding) so a snapshot file can be
+	// memory mapped and used in place without parsing. Bump Version whenever
+	// the layout changes.
+	struct Snapshot
+	{
+		static constexpr uint32_t Magic = 0x45524f43; // "CORE"
+		static constexpr uint32_t Version = 3;
+
+		uint32_t magic;
+		uint32_t version;
+		uint32_t size;
+		uint32_t integrator;
+		uint32_t coupling;
+		uint32_t neutronics_substeps;
+		uint32_t rod_drive;
+		uint32_t adaptive;
+		uint64_t step_count;
+		double timestep;
+		double timebank;
+		Inputs inputs;
+		State state;
+		Outputs outputs;
+		double adaptive_tolerance;
+		double max_timestep;
+		double adaptive_step;
+	};
+
+	static constexpr double FixedTimestep = 1.0 / 60.0;
+
+	// Most flux substeps a step may be split into, so that one step stays
+	// bounded in time whatever a snapshot asks for
+	static constexpr unsigned MaxNeutronicsSubsteps = 1024;
+
+	// The rod drive stops once the rods are this far out
+	static constexpr double RodEndStop = 2.25;
+};
+
+// The reactor model, specialized on a plant parameter set (see plant.h)
+template<typename Plant>
+class BasicCore : public CoreBase
+{
+public:
+	typedef Plant PlantType;
+
 private:
+	// empty for the constexpr plants, the parameters themselves for RuntimePlant
+	Plant plant_;
+
 	Inputs inputs_;
-	Outputs outputs_;
 	State state_;
 
+	// Wr and the rest of the outputs derived from the state are only worked
+	// out when read, once per change of state; the other fields are stored
+	mutable Outputs outputs_;
+	mutable bool outputs_valid_;
+
+	// simulation time not yet consumed by a fixed step
+	double timebank_;
+
+	Integrator integrator_;
+	double timestep_;
+
+	unsigned neutronics_substeps_;
+	Coupling coupling_;
+
+	// steps taken since construction, the clock input scripts are keyed on
+	uint64_t step_count_;
+
+	bool rod_drive_;
+
+	// adaptive stepping, see set_adaptive
+	bool adaptive_;
+	double adaptive_tolerance_;
+	double max_timestep_;
+	double adaptive_step_;
+	uint64_t rejected_steps_;
+	Inputs last_inputs_;
+
+	void advance(double h);
+	void simulate_adaptive();
+	void step_thermal(double h, double flux);
+	void update_outputs() const;
+
 public:
-	Core();
+	explicit BasicCore(const Plant& plant = Plant());
+
+	inline const Plant& get_plant() const
+	{
+		return plant_;
+	}
 
 	inline Inputs get_inputs() const
 	{
@@ -52,14 +186,21 @@ public:
 		inputs_ = inputs;
 	}
 
+	// Not safe to call for the same core from two threads at once, as the
+	// first read after a step fills in the derived outputs
 	inline Outputs get_outputs() const
 	{
+		if(!outputs_valid_)
+		{
+			update_outputs();
+		}
 		return outputs_;
 	}
 
 	inline void set_state(const State& state)
 	{
 		state_ = state;
+		outputs_valid_ = false;
 	}
 
 	inline State get_state() const
@@ -72,5 +213,175 @@ public:
 		return state_.N;
 	}
 
+	// Reactivity of the rods at their current position, zero at criticality
+	double get_reactivity() const;
+
+	// Rate of change of the state with the inputs held, the right hand side
+	// the integrators advance. Fields the model does not evolve are zero.
+	State get_derivatives(const State& state, const Inputs& inputs) const;
+
+	// The Jacobian of step(), from the current inputs and state, computed
+	// with dual numbers in one evaluation of the step rather than one
+	// finite difference step per column. Exact to rounding, including for
+	// substeps and the rod drive.
+	void get_step_jacobian(StepJacobian& jacobian) const;
+
+	// Finds the state at which nothing changes with the inputs held and the
+	// rod drive stopped, starting from the current state, so a scenario can
+	// start settled instead of integrating a long warm-up. Returns false,
+	// leaving steady untouched, if the solve does not converge or the core
+	// is supercritical and has no steady state with a positive flux.
+	bool solve_steady_state(const Inputs& inputs, State& steady) const;
+
+	inline void set_integrator(Integrator integrator)
+	{
+		integrator_ = integrator;
+	}
+
+	inline Integrator get_integrator() const
+	{
+		return integrator_;
+	}
+
+	// Sets the step simulate() advances by, FixedTimestep by default.
+	// Only the implicit and exponential integrators stay accurate at steps
+	// much larger than that.
+	inline void set_timestep(double timestep)
+	{
+		timestep_ = timestep;
+	}
+
+	inline double get_timestep() const
+	{
+		return timestep_;
+	}
+
+	// Splits each step into this many flux substeps while the thermal
+	// state advances once, at the full step. Clamped to
+	// 1..MaxNeutronicsSubsteps.
+	inline void set_neutronics_substeps(unsigned substeps)
+	{
+		neutronics_substeps_ = substeps > 0 ? (substeps < MaxNeutronicsSubsteps ? substeps : MaxNeutronicsSubsteps) : 1;
+	}
+
+	inline unsigned get_neutronics_substeps() const
+	{
+		return neutronics_substeps_;
+	}
+
+	inline void set_coupling(Coupling coupling)
+	{
+		coupling_ = coupling;
+	}
+
+	inline Coupling get_coupling() const
+	{
+		return coupling_;
+	}
+
+	inline uint64_t get_step_count() const
+	{
+		return step_count_;
+	}
+
+	// For callers that cut steps short, e.g. EventMonitor, to keep the
+	// count on whole steps of plant time, which InputTimeline replays by
+	inline void set_step_count(uint64_t count)
+	{
+		step_count_ = count;
+	}
+
+	// When enabled (the default) the core withdraws the rods at a fixed
+	// rate every step. Disable it to leave RodPosition entirely to
+	// set_inputs, e.g. when replaying a recorded session.
+	inline void set_rod_drive(bool enabled)
+	{
+		rod_drive_ = enabled;
+	}
+
+	inline bool get_rod_drive() const
+	{
+		return rod_drive_;
+	}
+
+	// When enabled, simulate() takes the fixed step only while the plant is
+	// changing. Once every derivative is small the step is allowed to grow
+	// towards get_max_timestep(), as long as a step doubling error estimate
+	// stays within the tolerance (relative, per state field). Changing the
+	// inputs, or the derivatives picking up again, drops back to the fixed
+	// step. Off by default; step() is unaffected. Pair it with the
+	// exponential or Rosenbrock integrator, forward Euler goes unstable
+	// long before the error estimate lets the step grow far.
+	inline void set_adaptive(bool enabled)
+	{
+		adaptive_ = enabled;
+		adaptive_step_ = timestep_;
+	}
+
+	inline bool get_adaptive() const
+	{
+		return adaptive_;
+	}
+
+	inline void set_adaptive_tolerance(double tolerance)
+	{
+		adaptive_tolerance_ = tolerance;
+	}
+
+	inline double get_adaptive_tolerance() const
+	{
+		return adaptive_tolerance_;
+	}
+
+	inline void set_max_timestep(double timestep)
+	{
+		max_timestep_ = timestep;
+	}
+
+	inline double get_max_timestep() const
+	{
+		return max_timestep_;
+	}
+
+	// The step the adaptive mode will try next
+	inline double get_adaptive_step() const
+	{
+		return adaptive_step_;
+	}
+
+	// Adaptive steps thrown away because their error was too large
+	inline uint64_t get_rejected_steps() const
+	{
+		return rejected_steps_;
+	}
+
+	Snapshot get_snapshot() const;
+
+	// Returns false, leaving the core untouched, if the snapshot has the
+	// wrong magic, version or size, or settings the core cannot run: an
+	// unknown integrator or coupling, more than MaxNeutronicsSubsteps, a
+	// timestep that is not finite and positive or a timebank that is not
+	// finite and non-negative, or adaptive settings that are not finite and
+	// positive
+	bool restore_snapshot(const Snapshot& snapshot);
+
+	bool save_snapshot(const std::string& filename) const;
+	bool load_snapshot(const std::string& filename);
+
 	void simulate(double dt);
-};
\ No newline at end of file
+
+	// Advances the core by exactly one step of get_timestep(), bypassing the
+	// accumulator used by simulate()
+	void step();
+
+	// Advances count independent cores by dt, splitting them across the
+	// scheduler's worker threads. Returns once every core has been stepped.
+	static void simulate_parallel(BasicCore* cores, size_t count, double dt, struct scheduler* sched);
+};
+
+// Instantiated in core.cpp
+extern template class BasicCore<PlantParams>;
+extern template class BasicCore<TunablePlant>;
+extern template class BasicCore<RuntimePlant>;
+
+typedef BasicCore<PlantParams> Core;
@@ -0,0 +1,463 @@
+#include "corebatch.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COREBATCH_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// Per step coefficients shared by every lane, read once from PlantParams
+	// and rounded to the batch's precision so they can stay in registers for
+	// the whole batch.
+	template<typename Real>
+	struct StepParams
+	{
+		Real inv_lambda;
+		Real rod0;
+		Real rod1;
+		Real rod2;
+		Real S;
+		Real Cpsi;
+		Real rod_speed;
+		Real rod_max;
+		Real dt;
+	};
+
+	template<typename Real>
+	StepParams<Real> make_step_params()
+	{
+		StepParams<Real> p;
+		p.inv_lambda = (Real)(1.0 / PlantParams::Lambda);
+		p.rod0       = (Real)PlantParams::RodParams[0];
+		p.rod1       = (Real)PlantParams::RodParams[1];
+		p.rod2       = (Real)PlantParams::RodParams[2];
+		p.S          = (Real)PlantParams::S;
+		p.Cpsi       = (Real)PlantParams::Cpsi;
+		p.rod_speed  = (Real)(1e-2 * Core::FixedTimestep);
+		p.rod_max    = (Real)Core::RodEndStop;
+		p.dt         = (Real)Core::FixedTimestep;
+		return p;
+	}
+
+	template<typename Real>
+	void step_scalar(const StepParams<Real>& p, Real* N, Real* rod, Real* Wr, size_t begin, size_t end, unsigned steps)
+	{
+		for(size_t i = begin; i < end; ++i)
+		{
+			Real n = N[i];
+			Real r = rod[i];
+			for(unsigned s = 0; s < steps; ++s)
+			{
+				// matches my_pow(r, 2.0) in core.cpp
+				Real r2 = r * r;
+				if(r < 0.0f)
+				{
+					r2 = -r2;
+				}
+
+				Real dN = p.inv_lambda * (p.rod0 * r2 + p.rod1 * r + p.rod2) * n + p.S;
+				n = n + dN * p.dt;
+
+				r += p.rod_speed;
+				if(r > p.rod_max) r = p.rod_max;
+			}
+			N[i] = n;
+			rod[i] = r;
+			if(steps > 0)
+			{
+				Wr[i] = p.Cpsi * n;
+			}
+		}
+	}
+
+#ifdef COREBATCH_X86
+	// The kernels must not contract multiplies and adds into FMA (which
+	// AVX-512 enables), it would round differently from Core::simulate
+	__attribute__((target("avx2"), optimize("fp-contract=off")))
+	size_t step_avx2(const StepParams<double>& p, double* N, double* rod, double* Wr, size_t count, unsigned steps)
+	{
+		const __m256d inv_lambda = _mm256_set1_pd(p.inv_lambda);
+		const __m256d rod0       = _mm256_set1_pd(p.rod0);
+		const __m256d rod1       = _mm256_set1_pd(p.rod1);
+		const __m256d rod2       = _mm256_set1_pd(p.rod2);
+		const __m256d S          = _mm256_set1_pd(p.S);
+		const __m256d Cpsi       = _mm256_set1_pd(p.Cpsi);
+		const __m256d rod_speed  = _mm256_set1_pd(p.rod_speed);
+		const __m256d rod_max    = _mm256_set1_pd(p.rod_max);
+		const __m256d dt         = _mm256_set1_pd(p.dt);
+		const __m256d zero       = _mm256_setzero_pd();
+
+		size_t i = 0;
+		for(; i + 4 <= count; i += 4)
+		{
+			__m256d n = _mm256_loadu_pd(N + i);
+			__m256d r = _mm256_loadu_pd(rod + i);
+			for(unsigned s = 0; s < steps; ++s)
+			{
+				__m256d r2 = _mm256_mul_pd(r, r);
+				__m256d negative = _mm256_cmp_pd(r, zero, _CMP_LT_OQ);
+				r2 = _mm256_blendv_pd(r2, _mm256_sub_pd(zero, r2), negative);
+
+				__m256d poly = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(rod0, r2), _mm256_mul_pd(rod1, r)), rod2);
+				__m256d dN = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(inv_lambda, poly), n), S);
+				n = _mm256_add_pd(n, _mm256_mul_pd(dN, dt));
+
+				// min(rod_max, r) keeps r when it is NaN, like the scalar clamp
+				r = _mm256_add_pd(r, rod_speed);
+				r = _mm256_min_pd(rod_max, r);
+			}
+			_mm256_storeu_pd(N + i, n);
+			_mm256_storeu_pd(rod + i, r);
+			if(steps > 0)
+			{
+				_mm256_storeu_pd(Wr + i, _mm256_mul_pd(Cpsi, n));
+			}
+		}
+
+		// the compiler only inserts this itself when optimizing, and dirty
+		// upper lanes slow down all the SSE code that runs afterwards
+		_mm256_zeroupper();
+		return i;
+	}
+
+	__attribute__((target("avx512f"), optimize("fp-contract=off")))
+	size_t step_avx512(const StepParams<double>& p, double* N, double* rod, double* Wr, size_t count, unsigned steps)
+	{
+		const __m512d inv_lambda = _mm512_set1_pd(p.inv_lambda);
+		const __m512d rod0       = _mm512_set1_pd(p.rod0);
+		const __m512d rod1       = _mm512_set1_pd(p.rod1);
+		const __m512d rod2       = _mm512_set1_pd(p.rod2);
+		const __m512d S          = _mm512_set1_pd(p.S);
+		const __m512d Cpsi       = _mm512_set1_pd(p.Cpsi);
+		const __m512d rod_speed  = _mm512_set1_pd(p.rod_speed);
+		const __m512d rod_max    = _mm512_set1_pd(p.rod_max);
+		const __m512d dt         = _mm512_set1_pd(p.dt);
+		const __m512d zero       = _mm512_setzero_pd();
+
+		size_t i = 0;
+		for(; i + 8 <= count; i += 8)
+		{
+			__m512d n = _mm512_loadu_pd(N + i);
+			__m512d r = _mm512_loadu_pd(rod + i);
+			for(unsigned s = 0; s < steps; ++s)
+			{
+				__m512d r2 = _mm512_mul_pd(r, r);
+				__mmask8 negative = _mm512_cmp_pd_mask(r, zero, _CMP_LT_OQ);
+				r2 = _mm512_mask_sub_pd(r2, negative, zero, r2);
+
+				__m512d poly = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(rod0, r2), _mm512_mul_pd(rod1, r)), rod2);
+				__m512d dN = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(inv_lambda, poly), n), S);
+				n = _mm512_add_pd(n, _mm512_mul_pd(dN, dt));
+
+				r = _mm512_add_pd(r, rod_speed);
+				r = _mm512_min_pd(rod_max, r);
+			}
+			_mm512_storeu_pd(N + i, n);
+			_mm512_storeu_pd(rod + i, r);
+			if(steps > 0)
+			{
+				_mm512_storeu_pd(Wr + i, _mm512_mul_pd(Cpsi, n));
+			}
+		}
+
+		_mm256_zeroupper();
+		return i;
+	}
+
+	// The same kernels on floats, twice as many lanes per vector
+	__attribute__((target("avx2"), optimize("fp-contract=off")))
+	size_t step_avx2(const StepParams<float>& p, float* N, float* rod, float* Wr, size_t count, unsigned steps)
+	{
+		const __m256 inv_lambda = _mm256_set1_ps(p.inv_lambda);
+		const __m256 rod0       = _mm256_set1_ps(p.rod0);
+		const __m256 rod1       = _mm256_set1_ps(p.rod1);
+		const __m256 rod2       = _mm256_set1_ps(p.rod2);
+		const __m256 S          = _mm256_set1_ps(p.S);
+		const __m256 Cpsi       = _mm256_set1_ps(p.Cpsi);
+		const __m256 rod_speed  = _mm256_set1_ps(p.rod_speed);
+		const __m256 rod_max    = _mm256_set1_ps(p.rod_max);
+		const __m256 dt         = _mm256_set1_ps(p.dt);
+		const __m256 zero       = _mm256_setzero_ps();
+
+		size_t i = 0;
+		for(; i + 8 <= count; i += 8)
+		{
+			__m256 n = _mm256_loadu_ps(N + i);
+			__m256 r = _mm256_loadu_ps(rod + i);
+			for(unsigned s = 0; s < steps; ++s)
+			{
+				__m256 r2 = _mm256_mul_ps(r, r);
+				__m256 negative = _mm256_cmp_ps(r, zero, _CMP_LT_OQ);
+				r2 = _mm256_blendv_ps(r2, _mm256_sub_ps(zero, r2), negative);
+
+				__m256 poly = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(rod0, r2), _mm256_mul_ps(rod1, r)), rod2);
+				__m256 dN = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(inv_lambda, poly), n), S);
+				n = _mm256_add_ps(n, _mm256_mul_ps(dN, dt));
+
+				r = _mm256_add_ps(r, rod_speed);
+				r = _mm256_min_ps(rod_max, r);
+			}
+			_mm256_storeu_ps(N + i, n);
+			_mm256_storeu_ps(rod + i, r);
+			if(steps > 0)
+			{
+				_mm256_storeu_ps(Wr + i, _mm256_mul_ps(Cpsi, n));
+			}
+		}
+
+		_mm256_zeroupper();
+		return i;
+	}
+
+	__attribute__((target("avx512f"), optimize("fp-contract=off")))
+	size_t step_avx512(const StepParams<float>& p, float* N, float* rod, float* Wr, size_t count, unsigned steps)
+	{
+		const __m512 inv_lambda = _mm512_set1_ps(p.inv_lambda);
+		const __m512 rod0       = _mm512_set1_ps(p.rod0);
+		const __m512 rod1       = _mm512_set1_ps(p.rod1);
+		const __m512 rod2       = _mm512_set1_ps(p.rod2);
+		const __m512 S          = _mm512_set1_ps(p.S);
+		const __m512 Cpsi       = _mm512_set1_ps(p.Cpsi);
+		const __m512 rod_speed  = _mm512_set1_ps(p.rod_speed);
+		const __m512 rod_max    = _mm512_set1_ps(p.rod_max);
+		const __m512 dt         = _mm512_set1_ps(p.dt);
+		const __m512 zero       = _mm512_setzero_ps();
+
+		size_t i = 0;
+		for(; i + 16 <= count; i += 16)
+		{
+			__m512 n = _mm512_loadu_ps(N + i);
+			__m512 r = _mm512_loadu_ps(rod + i);
+			for(unsigned s = 0; s < steps; ++s)
+			{
+				__m512 r2 = _mm512_mul_ps(r, r);
+				__mmask16 negative = _mm512_cmp_ps_mask(r, zero, _CMP_LT_OQ);
+				r2 = _mm512_mask_sub_ps(r2, negative, zero, r2);
+
+				__m512 poly = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(rod0, r2), _mm512_mul_ps(rod1, r)), rod2);
+				__m512 dN = _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(inv_lambda, poly), n), S);
+				n = _mm512_add_ps(n, _mm512_mul_ps(dN, dt));
+
+				r = _mm512_add_ps(r, rod_speed);
+				r = _mm512_min_ps(rod_max, r);
+			}
+			_mm512_storeu_ps(N + i, n);
+			_mm512_storeu_ps(rod + i, r);
+			if(steps > 0)
+			{
+				_mm512_storeu_ps(Wr + i, _mm512_mul_ps(Cpsi, n));
+			}
+		}
+
+		_mm256_zeroupper();
+		return i;
+	}
+#endif
+}
+
+template<typename Real>
+BasicCoreBatch<Real>::BasicCoreBatch(size_t count)
+	: count_(0)
+	, timebank_(0.0)
+	, kernel_(best_kernel())
+{
+	resize(count);
+}
+
+template<typename Real>
+void BasicCoreBatch<Real>::resize(size_t count)
+{
+	size_t old_count = count_;
+	count_ = count;
+
+	RodPosition_.resize(count);
+	Min_.resize(count);
+	WheatPR_.resize(count);
+	Msgin_.resize(count);
+	MrIn_.resize(count);
+
+	Wr_.resize(count);
+	Mpr_.resize(count);
+	Ppr_.resize(count);
+	Lpr_.resize(count);
+	Psg_.resize(count);
+	Tout_.resize(count);
+
+	N_.resize(count);
+	Mpc_.resize(count);
+	Tpc_.resize(count);
+	Tpr_.resize(count);
+	Msg_.resize(count);
+	Tsg_.resize(count);
+	Tw_.resize(count);
+
+	// new slots start from the Core constructor defaults
+	Core core;
+	for(size_t i = old_count; i < count; ++i)
+	{
+		load(i, core);
+	}
+}
+
+template<typename Real>
+bool BasicCoreBatch<Real>::supports(const Core& core)
+{
+	return core.get_integrator() == Core::Integrator_Euler && core.get_timestep() == Core::FixedTimestep
+		&& core.get_neutronics_substeps() == 1 && core.get_rod_drive() && !core.get_adaptive();
+}
+
+template<typename Real>
+bool BasicCoreBatch<Real>::load(size_t index, const Core& core)
+{
+	if(!supports(core))
+	{
+		return false;
+	}
+
+	set_inputs(index, core.get_inputs());
+	set_state(index, core.get_state());
+
+	Core::Outputs outputs = core.get_outputs();
+	Wr_[index]   = outputs.Wr;
+	Mpr_[index]  = outputs.Mpr;
+	Ppr_[index]  = outputs.Ppr;
+	Lpr_[index]  = outputs.Lpr;
+	Psg_[index]  = outputs.Psg;
+	Tout_[index] = outputs.Tout;
+	return true;
+}
+
+template<typename Real>
+void BasicCoreBatch<Real>::set_inputs(size_t index, const Core::Inputs& inputs)
+{
+	RodPosition_[index] = inputs.RodPosition;
+	Min_[index]         = inputs.Min;
+	WheatPR_[index]     = inputs.WheatPR;
+	Msgin_[index]       = inputs.Msgin;
+	MrIn_[index]        = inputs.MrIn;
+}
+
+template<typename Real>
+Core::Inputs BasicCoreBatch<Real>::get_inputs(size_t index) const
+{
+	Core::Inputs inputs;
+	inputs.RodPosition = RodPosition_[index];
+	inputs.Min         = Min_[index];
+	inputs.WheatPR     = WheatPR_[index];
+	inputs.Msgin       = Msgin_[index];
+	inputs.MrIn        = MrIn_[index];
+	return inputs;
+}
+
+template<typename Real>
+void BasicCoreBatch<Real>::set_state(size_t index, const Core::State& state)
+{
+	N_[index]   = state.N;
+	Mpc_[index] = state.Mpc;
+	Tpc_[index] = state.Tpc;
+	Tpr_[index] = state.Tpr;
+	Msg_[index] = state.Msg;
+	Tsg_[index] = state.Tsg;
+	Tw_[index]  = state.Tw;
+}
+
+template<typename Real>
+Core::State BasicCoreBatch<Real>::get_state(size_t index) const
+{
+	Core::State state;
+	state.N   = N_[index];
+	state.Mpc = Mpc_[index];
+	state.Tpc = Tpc_[index];
+	state.Tpr = Tpr_[index];
+	state.Msg = Msg_[index];
+	state.Tsg = Tsg_[index];
+	state.Tw  = Tw_[index];
+	return state;
+}
+
+template<typename Real>
+Core::Outputs BasicCoreBatch<Real>::get_outputs(size_t index) const
+{
+	Core::Outputs outputs;
+	outputs.Wr   = Wr_[index];
+	outputs.Mpr  = Mpr_[index];
+	outputs.Ppr  = Ppr_[index];
+	outputs.Lpr  = Lpr_[index];
+	outputs.Psg  = Psg_[index];
+	outputs.Tout = Tout_[index];
+	return outputs;
+}
+
+CoreBatchBase::Kernel CoreBatchBase::best_kernel()
+{
+#ifdef COREBATCH_X86
+	if(__builtin_cpu_supports("avx512f"))
+	{
+		return Kernel_AVX512;
+	}
+	if(__builtin_cpu_supports("avx2"))
+	{
+		return Kernel_AVX2;
+	}
+#endif
+	return Kernel_Scalar;
+}
+
+const char* CoreBatchBase::kernel_name(Kernel kernel)
+{
+	switch(kernel)
+	{
+		case Kernel_AVX2:   return "avx2";
+		case Kernel_AVX512: return "avx512";
+		default:            return "scalar";
+	}
+}
+
+template<typename Real>
+void BasicCoreBatch<Real>::set_kernel(Kernel kernel)
+{
+	Kernel best = best_kernel();
+	kernel_ = (kernel > best) ? best : kernel;
+}
+
+template<typename Real>
+void BasicCoreBatch<Real>::simulate(double dt)
+{
+	timebank_ += dt;
+
+	unsigned steps = 0;
+	while(timebank_ > Core::FixedTimestep)
+	{
+		timebank_ -= Core::FixedTimestep;
+		++steps;
+	}
+
+	if(steps == 0 || count_ == 0)
+	{
+		return;
+	}
+
+	const StepParams<Real> params = make_step_params<Real>();
+
+	// every reactor is independent, so each lane runs all of its sub steps
+	// with N and RodPosition held in registers
+	size_t done = 0;
+#ifdef COREBATCH_X86
+	switch(kernel_)
+	{
+		case Kernel_AVX512:
+			done = step_avx512(params, N_.data(), RodPosition_.data(), Wr_.data(), count_, steps);
+			break;
+		case Kernel_AVX2:
+			done = step_avx2(params, N_.data(), RodPosition_.data(), Wr_.data(), count_, steps);
+			break;
+		default:
+			break;
+	}
+#endif
+	step_scalar(params, N_.data(), RodPosition_.data(), Wr_.data(), done, count_, steps);
+}
+
+template class BasicCoreBatch<double>;
+template class BasicCoreBatch<float>;
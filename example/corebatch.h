@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "core.h"
+
+// Kernel selection shared by every precision
+class CoreBatchBase
+{
+public:
+	enum Kernel
+	{
+		Kernel_Scalar,
+		Kernel_AVX2,
+		Kernel_AVX512,
+	};
+
+	static Kernel best_kernel();
+
+	static const char* kernel_name(Kernel kernel);
+};
+
+// Advances many independent reactors together. Every field of the Core
+// Inputs/State/Outputs structs lives in its own contiguous array so the step
+// kernel can process one reactor per SIMD lane.
+//
+// The kernels implement one configuration of Core: forward Euler at
+// Core::FixedTimestep, one flux substep, the rod drive on and fixed steps,
+// which is how a Core is constructed. load() refuses a core set up any
+// other way, and the batch keeps one timebank for every reactor, so a
+// loaded core's own partial step is dropped.
+//
+// For that configuration the kernels perform the same operations in the
+// same order as Core::simulate, with no fused multiply-add. The one
+// difference is the rod worth term: Core uses pow(RodPosition, 2.0), which
+// libm may round one ulp away from the exact RodPosition * RodPosition used
+// here. In double precision the flux therefore agrees with Core to within
+// a few ulps (relative error around 1e-15).
+//
+// Real is the precision the lanes are stored and stepped in. float fits
+// twice as many reactors in a vector as double, at the cost of the model
+// drifting away from Core over time; the precision_drift tool measures
+// how far for a given scenario. Inputs, state and outputs are still passed
+// in and out as Core's doubles.
+template<typename Real>
+class BasicCoreBatch : public CoreBatchBase
+{
+public:
+	typedef Real RealType;
+
+	explicit BasicCoreBatch(size_t count = 0);
+
+	void resize(size_t count);
+
+	inline size_t size() const
+	{
+		return count_;
+	}
+
+	// Copies the inputs, state and outputs of a single Core into slot index.
+	// Returns false, leaving the slot untouched, if the core is not set up
+	// the way the kernels step (see supports).
+	bool load(size_t index, const Core& core);
+
+	// Whether the kernels step this core's configuration
+	static bool supports(const Core& core);
+
+	void set_inputs(size_t index, const Core::Inputs& inputs);
+	Core::Inputs get_inputs(size_t index) const;
+
+	void set_state(size_t index, const Core::State& state);
+	Core::State get_state(size_t index) const;
+
+	Core::Outputs get_outputs(size_t index) const;
+
+	inline double get_flux(size_t index) const
+	{
+		return N_[index];
+	}
+
+	// Selects the kernel used by simulate, falling back to the best one the
+	// cpu supports if the requested one is not available
+	void set_kernel(Kernel kernel);
+
+	inline Kernel get_kernel() const
+	{
+		return kernel_;
+	}
+
+	// Advances every reactor by dt using Core::FixedTimestep sub steps
+	void simulate(double dt);
+
+private:
+	size_t count_;
+	double timebank_;
+	Kernel kernel_;
+
+	// Inputs
+	std::vector<Real> RodPosition_;
+	std::vector<Real> Min_;
+	std::vector<Real> WheatPR_;
+	std::vector<Real> Msgin_;
+	std::vector<Real> MrIn_;
+
+	// Outputs
+	std::vector<Real> Wr_;
+	std::vector<Real> Mpr_;
+	std::vector<Real> Ppr_;
+	std::vector<Real> Lpr_;
+	std::vector<Real> Psg_;
+	std::vector<Real> Tout_;
+
+	// State
+	std::vector<Real> N_;
+	std::vector<Real> Mpc_;
+	std::vector<Real> Tpc_;
+	std::vector<Real> Tpr_;
+	std::vector<Real> Msg_;
+	std::vector<Real> Tsg_;
+	std::vector<Real> Tw_;
+};
+
+// Instantiated in corebatch.cpp
+extern template class BasicCoreBatch<double>;
+extern template class BasicCoreBatch<float>;
+
+typedef BasicCoreBatch<double> CoreBatch;
+typedef BasicCoreBatch<float> CoreBatchFloat;
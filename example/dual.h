@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cmath>
+
+// A value with its derivatives along N directions at once, for forward
+// mode automatic differentiation. Arithmetic on the value is exactly that
+// of plain doubles, so a kernel written for any number type gives the same
+// results in both, and a full Jacobian comes out of a single evaluation
+// with each direction seeded to one input. The derivative loops have a
+// fixed trip count and no dependencies, which the compiler vectorizes.
+template<int N>
+struct Dual
+{
+	double value;
+	double d[N];
+
+	Dual()
+		: value(0.0)
+	{
+		for(int i = 0; i < N; ++i) d[i] = 0.0;
+	}
+
+	// A constant, with all derivatives zero
+	Dual(double v)
+		: value(v)
+	{
+		for(int i = 0; i < N; ++i) d[i] = 0.0;
+	}
+
+	// Leaves the derivatives for the caller to fill in
+	struct Uninitialized {};
+	Dual(double v, Uninitialized)
+		: value(v)
+	{
+	}
+
+	// The independent variable of direction
+	static Dual variable(double v, int direction)
+	{
+		Dual x(v);
+		x.d[direction] = 1.0;
+		return x;
+	}
+
+	inline Dual& operator+=(const Dual& b)
+	{
+		value += b.value;
+		for(int i = 0; i < N; ++i) d[i] += b.d[i];
+		return *this;
+	}
+};
+
+template<int N>
+inline Dual<N> operator+(const Dual<N>& a, const Dual<N>& b)
+{
+	Dual<N> r(a.value + b.value, typename Dual<N>::Uninitialized());
+	for(int i = 0; i < N; ++i) r.d[i] = a.d[i] + b.d[i];
+	return r;
+}
+
+template<int N>
+inline Dual<N> operator-(const Dual<N>& a, const Dual<N>& b)
+{
+	Dual<N> r(a.value - b.value, typename Dual<N>::Uninitialized());
+	for(int i = 0; i < N; ++i) r.d[i] = a.d[i] - b.d[i];
+	return r;
+}
+
+template<int N>
+inline Dual<N> operator*(const Dual<N>& a, const Dual<N>& b)
+{
+	Dual<N> r(a.value * b.value, typename Dual<N>::Uninitialized());
+	for(int i = 0; i < N; ++i) r.d[i] = a.d[i] * b.value + a.value * b.d[i];
+	return r;
+}
+
+template<int N>
+inline Dual<N> operator/(const Dual<N>& a, const Dual<N>& b)
+{
+	Dual<N> r(a.value / b.value, typename Dual<N>::Uninitialized());
+	const double inv = 1.0 / b.value;
+	for(int i = 0; i < N; ++i) r.d[i] = (a.d[i] - r.value * b.d[i]) * inv;
+	return r;
+}
+
+template<int N>
+inline Dual<N> operator+(const Dual<N>& a, double b)
+{
+	Dual<N> r(a);
+	r.value = a.value + b;
+	return r;
+}
+
+template<int N>
+inline Dual<N> operator+(double a, const Dual<N>& b)
+{
+	Dual<N> r(b);
+	r.value = a + b.value;
+	return r;
+}
+
+template<int N>
+inline Dual<N> operator-(const Dual<N>& a, double b)
+{
+	Dual<N> r(a);
+	r.value = a.value - b;
+	return r;
+}
+
+template<int N>
+inline Dual<N> operator-(double a, const Dual<N>& b)
+{
+	Dual<N> r(a - b.value, typename Dual<N>::Uninitialized());
+	for(int i = 0; i < N; ++i) r.d[i] = -b.d[i];
+	return r;
+}
+
+template<int N>
+inline Dual<N> operator/(const Dual<N>& a, double b)
+{
+	Dual<N> r(a.value / b, typename Dual<N>::Uninitialized());
+	const double inv = 1.0 / b;
+	for(int i = 0; i < N; ++i) r.d[i] = a.d[i] * inv;
+	return r;
+}
+
+template<int N>
+inline Dual<N> operator/(double a, const Dual<N>& b)
+{
+	Dual<N> r(a / b.value, typename Dual<N>::Uninitialized());
+	const double slope = -r.value / b.value;
+	for(int i = 0; i < N; ++i) r.d[i] = slope * b.d[i];
+	return r;
+}
+
+template<int N>
+inline Dual<N> operator*(double a, const Dual<N>& b)
+{
+	Dual<N> r(a * b.value, typename Dual<N>::Uninitialized());
+	for(int i = 0; i < N; ++i) r.d[i] = a * b.d[i];
+	return r;
+}
+
+template<int N>
+inline Dual<N> operator*(const Dual<N>& a, double b)
+{
+	Dual<N> r(a.value * b, typename Dual<N>::Uninitialized());
+	for(int i = 0; i < N; ++i) r.d[i] = a.d[i] * b;
+	return r;
+}
+
+// Comparisons look at the value only; branches on them hold derivatives
+// piecewise
+template<int N> inline bool operator<(const Dual<N>& a, double b) { return a.value < b; }
+template<int N> inline bool operator>(const Dual<N>& a, double b) { return a.value > b; }
+template<int N> inline bool operator==(const Dual<N>& a, double b) { return a.value == b; }
+
+template<int N>
+inline Dual<N> expm1(const Dual<N>& a)
+{
+	Dual<N> r(std::expm1(a.value), typename Dual<N>::Uninitialized());
+	const double slope = std::exp(a.value);
+	for(int i = 0; i < N; ++i) r.d[i] = slope * a.d[i];
+	return r;
+}
+
+// Matches Properties::my_pow, which keeps the sign of a negative base
+template<int N>
+inline Dual<N> my_pow(const Dual<N>& x, double y)
+{
+	const double magnitude = std::fabs(x.value);
+	Dual<N> r((x.value < 0.0f) ? -1.0 * pow(-x.value, y) : pow(x.value, y), typename Dual<N>::Uninitialized());
+	const double slope = y * pow(magnitude, y - 1.0);
+	for(int i = 0; i < N; ++i) r.d[i] = slope * x.d[i];
+	return r;
+}
@@ -0,0 +1,206 @@
+#include "ensemble.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "scheduler.h"
+
+namespace
+{
+	constexpr unsigned ParameterCount = sizeof(RuntimePlant) / sizeof(double);
+	static_assert(sizeof(RuntimePlant) == ParameterCount * sizeof(double), "RuntimePlant must only hold doubles");
+
+	const char* const ParameterNames[] =
+	{
+		"RodParams[0]", "RodParams[1]", "RodParams[2]",
+		"Lambda", "S", "CpPC", "KtSG1", "KlossPC", "alpha", "Msg0", "CpSG", "KlossSG", "Ktsg2", "beta",
+		"CpWMw", "Tw0", "CpPR", "WlossPR", "Cpsi", "Apr", "V0pc", "mout", "min", "TpcLoss", "ToutPC", "Msg",
+	};
+	static_assert(sizeof(ParameterNames) / sizeof(ParameterNames[0]) == ParameterCount, "ParameterNames must match RuntimePlant");
+
+	inline double* parameters(RuntimePlant& plant)
+	{
+		return (double*)&plant;
+	}
+}
+
+unsigned Ensemble::parameter_count()
+{
+	return ParameterCount;
+}
+
+const char* Ensemble::parameter_name(unsigned parameter)
+{
+	return parameter < ParameterCount ? ParameterNames[parameter] : nullptr;
+}
+
+bool Ensemble::find_parameter(const char* name, unsigned& parameter)
+{
+	for(unsigned p = 0; p < ParameterCount; ++p)
+	{
+		if(strcmp(name, ParameterNames[p]) == 0)
+		{
+			parameter = p;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Ensemble::parse_axis(const char* spec, Axis& axis)
+{
+	const char* equals = strchr(spec, '=');
+	if(!equals)
+	{
+		return false;
+	}
+
+	const std::string name(spec, equals);
+	char* end;
+	axis.first = strtod(equals + 1, &end);
+	if(*end != ':')
+	{
+		return false;
+	}
+	axis.last = strtod(end + 1, &end);
+	if(*end != ':')
+	{
+		return false;
+	}
+	axis.count = (unsigned)strtoul(end + 1, &end, 10);
+
+	return *end == '\0' && axis.count > 0 && find_parameter(name.c_str(), axis.parameter);
+}
+
+Ensemble::Ensemble()
+	: steps_(0)
+{
+	start_ = Core().get_snapshot();
+}
+
+bool Ensemble::add_axis(const Axis& axis)
+{
+	if(axis.parameter >= ParameterCount || axis.count == 0)
+	{
+		return false;
+	}
+	axes_.push_back(axis);
+	return true;
+}
+
+size_t Ensemble::get_run_count() const
+{
+	size_t count = 1;
+	for(const Axis& axis : axes_)
+	{
+		count *= axis.count;
+	}
+	return count;
+}
+
+double Ensemble::get_axis_value(size_t run, size_t axis) const
+{
+	for(size_t a = axes_.size() - 1; a > axis; --a)
+	{
+		run /= axes_[a].count;
+	}
+
+	const Axis& spec = axes_[axis];
+	const unsigned index = (unsigned)(run % spec.count);
+	if(spec.count == 1)
+	{
+		return spec.first;
+	}
+	return spec.first + (spec.last - spec.first) * index / (spec.count - 1);
+}
+
+RuntimePlant Ensemble::get_plant(size_t run) const
+{
+	RuntimePlant plant = base_plant_;
+	for(size_t a = 0; a < axes_.size(); ++a)
+	{
+		parameters(plant)[axes_[a].parameter] = get_axis_value(run, a);
+	}
+	return plant;
+}
+
+void Ensemble::run_one(size_t run)
+{
+	BasicCore<RuntimePlant> core(get_plant(run));
+	core.restore_snapshot(start_);
+
+	const double h = core.get_timestep();
+	Result result;
+	result.peak_flux = core.get_flux();
+	result.peak_time = 0.0;
+	result.critical_time = core.get_reactivity() >= 0.0 ? 0.0 : -1.0;
+
+	for(unsigned long long s = 1; s <= steps_; ++s)
+	{
+		core.step();
+
+		const double flux = core.get_flux();
+		if(flux > result.peak_flux)
+		{
+			result.peak_flux = flux;
+			result.peak_time = s * h;
+		}
+		if(result.critical_time < 0.0 && core.get_reactivity() >= 0.0)
+		{
+			result.critical_time = s * h;
+		}
+	}
+
+	result.final_flux = core.get_flux();
+	result.final_power = core.get_outputs().Wr;
+	results_[run] = result;
+}
+
+void Ensemble::run_range(void* pArg, struct scheduler*, unsigned begin, unsigned end, unsigned)
+{
+	Ensemble* ensemble = (Ensemble*)pArg;
+	for(unsigned run = begin; run < end; ++run)
+	{
+		ensemble->run_one(run);
+	}
+}
+
+void Ensemble::run(double duration, struct scheduler* sched)
+{
+	steps_ = (unsigned long long)std::llround(duration / start_.timestep);
+	results_.resize(get_run_count());
+
+	struct sched_task task;
+	scheduler_add(&task, sched, run_range, this, (sched_uint)results_.size());
+	scheduler_join(sched, &task);
+}
+
+bool Ensemble::write_table(const std::string& filename) const
+{
+	FILE* file = fopen(filename.c_str(), "w");
+	if(!file)
+	{
+		return false;
+	}
+
+	for(const Axis& axis : axes_)
+	{
+		fprintf(file, "%s,", ParameterNames[axis.parameter]);
+	}
+	fprintf(file, "peak_flux,peak_time,critical_time,final_flux,final_power\n");
+
+	for(size_t run = 0; run < results_.size(); ++run)
+	{
+		for(size_t a = 0; a < axes_.size(); ++a)
+		{
+			fprintf(file, "%.17g,", get_axis_value(run, a));
+		}
+		const Result& result = results_[run];
+		fprintf(file, "%.17g,%.17g,%.17g,%.17g,%.17g\n", result.peak_flux, result.peak_time, result.critical_time,
+			result.final_flux, result.final_power);
+	}
+
+	return (fclose(file) == 0);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "core.h"
+
+struct scheduler;
+
+// Runs a parameter sweep: one core for every combination of values along
+// the sweep's axes, each started from the same snapshot, with summary
+// metrics of each run collected into a table.
+//
+// The runs are split across the scheduler's workers, which steal ranges of
+// runs from each other as they finish. Each run steps a core on the stack
+// and writes one row of the preallocated table, so nothing is allocated
+// per run.
+class Ensemble
+{
+public:
+	// Values first to last inclusive, evenly spaced, of one RuntimePlant
+	// parameter
+	struct Axis
+	{
+		unsigned parameter;
+		double first;
+		double last;
+		unsigned count;
+	};
+
+	struct Result
+	{
+		double peak_flux;
+		double peak_time;
+		// first time the rod reactivity reaches zero, negative if never
+		double critical_time;
+		double final_flux;
+		double final_power;
+	};
+
+	// Parameters are numbered in RuntimePlant order, RodParams[0] first
+	static unsigned parameter_count();
+	static const char* parameter_name(unsigned parameter);
+	static bool find_parameter(const char* name, unsigned& parameter);
+
+	// Parses "name=first:last:count", e.g. "Cpsi=1e7:2e7:16"
+	static bool parse_axis(const char* spec, Axis& axis);
+
+	Ensemble();
+
+	// Returns false for an unknown parameter or an empty axis
+	bool add_axis(const Axis& axis);
+
+	inline const std::vector<Axis>& get_axes() const
+	{
+		return axes_;
+	}
+
+	// Plant the axes are applied to, the reference plant by default
+	inline void set_base_plant(const RuntimePlant& plant)
+	{
+		base_plant_ = plant;
+	}
+
+	// Snapshot every run starts from, a default Core by default. Its
+	// integrator, step and substeps apply to every run; runs take fixed
+	// steps, so its adaptive mode does not. Returns false, keeping the
+	// previous start, if a Core would not restore it.
+	inline bool set_start(const Core::Snapshot& start)
+	{
+		if(!Core().restore_snapshot(start))
+		{
+			return false;
+		}
+		start_ = start;
+		return true;
+	}
+
+	size_t get_run_count() const;
+
+	// The plant of one run; the last axis varies fastest
+	RuntimePlant get_plant(size_t run) const;
+	double get_axis_value(size_t run, size_t axis) const;
+
+	// Runs every combination for duration seconds of plant time
+	void run(double duration, struct scheduler* sched);
+
+	inline const std::vector<Result>& get_results() const
+	{
+		return results_;
+	}
+
+	// Writes the table as csv, one row per run: the axis values then the
+	// metrics
+	bool write_table(const std::string& filename) const;
+
+private:
+	std::vector<Axis> axes_;
+	RuntimePlant base_plant_;
+	Core::Snapshot start_;
+	unsigned long long steps_;
+	std::vector<Result> results_;
+
+	static void run_range(void* pArg, struct scheduler*, unsigned begin, unsigned end, unsigned thread);
+	void run_one(size_t run);
+};
@@ -0,0 +1,223 @@
+#include "events.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+	// Steps a copy of start by h, leaving the step count to the caller
+	inline void step_by(const Core& start, double h, Core& out)
+	{
+		out = start;
+		out.set_timestep(h);
+		out.step();
+		out.set_timestep(start.get_timestep());
+		out.set_step_count(start.get_step_count());
+	}
+}
+
+EventMonitor::EventMonitor()
+	: time_tolerance_(1e-6)
+	, time_(0.0)
+	, localizations_(0)
+	, localization_steps_(0)
+	, partial_step_(0.0)
+{
+}
+
+unsigned EventMonitor::add_event(const char* name, Function function, Direction direction, Action action, void* userdata)
+{
+	Event event;
+	event.name = name;
+	event.function = function;
+	event.direction = direction;
+	event.action = action;
+	event.userdata = userdata;
+	event.count = 0;
+	event.last_time = -1.0;
+	events_.push_back(event);
+
+	before_.resize(events_.size());
+	after_.resize(events_.size());
+	return (unsigned)events_.size() - 1;
+}
+
+bool EventMonitor::crosses(const Event& event, double before, double after) const
+{
+	const bool rising = before < 0.0 && after >= 0.0;
+	const bool falling = before > 0.0 && after <= 0.0;
+	switch(event.direction)
+	{
+		case Direction_Rising:  return rising;
+		case Direction_Falling: return falling;
+		default:                return rising || falling;
+	}
+}
+
+double EventMonitor::locate(const Core& start, unsigned index, double h, Core& at)
+{
+	const Event& event = events_[index];
+
+	// the crossing lies in (a, b]; at holds the core stepped to b
+	double a = 0.0, b = h;
+	double ga = before_[index], gb = after_[index];
+	int retained = 0;
+
+	// the bracket cannot close below the spacing of doubles near h
+	const double tolerance = std::max(time_tolerance_, 4.0 * DBL_EPSILON * h);
+
+	Core trial;
+	while(b - a > tolerance)
+	{
+		double t = b - gb * (b - a) / (gb - ga);
+		if(!(t > a && t < b))
+		{
+			t = 0.5 * (a + b);
+		}
+		if(t == a || t == b)
+		{
+			break;
+		}
+
+		step_by(start, t, trial);
+		++localization_steps_;
+		const double gt = event.function(trial, event.userdata);
+
+		if(crosses(event, ga, gt))
+		{
+			b = t;
+			gb = gt;
+			at = trial;
+
+			// Illinois: when the same end is kept twice, halve its value so
+			// the secant does not stall on one side
+			if(retained < 0)
+			{
+				ga *= 0.5;
+			}
+			retained = -1;
+		}
+		else
+		{
+			a = t;
+			ga = gt;
+			if(retained > 0)
+			{
+				gb *= 0.5;
+			}
+			retained = 1;
+		}
+	}
+	return b;
+}
+
+void EventMonitor::advance(Core& core, double h, double slack)
+{
+	time_ += h;
+	partial_step_ += h;
+	if(partial_step_ >= core.get_timestep() - slack)
+	{
+		core.set_step_count(core.get_step_count() + 1);
+		partial_step_ = std::max(partial_step_ - core.get_timestep(), 0.0);
+	}
+}
+
+void EventMonitor::simulate(Core& core, double dt)
+{
+	const double timestep = core.get_timestep();
+	double remaining = dt;
+
+	// what is left after subtracting the steps can be a few ulps off, which
+	// is not worth another step
+	const double slack = 4.0 * DBL_EPSILON * std::max(dt, timestep);
+
+	Core start;
+	Core earliest_core, candidate_core;
+	while(remaining > 0.0)
+	{
+		const double h = (remaining < timestep) ? remaining : timestep;
+		start = core;
+
+		for(size_t i = 0; i < events_.size(); ++i)
+		{
+			before_[i] = events_[i].function(core, events_[i].userdata);
+		}
+
+		step_by(start, h, core);
+
+		bool crossed = false;
+		for(size_t i = 0; i < events_.size(); ++i)
+		{
+			after_[i] = events_[i].function(core, events_[i].userdata);
+			crossed = crossed || crosses(events_[i], before_[i], after_[i]);
+		}
+
+		if(!crossed)
+		{
+			advance(core, h, slack);
+			remaining -= h;
+			if(remaining < slack)
+			{
+				remaining = 0.0;
+			}
+			continue;
+		}
+
+		// find the first crossing and stop the core just past it
+		double earliest = h;
+		earliest_core = core;
+		for(unsigned i = 0; i < events_.size(); ++i)
+		{
+			if(crosses(events_[i], before_[i], after_[i]))
+			{
+				candidate_core = core;
+				const double t = locate(start, i, h, candidate_core);
+				if(t < earliest)
+				{
+					earliest = t;
+					earliest_core = candidate_core;
+				}
+			}
+		}
+		++localizations_;
+
+		core = earliest_core;
+		advance(core, earliest, slack);
+		remaining -= earliest;
+		if(remaining < slack)
+		{
+			remaining = 0.0;
+		}
+
+		// every event that has crossed by then fires, in the order added
+		for(size_t i = 0; i < events_.size(); ++i)
+		{
+			Event& event = events_[i];
+			if(crosses(event, before_[i], event.function(core, event.userdata)))
+			{
+				++event.count;
+				event.last_time = time_;
+				if(event.action)
+				{
+					event.action(core, event.userdata);
+				}
+			}
+		}
+	}
+}
+
+double EventMonitor::flux_minus_setpoint(const Core& core, void* setpoint)
+{
+	return core.get_flux() - *(const double*)setpoint;
+}
+
+double EventMonitor::power_minus_setpoint(const Core& core, void* setpoint)
+{
+	return core.get_outputs().Wr - *(const double*)setpoint;
+}
+
+double EventMonitor::rods_from_end_stop(const Core& core, void*)
+{
+	return core.get_inputs().RodPosition - Core::RodEndStop;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "core.h"
+
+// Steps a core while watching zero-crossing functions, such as a trip
+// setpoint minus the value it guards. When one changes sign over a step,
+// the crossing is located by root finding on the step size (the Illinois
+// variant of regula falsi, re-stepping from the start of the step), the
+// core is left just past it, and the event's action runs. Steps between
+// events can then be as long as the integrator allows without a trip
+// being noticed late.
+class EventMonitor
+{
+public:
+	enum Direction
+	{
+		Direction_Rising,
+		Direction_Falling,
+		Direction_Both,
+	};
+
+	// Zero at the event
+	typedef double (*Function)(const Core& core, void* userdata);
+	// Runs at the event, e.g. to scram the reactor; may be null. Gets the
+	// same userdata as the event's function.
+	typedef void (*Action)(Core& core, void* userdata);
+
+	struct Event
+	{
+		const char* name;
+		Function function;
+		Direction direction;
+		Action action;
+		void* userdata;
+
+		uint64_t count;
+		// plant time of the last crossing
+		double last_time;
+	};
+
+	// Smallest crossing tolerance, in seconds of plant time
+	static constexpr double MinTimeTolerance = 1e-12;
+
+	EventMonitor();
+
+	// Returns the event's index
+	unsigned add_event(const char* name, Function function, Direction direction, Action action = nullptr, void* userdata = nullptr);
+
+	// Crossings are located to within this much plant time, 1e-6 s by
+	// default. It is kept above MinTimeTolerance, and locating also stops
+	// once the bracket is a few ulps of the step wide.
+	inline void set_time_tolerance(double tolerance)
+	{
+		time_tolerance_ = (tolerance > MinTimeTolerance) ? tolerance : MinTimeTolerance;
+	}
+
+	inline unsigned get_event_count() const
+	{
+		return (unsigned)events_.size();
+	}
+
+	inline const Event& get_event(unsigned index) const
+	{
+		return events_[index];
+	}
+
+	// Plant time advanced through this monitor
+	inline double get_time() const
+	{
+		return time_;
+	}
+
+	// Crossings located so far, and the extra steps it took
+	inline uint64_t get_localizations() const
+	{
+		return localizations_;
+	}
+
+	inline uint64_t get_localization_steps() const
+	{
+		return localization_steps_;
+	}
+
+	// Advances core by dt of plant time in steps of core.get_timestep(),
+	// the last one shortened to land on dt exactly, stopping at crossings.
+	// The core's step count goes up once per timestep of plant time, however
+	// crossings and the last step cut it up, so InputTimeline replay stays
+	// in step; time short of a whole step carries over to the next call.
+	void simulate(Core& core, double dt);
+
+	// Common event functions. The setpoint ones take a pointer to the
+	// setpoint as userdata.
+	static double flux_minus_setpoint(const Core& core, void* setpoint);
+	static double power_minus_setpoint(const Core& core, void* setpoint);
+	// Crosses zero when the rod drive reaches its end stop
+	static double rods_from_end_stop(const Core& core, void*);
+
+private:
+	std::vector<Event> events_;
+	double time_tolerance_;
+	double time_;
+	uint64_t localizations_;
+	uint64_t localization_steps_;
+	// plant time since the core's step count last went up
+	double partial_step_;
+
+	// scratch, sized to the events, so stepping does not allocate
+	std::vector<double> before_;
+	std::vector<double> after_;
+
+	bool crosses(const Event& event, double before, double after) const;
+	double locate(const Core& start, unsigned index, double h, Core& at);
+	void advance(Core& core, double h, double slack);
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+// Plant parameter sets for BasicCore. A plant is a type with the members
+// below; each core holds a copy of its plant and reads them through it, so
+// when they are static constexpr the compiler folds them straight into the
+// step, and when they are plain members every core can have its own.
+
+// The reference plant
+struct PlantParams
+{
+	static constexpr double RodParams [3] = { -1.36e-4, -6.05e-5, -2.88e-4 };
+	static constexpr double Lambda  = 1.0e-5;	//
+	static constexpr double S       = 2859.0;	// %/s
+	static constexpr double CpPC    = 5281.0;	// J/kg/K
+	static constexpr double KtSG1   = 9.19e6;	// W/K
+	static constexpr double KlossPC = 3.0e6;	// W/K
+	static constexpr double alpha   = 1.097;	// --
+	static constexpr double Msg0    = 31810.0;	// kg
+	static constexpr double CpSG    = 4651.1;	// J/kg/K
+	static constexpr double KlossSG = 1.52e8;	// W
+	static constexpr double Ktsg2   = 3.30e6;	// W/K
+	static constexpr double beta    = 2.004;	// --
+	static constexpr double CpWMw   = 2.031e7;	// J/K
+	static constexpr double Tw0     = 267.9;	// deg C
+	static constexpr double CpPR    = 5895.4;	// J/kg/K
+	static constexpr double WlossPR = 1.48e5;	// W
+	static constexpr double Cpsi    = 13.75e6;	// W / %
+	static constexpr double Apr     = 4.52;		// m^2
+	static constexpr double V0pc    = 242.0;	// m^3
+	static constexpr double mout    = 2.9722;	// kg/s
+	static constexpr double min     = 1.4222;	// kg/s
+	static constexpr double TpcLoss = 10.0;		// temperature loss between Tpc,CL and Tpci
+	static constexpr double ToutPC  = 293.0;
+	static constexpr double Msg     = 120.56;	// mass of steam / water through steam-generator
+};
+
+// The reference plant's parameters held in mutable globals, defined in
+// core.cpp, for experimenting with them at runtime. Every step has to
+// reload them from memory.
+struct TunablePlant
+{
+	static double RodParams [3];
+	static double Lambda;
+	static double S;
+	static double CpPC;
+	static double KtSG1;
+	static double KlossPC;
+	static double alpha;
+	static double Msg0;
+	static double CpSG;
+	static double KlossSG;
+	static double Ktsg2;
+	static double beta;
+	static double CpWMw;
+	static double Tw0;
+	static double CpPR;
+	static double WlossPR;
+	static double Cpsi;
+	static double Apr;
+	static double V0pc;
+	static double mout;
+	static double min;
+	static double TpcLoss;
+	static double ToutPC;
+	static double Msg;
+};
+
+// Per core parameters, for cores that differ from each other, e.g. the
+// runs of a parameter sweep. Starts out as the reference plant. Holds only
+// doubles, in the same order as the members above.
+struct RuntimePlant
+{
+	double RodParams [3];
+	double Lambda;
+	double S;
+	double CpPC;
+	double KtSG1;
+	double KlossPC;
+	double alpha;
+	double Msg0;
+	double CpSG;
+	double KlossSG;
+	double Ktsg2;
+	double beta;
+	double CpWMw;
+	double Tw0;
+	double CpPR;
+	double WlossPR;
+	double Cpsi;
+	double Apr;
+	double V0pc;
+	double mout;
+	double min;
+	double TpcLoss;
+	double ToutPC;
+	double Msg;
+
+	RuntimePlant()
+		: RodParams { PlantParams::RodParams[0], PlantParams::RodParams[1], PlantParams::RodParams[2] }
+		, Lambda(PlantParams::Lambda)
+		, S(PlantParams::S)
+		, CpPC(PlantParams::CpPC)
+		, KtSG1(PlantParams::KtSG1)
+		, KlossPC(PlantParams::KlossPC)
+		, alpha(PlantParams::alpha)
+		, Msg0(PlantParams::Msg0)
+		, CpSG(PlantParams::CpSG)
+		, KlossSG(PlantParams::KlossSG)
+		, Ktsg2(PlantParams::Ktsg2)
+		, beta(PlantParams::beta)
+		, CpWMw(PlantParams::CpWMw)
+		, Tw0(PlantParams::Tw0)
+		, CpPR(PlantParams::CpPR)
+		, WlossPR(PlantParams::WlossPR)
+		, Cpsi(PlantParams::Cpsi)
+		, Apr(PlantParams::Apr)
+		, V0pc(PlantParams::V0pc)
+		, mout(PlantParams::mout)
+		, min(PlantParams::min)
+		, TpcLoss(PlantParams::TpcLoss)
+		, ToutPC(PlantParams::ToutPC)
+		, Msg(PlantParams::Msg)
+	{
+	}
+};
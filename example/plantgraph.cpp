@@ -0,0 +1,201 @@
+#include "plantgraph.h"
+
+#include "scheduler.h"
+
+namespace
+{
+	unsigned find_root(std::vector<unsigned>& parent, unsigned node)
+	{
+		while(parent[node] != node)
+		{
+			parent[node] = parent[parent[node]];
+			node = parent[node];
+		}
+		return node;
+	}
+}
+
+PlantGraph::PlantGraph()
+	: substeps_(1)
+	, step_h_(0.0)
+{
+}
+
+unsigned PlantGraph::add_component(std::unique_ptr<Component> component)
+{
+	Node node;
+	node.state = state_.size();
+	node.input = input_.size();
+	node.output = output_.size();
+
+	state_.resize(state_.size() + component->get_state_count(), 0.0);
+	rate_.resize(state_.size(), 0.0);
+	input_.resize(input_.size() + component->get_input_count(), 0.0);
+	output_.resize(output_.size() + component->get_output_count(), 0.0);
+
+	node.component = std::move(component);
+	components_.push_back(std::move(node));
+	return (unsigned)components_.size() - 1;
+}
+
+bool PlantGraph::link(unsigned from, unsigned output, unsigned to, unsigned input, bool tight)
+{
+	if(from >= components_.size() || to >= components_.size()
+		|| output >= components_[from].component->get_output_count()
+		|| input >= components_[to].component->get_input_count())
+	{
+		return false;
+	}
+
+	for(const Link& link : links_)
+	{
+		if(link.to == to && link.input == input)
+		{
+			return false;
+		}
+	}
+
+	Link link = { from, output, to, input, tight };
+	links_.push_back(link);
+	return true;
+}
+
+void PlantGraph::build()
+{
+	// subsystems are the connected components over the tight links
+	std::vector<unsigned> parent(components_.size());
+	for(unsigned c = 0; c < components_.size(); ++c)
+	{
+		parent[c] = c;
+	}
+	for(const Link& link : links_)
+	{
+		if(link.tight)
+		{
+			parent[find_root(parent, link.from)] = find_root(parent, link.to);
+		}
+	}
+
+	subsystems_.clear();
+	std::vector<int> subsystem_of_root(components_.size(), -1);
+	for(unsigned c = 0; c < components_.size(); ++c)
+	{
+		const unsigned root = find_root(parent, c);
+		if(subsystem_of_root[root] < 0)
+		{
+			subsystem_of_root[root] = (int)subsystems_.size();
+			subsystems_.push_back(Subsystem());
+		}
+		subsystems_[subsystem_of_root[root]].components.push_back(c);
+	}
+	for(unsigned l = 0; l < links_.size(); ++l)
+	{
+		if(links_[l].tight)
+		{
+			subsystems_[subsystem_of_root[find_root(parent, links_[l].to)]].links.push_back(l);
+		}
+	}
+
+	for(Node& node : components_)
+	{
+		node.component->initial_state(&state_[node.state]);
+	}
+	for(const Subsystem& subsystem : subsystems_)
+	{
+		update_outputs(subsystem);
+	}
+}
+
+const double* PlantGraph::get_state(unsigned component) const
+{
+	return &state_[components_[component].state];
+}
+
+double* PlantGraph::get_state(unsigned component)
+{
+	return &state_[components_[component].state];
+}
+
+const double* PlantGraph::get_outputs(unsigned component) const
+{
+	return &output_[components_[component].output];
+}
+
+void PlantGraph::update_outputs(const Subsystem& subsystem)
+{
+	for(unsigned c : subsystem.components)
+	{
+		const Node& node = components_[c];
+		node.component->outputs(&state_[node.state], &output_[node.output]);
+	}
+}
+
+void PlantGraph::gather(const Subsystem& subsystem)
+{
+	for(unsigned l : subsystem.links)
+	{
+		const Link& link = links_[l];
+		input_[components_[link.to].input + link.input] = output_[components_[link.from].output + link.output];
+	}
+}
+
+void PlantGraph::step_subsystem(const Subsystem& subsystem, double h)
+{
+	const double h_sub = h / substeps_;
+	for(unsigned s = 0; s < substeps_; ++s)
+	{
+		gather(subsystem);
+
+		for(unsigned c : subsystem.components)
+		{
+			const Node& node = components_[c];
+			node.component->derivatives(&state_[node.state], &input_[node.input], &rate_[node.state]);
+		}
+
+		for(unsigned c : subsystem.components)
+		{
+			const Node& node = components_[c];
+			const size_t end = node.state + node.component->get_state_count();
+			for(size_t i = node.state; i < end; ++i)
+			{
+				state_[i] += h_sub * rate_[i];
+			}
+		}
+
+		update_outputs(subsystem);
+	}
+}
+
+void PlantGraph::step_range(void* pArg, struct scheduler*, unsigned begin, unsigned end, unsigned)
+{
+	PlantGraph* graph = (PlantGraph*)pArg;
+	for(unsigned s = begin; s < end; ++s)
+	{
+		graph->step_subsystem(graph->subsystems_[s], graph->step_h_);
+	}
+}
+
+void PlantGraph::step(double h, struct scheduler* sched)
+{
+	// loose links take the outputs as they stand at the start of the step,
+	// before any subsystem moves on
+	for(const Link& link : links_)
+	{
+		if(!link.tight)
+		{
+			input_[components_[link.to].input + link.input] = output_[components_[link.from].output + link.output];
+		}
+	}
+
+	step_h_ = h;
+	if(sched)
+	{
+		struct sched_task task;
+		scheduler_add(&task, sched, step_range, this, (sched_uint)subsystems_.size());
+		scheduler_join(sched, &task);
+	}
+	else
+	{
+		step_range(this, nullptr, 0, (unsigned)subsystems_.size(), 0);
+	}
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct scheduler;
+
+// A piece of plant: some states, the signals it reads from other
+// components (inputs) and the signals it offers them (outputs), all
+// scalars numbered from zero.
+class Component
+{
+	std::string name_;
+	unsigned state_count_;
+	unsigned input_count_;
+	unsigned output_count_;
+
+public:
+	Component(const std::string& name, unsigned states, unsigned inputs, unsigned outputs)
+		: name_(name)
+		, state_count_(states)
+		, input_count_(inputs)
+		, output_count_(outputs)
+	{
+		;
+	}
+
+	virtual ~Component() = default;
+
+	inline const std::string& get_name() const
+	{
+		return name_;
+	}
+
+	inline unsigned get_state_count() const
+	{
+		return state_count_;
+	}
+
+	inline unsigned get_input_count() const
+	{
+		return input_count_;
+	}
+
+	inline unsigned get_output_count() const
+	{
+		return output_count_;
+	}
+
+	virtual void initial_state(double* state) const = 0;
+
+	// Outputs are a function of the state alone
+	virtual void outputs(const double* state, double* outputs) const = 0;
+
+	virtual void derivatives(const double* state, const double* inputs, double* rate) const = 0;
+};
+
+// Components joined by links from an output of one to an input of
+// another, advanced together with forward Euler.
+//
+// Tight links are exchanged at every substep. Loose links are exchanged
+// once per step: the input holds the output as it was at the start of
+// the step. Components joined by tight links form a subsystem, and as
+// subsystems only meet through loose links they are independent within a
+// step, so each step runs them concurrently on the scheduler. A multi-loop
+// plant with loose links between the loops and the reactor vessel then
+// scales with the number of loops.
+class PlantGraph
+{
+public:
+	PlantGraph();
+
+	// Takes ownership; returns the component's index
+	unsigned add_component(std::unique_ptr<Component> component);
+
+	// Inputs left unlinked read zero. Returns false for an index out of
+	// range or an input that is already linked.
+	bool link(unsigned from, unsigned output, unsigned to, unsigned input, bool tight);
+
+	// Partitions the graph into subsystems and sets every component to its
+	// initial state. Call after the last add_component and link.
+	void build();
+
+	inline size_t get_component_count() const
+	{
+		return components_.size();
+	}
+
+	inline const Component& get_component(unsigned index) const
+	{
+		return *components_[index].component;
+	}
+
+	// For changing a component's settings between steps
+	inline Component& get_component(unsigned index)
+	{
+		return *components_[index].component;
+	}
+
+	inline size_t get_subsystem_count() const
+	{
+		return subsystems_.size();
+	}
+
+	inline void set_substeps(unsigned substeps)
+	{
+		substeps_ = substeps > 0 ? substeps : 1;
+	}
+
+	inline unsigned get_substeps() const
+	{
+		return substeps_;
+	}
+
+	const double* get_state(unsigned component) const;
+	double* get_state(unsigned component);
+	const double* get_outputs(unsigned component) const;
+
+	// Advances every subsystem by h, on the scheduler's workers if sched is
+	// not null and in order on the calling thread otherwise
+	void step(double h, struct scheduler* sched = nullptr);
+
+private:
+	struct Node
+	{
+		std::unique_ptr<Component> component;
+		size_t state;
+		size_t input;
+		size_t output;
+	};
+
+	struct Link
+	{
+		unsigned from;
+		unsigned output;
+		unsigned to;
+		unsigned input;
+		bool tight;
+	};
+
+	struct Subsystem
+	{
+		std::vector<unsigned> components;
+		// into links_, the tight links between its components
+		std::vector<unsigned> links;
+	};
+
+	std::vector<Node> components_;
+	std::vector<Link> links_;
+	std::vector<Subsystem> subsystems_;
+	unsigned substeps_;
+
+	// every component's values, back to back
+	std::vector<double> state_;
+	std::vector<double> rate_;
+	std::vector<double> input_;
+	std::vector<double> output_;
+
+	// the step size passed to the scheduler's tasks
+	double step_h_;
+
+	static void step_range(void* pArg, struct scheduler*, unsigned begin, unsigned end, unsigned thread);
+	void step_subsystem(const Subsystem& subsystem, double h);
+	void update_outputs(const Subsystem& subsystem);
+	void gather(const Subsystem& subsystem);
+};
@@ -0,0 +1,251 @@
+// Runs the same reactors in double and in single precision batches side by
+// side and reports how far the single precision ones drift over time, to
+// decide whether a scenario can use CoreBatchFloat.
+//
+// usage: precision_drift [options]
+//   --duration <s>      plant time to simulate (default 600)
+//   --interval <s>      plant time between reports (default 10)
+//   --reactors <n>      reactors in each batch (default 1024)
+//   --rods <a:b>        starting rod positions, spread evenly from a to b
+//                       (default 0:2.25)
+//   --kernel <name>     scalar, avx2 or avx512 (default: the best supported)
+//   --load-snapshot <f> start every reactor from a saved core, rods spread
+//                       only if --rods is given; the core must be set up the
+//                       way the batch kernels step it (see corebatch.h)
+//   --table <f>         also write the report as csv
+//
+// Divergences are of the float batch from the double one, which matches
+// Core to a few ulps: the largest and mean relative difference in flux and
+// power across the reactors, and the largest difference in rod position.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "core.h"
+#include "corebatch.h"
+
+namespace
+{
+	struct Options
+	{
+		double duration;
+		double interval;
+		unsigned reactors;
+		double rod_first;
+		double rod_last;
+		bool rods_set;
+		CoreBatchBase::Kernel kernel;
+		const char* load_snapshot;
+		const char* table;
+	};
+
+	void usage()
+	{
+		fprintf(stderr,
+			"usage: precision_drift [--duration s] [--interval s] [--reactors n] [--rods a:b]\n"
+			"                       [--kernel scalar|avx2|avx512] [--load-snapshot file] [--table file]\n");
+	}
+
+	bool parse_kernel(const char* name, CoreBatchBase::Kernel& kernel)
+	{
+		const CoreBatchBase::Kernel kernels[] = { CoreBatchBase::Kernel_Scalar, CoreBatchBase::Kernel_AVX2, CoreBatchBase::Kernel_AVX512 };
+		for(CoreBatchBase::Kernel k : kernels)
+		{
+			if(strcmp(name, CoreBatchBase::kernel_name(k)) == 0)
+			{
+				kernel = k;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool parse_options(int argc, char** argv, Options& options)
+	{
+		options.duration  = 600.0;
+		options.interval  = 10.0;
+		options.reactors  = 1024;
+		options.rod_first = 0.0;
+		options.rod_last  = Core::RodEndStop;
+		options.rods_set  = false;
+		options.kernel    = CoreBatchBase::best_kernel();
+		options.load_snapshot = nullptr;
+		options.table = nullptr;
+
+		for(int i = 1; i < argc; ++i)
+		{
+			if(i + 1 >= argc)
+			{
+				return false;
+			}
+
+			const char* value = argv[i + 1];
+			if(strcmp(argv[i], "--duration") == 0)
+			{
+				options.duration = atof(value);
+			}
+			else if(strcmp(argv[i], "--interval") == 0)
+			{
+				options.interval = atof(value);
+			}
+			else if(strcmp(argv[i], "--reactors") == 0)
+			{
+				options.reactors = (unsigned)atoi(value);
+			}
+			else if(strcmp(argv[i], "--rods") == 0)
+			{
+				if(sscanf(value, "%lf:%lf", &options.rod_first, &options.rod_last) != 2)
+				{
+					return false;
+				}
+				options.rods_set = true;
+			}
+			else if(strcmp(argv[i], "--kernel") == 0)
+			{
+				if(!parse_kernel(value, options.kernel))
+				{
+					return false;
+				}
+			}
+			else if(strcmp(argv[i], "--load-snapshot") == 0)
+			{
+				options.load_snapshot = value;
+			}
+			else if(strcmp(argv[i], "--table") == 0)
+			{
+				options.table = value;
+			}
+			else
+			{
+				return false;
+			}
+			++i;
+		}
+
+		return options.duration > 0.0 && options.interval > 0.0 && options.reactors > 0;
+	}
+
+	struct Divergence
+	{
+		double flux_max;
+		double flux_mean;
+		double power_max;
+		double rod_max;
+	};
+
+	// Relative difference, treating two zeros as equal
+	inline double relative_error(double a, double b)
+	{
+		double scale = std::fabs(a) > std::fabs(b) ? std::fabs(a) : std::fabs(b);
+		return scale > 0.0 ? std::fabs(a - b) / scale : 0.0;
+	}
+
+	Divergence measure(const CoreBatch& reference, const CoreBatchFloat& single)
+	{
+		Divergence d;
+		memset(&d, 0, sizeof(d));
+		for(size_t i = 0; i < reference.size(); ++i)
+		{
+			const double flux = relative_error(single.get_flux(i), reference.get_flux(i));
+			const double power = relative_error(single.get_outputs(i).Wr, reference.get_outputs(i).Wr);
+			const double rod = std::fabs(single.get_inputs(i).RodPosition - reference.get_inputs(i).RodPosition);
+			d.flux_max = std::fmax(d.flux_max, flux);
+			d.flux_mean += flux;
+			d.power_max = std::fmax(d.power_max, power);
+			d.rod_max = std::fmax(d.rod_max, rod);
+		}
+		d.flux_mean /= (double)reference.size();
+		return d;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if(!parse_options(argc, argv, options))
+	{
+		usage();
+		return 1;
+	}
+
+	Core start;
+	if(options.load_snapshot && !start.load_snapshot(options.load_snapshot))
+	{
+		fprintf(stderr, "unable to load snapshot '%s'\n", options.load_snapshot);
+		return 1;
+	}
+	const bool spread = options.rods_set || !options.load_snapshot;
+
+	CoreBatch reference(options.reactors);
+	CoreBatchFloat single(options.reactors);
+	reference.set_kernel(options.kernel);
+	single.set_kernel(options.kernel);
+	for(unsigned i = 0; i < options.reactors; ++i)
+	{
+		Core core = start;
+		if(spread)
+		{
+			Core::Inputs inputs = core.get_inputs();
+			const double t = (options.reactors > 1) ? (double)i / (options.reactors - 1) : 0.0;
+			inputs.RodPosition = options.rod_first + t * (options.rod_last - options.rod_first);
+			core.set_inputs(inputs);
+		}
+		if(!reference.load(i, core) || !single.load(i, core))
+		{
+			fprintf(stderr, "the batch kernels only step forward Euler at the fixed step, one substep, with the rod drive on\n");
+			return 1;
+		}
+	}
+
+	FILE* table = nullptr;
+	if(options.table)
+	{
+		table = fopen(options.table, "w");
+		if(!table)
+		{
+			fprintf(stderr, "unable to write table '%s'\n", options.table);
+			return 1;
+		}
+		fprintf(table, "time,flux_max,flux_mean,power_max,rod_max\n");
+	}
+
+	printf("%u reactors, %s kernel, rods %g to %g\n", options.reactors, CoreBatchBase::kernel_name(reference.get_kernel()),
+		spread ? options.rod_first : start.get_inputs().RodPosition, spread ? options.rod_last : start.get_inputs().RodPosition);
+	printf("%10s %12s %12s %12s %12s\n", "time", "flux max", "flux mean", "power max", "rod max");
+
+	typedef std::chrono::steady_clock Clock;
+	double reference_seconds = 0.0, single_seconds = 0.0;
+	for(double time = 0.0; time < options.duration; )
+	{
+		const double dt = std::fmin(options.interval, options.duration - time);
+		time += dt;
+
+		auto begin = Clock::now();
+		reference.simulate(dt);
+		auto middle = Clock::now();
+		single.simulate(dt);
+		auto end = Clock::now();
+		reference_seconds += std::chrono::duration<double>(middle - begin).count();
+		single_seconds += std::chrono::duration<double>(end - middle).count();
+
+		const Divergence d = measure(reference, single);
+		printf("%10.1f %12.3e %12.3e %12.3e %12.3e\n", time, d.flux_max, d.flux_mean, d.power_max, d.rod_max);
+		if(table)
+		{
+			fprintf(table, "%.17g,%.17g,%.17g,%.17g,%.17g\n", time, d.flux_max, d.flux_mean, d.power_max, d.rod_max);
+		}
+	}
+
+	if(table)
+	{
+		fclose(table);
+	}
+
+	const double reactor_steps = (double)options.reactors * std::floor(options.duration / Core::FixedTimestep);
+	printf("double %12.0f reactor-steps/s\n", reactor_steps / reference_seconds);
+	printf("float  %12.0f reactor-steps/s  x%.2f\n", reactor_steps / single_seconds, reference_seconds / single_seconds);
+	return 0;
+}
@@ -0,0 +1,287 @@
+#include "properties.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PROPERTIES_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	constexpr uint64_t SignMask     = 0x8000000000000000ull;
+	constexpr uint64_t MantissaMask = 0x000fffffffffffffull;
+	constexpr uint64_t OneBits      = 0x3ff0000000000000ull;
+	constexpr unsigned MantissaBits = 52;
+	constexpr unsigned MaxSegmentBits = 12;
+
+	// allowance for rounding in the table values, the coefficients and the
+	// evaluation, on top of the interpolation remainder
+	constexpr double RoundingBound = 16.0 * 0x1p-53;
+
+	inline uint64_t to_bits(double value)
+	{
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	inline double from_bits(uint64_t bits)
+	{
+		double value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	inline uint64_t biased_exponent(double x)
+	{
+		return (to_bits(x) & ~SignMask) >> MantissaBits;
+	}
+
+	// Relative interpolation error of a cubic through the Chebyshev nodes of
+	// a slice of [1, 2) of width h, for m^a:
+	//   |f''''| / 4! * (h/2)^4 / 2^3, over the smallest |f|
+	double interpolation_bound(double a, double h)
+	{
+		const double derivative = std::fabs(a * (a - 1.0) * (a - 2.0) * (a - 3.0)) * std::fmax(1.0, std::pow(2.0, a - 4.0));
+		const double smallest = std::fmin(1.0, std::pow(2.0, a));
+		const double half = 0.5 * h;
+		return derivative / 24.0 * (half * half * half * half) / 8.0 / smallest;
+	}
+
+	// Monomial coefficients, in u = m - start, of the cubic through m^a at
+	// the four Chebyshev nodes of [start, start + h]
+	void fit_segment(double a, double start, double h, double* c)
+	{
+		constexpr double Pi = 3.14159265358979323846;
+
+		long double u[4], d[4];
+		for(int k = 0; k < 4; ++k)
+		{
+			u[k] = 0.5L * h * (1.0L - std::cos((2 * k + 1) * Pi / 8.0));
+			d[k] = std::pow((long double)start + u[k], (long double)a);
+		}
+
+		// Newton divided differences
+		for(int j = 1; j < 4; ++j)
+		{
+			for(int k = 3; k >= j; --k)
+			{
+				d[k] = (d[k] - d[k - 1]) / (u[k] - u[k - j]);
+			}
+		}
+
+		// expand d0 + (u-u0)(d1 + (u-u1)(d2 + (u-u2) d3))
+		long double q[4] = { d[3], 0.0L, 0.0L, 0.0L };
+		for(int j = 2; j >= 0; --j)
+		{
+			for(int k = 3; k > 0; --k)
+			{
+				q[k] = q[k - 1] - u[j] * q[k];
+			}
+			q[0] = d[j] - u[j] * q[0];
+		}
+
+		for(int k = 0; k < 4; ++k)
+		{
+			c[k] = (double)q[k];
+		}
+	}
+
+#ifdef PROPERTIES_X86
+	__attribute__((target("avx2"), optimize("fp-contract=off")))
+	size_t evaluate_avx2(const double* scales, const double* coefficients, uint64_t first, uint64_t last, unsigned segment_bits,
+		double exponent, const double* x, double* result, size_t count)
+	{
+		const __m256i sign      = _mm256_set1_epi64x((long long)SignMask);
+		const __m256i mantissa  = _mm256_set1_epi64x((long long)MantissaMask);
+		const __m256i one       = _mm256_set1_epi64x((long long)OneBits);
+		const __m256i first_v   = _mm256_set1_epi64x((long long)first);
+		const __m256i last_v    = _mm256_set1_epi64x((long long)last);
+		const __m256i segment   = _mm256_set1_epi64x((long long)((1u << segment_bits) - 1));
+		const int shift = MantissaBits - segment_bits;
+
+		size_t i = 0;
+		for(; i + 4 <= count; i += 4)
+		{
+			const __m256i bits = _mm256_castpd_si256(_mm256_loadu_pd(x + i));
+			const __m256i magnitude = _mm256_andnot_si256(sign, bits);
+			__m256i octave = _mm256_srli_epi64(magnitude, MantissaBits);
+
+			// lanes outside the table fall back to my_pow below, until then
+			// they read the first entry so the gathers stay in bounds
+			const __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi64(first_v, octave), _mm256_cmpgt_epi64(octave, last_v));
+			octave = _mm256_blendv_epi8(octave, first_v, outside);
+
+			const __m256i slice = _mm256_and_si256(_mm256_srli_epi64(magnitude, shift), segment);
+			const __m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(magnitude, mantissa), one));
+			const __m256d start = _mm256_castsi256_pd(_mm256_or_si256(one, _mm256_slli_epi64(slice, shift)));
+			const __m256d u = _mm256_sub_pd(m, start);
+
+			const __m256i index = _mm256_slli_epi64(slice, 2);
+			const __m256d c0 = _mm256_i64gather_pd(coefficients + 0, index, 8);
+			const __m256d c1 = _mm256_i64gather_pd(coefficients + 1, index, 8);
+			const __m256d c2 = _mm256_i64gather_pd(coefficients + 2, index, 8);
+			const __m256d c3 = _mm256_i64gather_pd(coefficients + 3, index, 8);
+			const __m256d scale = _mm256_i64gather_pd(scales, _mm256_sub_epi64(octave, first_v), 8);
+
+			__m256d p = _mm256_add_pd(_mm256_mul_pd(c3, u), c2);
+			p = _mm256_add_pd(_mm256_mul_pd(p, u), c1);
+			p = _mm256_add_pd(_mm256_mul_pd(p, u), c0);
+			p = _mm256_mul_pd(scale, p);
+
+			// negative x gives a negative result, as in my_pow
+			p = _mm256_xor_pd(p, _mm256_castsi256_pd(_mm256_and_si256(bits, sign)));
+			_mm256_storeu_pd(result + i, p);
+
+			if(_mm256_movemask_pd(_mm256_castsi256_pd(outside)))
+			{
+				for(size_t j = i; j < i + 4; ++j)
+				{
+					if(biased_exponent(x[j]) < first || biased_exponent(x[j]) > last)
+					{
+						result[j] = Properties::my_pow(x[j], exponent);
+					}
+				}
+			}
+		}
+
+		// the compiler only inserts this itself when optimizing
+		_mm256_zeroupper();
+		return i;
+	}
+#endif
+}
+
+void Properties::water_density(const double* temperature, double* density, size_t count)
+{
+	for(size_t i = 0; i < count; ++i)
+	{
+		density[i] = water_density(temperature[i]);
+	}
+}
+
+void Properties::saturated_vapor_pressure(const double* temperature, double* pressure, size_t count)
+{
+	for(size_t i = 0; i < count; ++i)
+	{
+		pressure[i] = saturated_vapor_pressure(temperature[i]);
+	}
+}
+
+PowerTable::PowerTable()
+	: exponent_(1.0)
+	, error_bound_(0.0)
+	, segment_bits_(0)
+	, first_octave_(1)
+	, last_octave_(0)
+	, kernel_(best_kernel())
+{
+}
+
+bool PowerTable::build(double exponent, double min_x, double max_x, double tolerance)
+{
+	if(!std::isfinite(exponent) || !std::isnormal(min_x) || !std::isnormal(max_x) || min_x <= 0.0 || max_x < min_x)
+	{
+		return false;
+	}
+
+	unsigned segment_bits = 0;
+	while(interpolation_bound(exponent, 1.0 / (1u << segment_bits)) + RoundingBound > tolerance)
+	{
+		if(++segment_bits > MaxSegmentBits)
+		{
+			return false;
+		}
+	}
+
+	const uint64_t first = biased_exponent(min_x);
+	const uint64_t last = biased_exponent(max_x);
+
+	std::vector<double> scales;
+	for(uint64_t octave = first; octave <= last; ++octave)
+	{
+		const double scale = std::pow(std::ldexp(1.0, (int)octave - 1023), exponent);
+		if(!std::isnormal(scale))
+		{
+			return false;
+		}
+		scales.push_back(scale);
+	}
+
+	const unsigned segments = 1u << segment_bits;
+	const double h = 1.0 / segments;
+	std::vector<double> coefficients(4 * segments);
+	for(unsigned s = 0; s < segments; ++s)
+	{
+		fit_segment(exponent, 1.0 + s * h, h, &coefficients[4 * s]);
+	}
+
+	exponent_ = exponent;
+	error_bound_ = interpolation_bound(exponent, h) + RoundingBound;
+	segment_bits_ = segment_bits;
+	first_octave_ = first;
+	last_octave_ = last;
+	scales_.swap(scales);
+	coefficients_.swap(coefficients);
+	return true;
+}
+
+PowerTable::Kernel PowerTable::best_kernel()
+{
+#ifdef PROPERTIES_X86
+	if(__builtin_cpu_supports("avx2"))
+	{
+		return Kernel_AVX2;
+	}
+#endif
+	return Kernel_Scalar;
+}
+
+const char* PowerTable::kernel_name(Kernel kernel)
+{
+	switch(kernel)
+	{
+		case Kernel_AVX2: return "avx2";
+		default:          return "scalar";
+	}
+}
+
+void PowerTable::set_kernel(Kernel kernel)
+{
+	kernel_ = (kernel > best_kernel()) ? best_kernel() : kernel;
+}
+
+double PowerTable::evaluate(double x) const
+{
+	const uint64_t bits = to_bits(x);
+	const uint64_t magnitude = bits & ~SignMask;
+	const uint64_t octave = magnitude >> MantissaBits;
+	if(octave < first_octave_ || octave > last_octave_)
+	{
+		return Properties::my_pow(x, exponent_);
+	}
+
+	const unsigned shift = MantissaBits - segment_bits_;
+	const uint64_t slice = (magnitude >> shift) & ((1u << segment_bits_) - 1);
+	const double u = from_bits((magnitude & MantissaMask) | OneBits) - from_bits(OneBits | (slice << shift));
+
+	const double* c = &coefficients_[4 * slice];
+	const double p = scales_[octave - first_octave_] * (((c[3] * u + c[2]) * u + c[1]) * u + c[0]);
+	return from_bits(to_bits(p) ^ (bits & SignMask));
+}
+
+void PowerTable::evaluate(const double* x, double* result, size_t count) const
+{
+	size_t i = 0;
+#ifdef PROPERTIES_X86
+	if(kernel_ == Kernel_AVX2 && is_built())
+	{
+		i = evaluate_avx2(scales_.data(), coefficients_.data(), first_octave_, last_octave_, segment_bits_, exponent_, x, result, count);
+	}
+#endif
+	for(; i < count; ++i)
+	{
+		result[i] = evaluate(x[i]);
+	}
+}
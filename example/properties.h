@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Property functions used by the thermal model, with array versions for
+// evaluating many temperatures at once.
+namespace Properties
+{
+	// Estimates the water density at a given temperature kelvin
+	inline double water_density(double temperature)
+	{
+		constexpr double C0 = 581.2;
+		constexpr double C1 = 2.98;
+		constexpr double C2 = -0.00848;
+
+		return C0 + C1 * temperature + C2 * temperature * temperature;
+	}
+
+	// Estimates the saturated vapor pressure using centigrade
+	// returns in units of kPa
+	inline double saturated_vapor_pressure(double temperature)
+	{
+		return 28884.78 - 258.01*temperature + 0.63*temperature*temperature;
+	}
+
+	// pow that keeps the sign of a negative base
+	inline double my_pow(double x, double y)
+	{
+		if(x < 0.0f)
+		{
+			return -1.0 * pow(-x, y);
+		}
+		else
+		{
+			return pow(x,y);
+		}
+	}
+
+	// Both fits are already quadratics, cheaper than any table lookup, so
+	// the array versions evaluate them exactly as the scalar ones do
+	void water_density(const double* temperature, double* density, size_t count);
+	void saturated_vapor_pressure(const double* temperature, double* pressure, size_t count);
+}
+
+// Approximates my_pow(x, exponent) for a fixed exponent, e.g. the alpha
+// and beta heat transfer exponents of the plant.
+//
+// x is split into its binary exponent e and mantissa m in [1, 2), so that
+// |x|^a = 2^(e a) * m^a. 2^(e a) comes from a table with one entry per
+// octave, and m^a from a cubic on one of segments equal slices of [1, 2),
+// interpolated at Chebyshev nodes. The relative error is then bounded by
+// the interpolation remainder, worked out from the fourth derivative of
+// m^a, plus a few ulps of rounding; get_error_bound() reports the total.
+// Values outside the octaves of [min_x, max_x], zero, subnormals, infinity
+// and NaN fall back to my_pow.
+class PowerTable
+{
+public:
+	enum Kernel
+	{
+		Kernel_Scalar,
+		Kernel_AVX2,
+	};
+
+	PowerTable();
+
+	// Picks the fewest segments (a power of two, at most 4096) that keep
+	// the relative error under tolerance. Returns false if that is not
+	// possible or the range is empty.
+	bool build(double exponent, double min_x, double max_x, double tolerance);
+
+	inline bool is_built() const
+	{
+		return !scales_.empty();
+	}
+
+	inline double get_exponent() const
+	{
+		return exponent_;
+	}
+
+	inline double get_error_bound() const
+	{
+		return error_bound_;
+	}
+
+	inline unsigned get_segment_count() const
+	{
+		return 1u << segment_bits_;
+	}
+
+	// Fastest kernel the running cpu supports
+	static Kernel best_kernel();
+	static const char* kernel_name(Kernel kernel);
+
+	// Falls back to the best supported kernel if this one is not available
+	void set_kernel(Kernel kernel);
+
+	inline Kernel get_kernel() const
+	{
+		return kernel_;
+	}
+
+	double evaluate(double x) const;
+	void evaluate(const double* x, double* result, size_t count) const;
+
+private:
+	double exponent_;
+	double error_bound_;
+	unsigned segment_bits_;
+
+	// biased binary exponents covered by scales_
+	uint64_t first_octave_;
+	uint64_t last_octave_;
+
+	// 2^(e a) for each covered octave, and c0..c3 of each segment's cubic
+	// in the offset from the segment start
+	std::vector<double> scales_;
+	std::vector<double> coefficients_;
+
+	Kernel kernel_;
+};
@@ -0,0 +1,273 @@
+#include "publisher.h"
+
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(StatePublisher::Header) == 64, "StatePublisher::Header layout changed, bump Version");
+
+StatePublisher::StatePublisher()
+	: header_(nullptr)
+	, slots_(nullptr)
+	, size_(0)
+{
+}
+
+StatePublisher::~StatePublisher()
+{
+	close();
+}
+
+size_t StatePublisher::mapping_size(uint32_t slot_count)
+{
+	return sizeof(Header) + (size_t)slot_count * sizeof(Slot);
+}
+
+bool StatePublisher::open(const std::string& name, uint32_t slot_count, bool replace)
+{
+	close();
+	if(slot_count == 0)
+	{
+		return false;
+	}
+
+	// always a fresh object, so readers of an old one are not confused by
+	// a layout change
+	if(replace)
+	{
+		shm_unlink(name.c_str());
+	}
+	int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if(fd < 0)
+	{
+		return false;
+	}
+
+	const size_t size = mapping_size(slot_count);
+	if(ftruncate(fd, (off_t)size) != 0)
+	{
+		::close(fd);
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(memory == MAP_FAILED)
+	{
+		shm_unlink(name.c_str());
+		return false;
+	}
+
+	// the object comes zero filled: every slot at sequence 0, never written
+	header_ = new(memory) Header;
+	slots_ = (Slot*)((char*)memory + sizeof(Header));
+	for(uint32_t i = 0; i < slot_count; ++i)
+	{
+		new(&slots_[i]) Slot;
+		slots_[i].sequence.store(0, std::memory_order_relaxed);
+	}
+
+	header_->slot_count = slot_count;
+	header_->slot_size = sizeof(Slot);
+	header_->version = Version;
+	header_->published.store(0, std::memory_order_relaxed);
+
+	// readers check the magic last
+	std::atomic_thread_fence(std::memory_order_release);
+	header_->magic = Magic;
+
+	name_ = name;
+	size_ = size;
+	return true;
+}
+
+void StatePublisher::close()
+{
+	if(!header_)
+	{
+		return;
+	}
+
+	munmap(header_, size_);
+	shm_unlink(name_.c_str());
+	header_ = nullptr;
+	slots_ = nullptr;
+	size_ = 0;
+}
+
+void StatePublisher::publish(double time, const Core& core)
+{
+	if(!header_)
+	{
+		return;
+	}
+
+	const uint64_t index = header_->published.load(std::memory_order_relaxed);
+	Slot& slot = slots_[index % header_->slot_count];
+
+	slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.frame.frame      = index;
+	slot.frame.step_count = core.get_step_count();
+	slot.frame.time       = time;
+	slot.frame.inputs     = core.get_inputs();
+	slot.frame.state      = core.get_state();
+	slot.frame.outputs    = core.get_outputs();
+
+	slot.sequence.store(2 * index + 2, std::memory_order_release);
+	header_->published.store(index + 1, std::memory_order_release);
+}
+
+StateSubscriber::StateSubscriber()
+	: header_(nullptr)
+	, slots_(nullptr)
+	, size_(0)
+	, next_(0)
+	, dropped_(0)
+{
+}
+
+StateSubscriber::~StateSubscriber()
+{
+	close();
+}
+
+bool StateSubscriber::open(const std::string& name)
+{
+	close();
+
+	int fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if(fd < 0)
+	{
+		return false;
+	}
+
+	struct stat info;
+	if(fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(StatePublisher::Header))
+	{
+		::close(fd);
+		return false;
+	}
+
+	const size_t size = (size_t)info.st_size;
+	void* memory = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(memory == MAP_FAILED)
+	{
+		return false;
+	}
+
+	const StatePublisher::Header* header = (const StatePublisher::Header*)memory;
+	const bool valid = header->magic == StatePublisher::Magic;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if(!valid || header->version != StatePublisher::Version || header->slot_size != sizeof(StatePublisher::Slot)
+		|| header->slot_count == 0 || StatePublisher::mapping_size(header->slot_count) > size)
+	{
+		munmap(memory, size);
+		return false;
+	}
+
+	header_ = header;
+	slots_ = (const StatePublisher::Slot*)((const char*)memory + sizeof(StatePublisher::Header));
+	size_ = size;
+
+	const uint64_t published = header_->published.load(std::memory_order_acquire);
+	next_ = published > 0 ? published - 1 : 0;
+	dropped_ = 0;
+	return true;
+}
+
+void StateSubscriber::close()
+{
+	if(!header_)
+	{
+		return;
+	}
+
+	munmap((void*)header_, size_);
+	header_ = nullptr;
+	slots_ = nullptr;
+	size_ = 0;
+}
+
+bool StateSubscriber::read_frame(uint64_t index, Frame& frame) const
+{
+	const StatePublisher::Slot& slot = slots_[index % header_->slot_count];
+	const uint64_t complete = 2 * index + 2;
+
+	const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+	if(before != complete)
+	{
+		return false;
+	}
+
+	memcpy(&frame, (const void*)&slot.frame, sizeof(Frame));
+
+	// the copy must be complete before the sequence is checked again
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot.sequence.load(std::memory_order_relaxed) == before;
+}
+
+bool StateSubscriber::read_latest(Frame& frame)
+{
+	if(!header_)
+	{
+		return false;
+	}
+
+	// the newest frame can only be overwritten by a publisher a whole ring
+	// ahead, so a retry or two always succeeds
+	for(;;)
+	{
+		const uint64_t published = header_->published.load(std::memory_order_acquire);
+		if(published == 0)
+		{
+			return false;
+		}
+		if(read_frame(published - 1, frame))
+		{
+			return true;
+		}
+	}
+}
+
+bool StateSubscriber::read_next(Frame& frame)
+{
+	if(!header_)
+	{
+		return false;
+	}
+
+	for(;;)
+	{
+		const uint64_t published = header_->published.load(std::memory_order_acquire);
+		if(next_ >= published)
+		{
+			return false;
+		}
+
+		// anything a whole ring behind is gone
+		const uint64_t oldest = (published > header_->slot_count) ? published - header_->slot_count : 0;
+		if(next_ < oldest)
+		{
+			dropped_ += oldest - next_;
+			next_ = oldest;
+		}
+
+		if(read_frame(next_, frame))
+		{
+			++next_;
+			return true;
+		}
+
+		// overwritten while copying; count it and move on
+		++dropped_;
+		++next_;
+	}
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "core.h"
+
+// Publishes Core state to other processes on the same machine through a
+// POSIX shared memory object, for viewers, loggers and analytics that
+// should not run on (or slow down) the simulation thread.
+//
+// The object holds a ring of frames, each guarded by a sequence lock. The
+// publisher never waits: it marks a slot as being written (odd sequence),
+// writes the frame in place and marks it done (even sequence). A reader
+// copies a frame out of the mapping and keeps it only if the sequence was
+// even and unchanged across the copy, so any number of readers can follow
+// along without a lock, and a reader that falls more than a ring behind
+// loses the oldest frames rather than holding up the publisher.
+//
+// Layout (native endian, the processes share a machine):
+//   Header, padded to a cache line, then slot_count Slots of one or more
+//   cache lines each. Slot i holds frames i, i + slot_count, ...; a slot's
+//   sequence is 2 * frame + 1 while frame is written and 2 * frame + 2
+//   once it is complete.
+class StatePublisher
+{
+public:
+	static constexpr uint32_t Magic = 0x42555053; // "SPUB"
+	static constexpr uint32_t Version = 1;
+
+	struct Frame
+	{
+		// frames published before this one
+		uint64_t frame;
+		uint64_t step_count;
+		// plant time, as given to publish()
+		double time;
+		Core::Inputs inputs;
+		Core::State state;
+		Core::Outputs outputs;
+	};
+
+	struct alignas(64) Header
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t slot_count;
+		uint32_t slot_size;
+		// frames published so far
+		std::atomic<uint64_t> published;
+	};
+
+	struct alignas(64) Slot
+	{
+		std::atomic<uint64_t> sequence;
+		Frame frame;
+	};
+
+	static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock free");
+
+	StatePublisher();
+	~StatePublisher();
+
+	StatePublisher(const StatePublisher&) = delete;
+	StatePublisher& operator=(const StatePublisher&) = delete;
+
+	// Creates the shared memory object name, e.g. "/nuke-sim", with a ring
+	// of slot_count frames. Fails if the name is taken, e.g. by another
+	// running publisher, unless replace is set; then the old object is
+	// removed and its readers stop seeing updates.
+	bool open(const std::string& name, uint32_t slot_count = 256, bool replace = false);
+
+	// Unmaps and removes the object; readers that still have it mapped keep
+	// what they have
+	void close();
+
+	inline bool is_open() const
+	{
+		return header_ != nullptr;
+	}
+
+	// Called from the simulation thread, never blocks
+	void publish(double time, const Core& core);
+
+	inline uint64_t get_published() const
+	{
+		return header_ ? header_->published.load(std::memory_order_relaxed) : 0;
+	}
+
+	static size_t mapping_size(uint32_t slot_count);
+
+private:
+	std::string name_;
+	Header* header_;
+	Slot* slots_;
+	size_t size_;
+};
+
+// Follows a StatePublisher from another process (or thread)
+class StateSubscriber
+{
+public:
+	typedef StatePublisher::Frame Frame;
+
+	StateSubscriber();
+	~StateSubscriber();
+
+	StateSubscriber(const StateSubscriber&) = delete;
+	StateSubscriber& operator=(const StateSubscriber&) = delete;
+
+	// Maps an existing object read only. Returns false if it does not exist
+	// or is not a publisher of this version. The subscriber starts at the
+	// newest frame.
+	bool open(const std::string& name);
+	void close();
+
+	inline bool is_open() const
+	{
+		return header_ != nullptr;
+	}
+
+	// Copies the newest complete frame. Returns false if nothing has been
+	// published yet.
+	bool read_latest(Frame& frame);
+
+	// Copies the next frame after the last one read, for readers that want
+	// every frame. Returns false once caught up. Frames overwritten before
+	// they could be read are skipped and counted in get_dropped().
+	bool read_next(Frame& frame);
+
+	inline uint64_t get_dropped() const
+	{
+		return dropped_;
+	}
+
+private:
+	const StatePublisher::Header* header_;
+	const StatePublisher::Slot* slots_;
+	size_t size_;
+	uint64_t next_;
+	uint64_t dropped_;
+
+	// Copies frame number index if the slot still holds it
+	bool read_frame(uint64_t index, Frame& frame) const;
+};
@@ -0,0 +1,364 @@
+#include "recorder.h"
+
+#include <chrono>
+#include <cstring>
+
+static_assert(sizeof(Core::State) == 7 * sizeof(double), "Recorder channels must match Core::State");
+static_assert(sizeof(Core::Outputs) == 6 * sizeof(double), "Recorder channels must match Core::Outputs");
+static_assert(sizeof(Core::Inputs) == 5 * sizeof(double), "Recorder channels must match Core::Inputs");
+
+namespace
+{
+	// Marks a value identical to the previous one. Any other control byte
+	// packs the count of leading and trailing zero bytes of the XOR, which
+	// never reaches 15 for a non-zero value.
+	constexpr uint8_t RepeatedValue = 0xFF;
+
+	inline uint64_t to_bits(double value)
+	{
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	inline double from_bits(uint64_t bits)
+	{
+		double value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	void encode_column(const std::vector<double>& column, std::vector<uint8_t>& out)
+	{
+		out.clear();
+		uint64_t previous = 0;
+		for(double value : column)
+		{
+			const uint64_t bits = to_bits(value);
+			const uint64_t x = bits ^ previous;
+			previous = bits;
+
+			if(x == 0)
+			{
+				out.push_back(RepeatedValue);
+				continue;
+			}
+
+			const unsigned leading = __builtin_clzll(x) / 8;
+			const unsigned trailing = __builtin_ctzll(x) / 8;
+			out.push_back((uint8_t)((leading << 4) | trailing));
+
+			uint64_t meaningful = x >> (trailing * 8);
+			for(unsigned i = 0; i < 8 - leading - trailing; ++i)
+			{
+				out.push_back((uint8_t)(meaningful & 0xFF));
+				meaningful >>= 8;
+			}
+		}
+	}
+
+	bool decode_column(const std::vector<uint8_t>& in, uint32_t count, std::vector<double>& out)
+	{
+		uint64_t previous = 0;
+		size_t pos = 0;
+		for(uint32_t n = 0; n < count; ++n)
+		{
+			if(pos >= in.size())
+			{
+				return false;
+			}
+
+			const uint8_t control = in[pos++];
+			if(control != RepeatedValue)
+			{
+				const unsigned leading = control >> 4;
+				const unsigned trailing = control & 0xF;
+				const unsigned length = 8 - leading - trailing;
+				if(leading + trailing >= 8 || pos + length > in.size())
+				{
+					return false;
+				}
+
+				uint64_t x = 0;
+				for(unsigned i = 0; i < length; ++i)
+				{
+					x |= (uint64_t)in[pos++] << (8 * i);
+				}
+				previous ^= x << (trailing * 8);
+			}
+			out.push_back(from_bits(previous));
+		}
+		return true;
+	}
+
+	bool write_u32(FILE* file, uint32_t value)
+	{
+		return fwrite(&value, sizeof(value), 1, file) == 1;
+	}
+
+	bool read_u32(FILE* file, uint32_t& value)
+	{
+		return fread(&value, sizeof(value), 1, file) == 1;
+	}
+}
+
+Recorder::Recorder()
+	: file_(nullptr)
+	, chunk_samples_(0)
+	, stride_(0)
+	, ring_mask_(0)
+	, head_(0)
+	, tail_(0)
+	, dropped_(0)
+	, running_(false)
+	, write_failed_(false)
+{
+}
+
+Recorder::~Recorder()
+{
+	close();
+}
+
+bool Recorder::open(const std::string& filename, uint32_t channel_mask, uint32_t chunk_samples, uint32_t ring_samples)
+{
+	close();
+
+	if(chunk_samples == 0 || ring_samples == 0 || (ring_samples & (ring_samples - 1)) != 0)
+	{
+		return false;
+	}
+
+	file_ = fopen(filename.c_str(), "wb");
+	if(!file_)
+	{
+		return false;
+	}
+
+	channel_mask &= (1u << Channel_Count) - 1;
+	channels_.clear();
+	for(uint8_t c = 0; c < Channel_Count; ++c)
+	{
+		if(channel_mask & (1u << c))
+		{
+			channels_.push_back(c);
+		}
+	}
+
+	if(!write_u32(file_, Magic) || !write_u32(file_, Version) ||
+		!write_u32(file_, channel_mask) || !write_u32(file_, chunk_samples))
+	{
+		fclose(file_);
+		file_ = nullptr;
+		return false;
+	}
+
+	chunk_samples_ = chunk_samples;
+	stride_ = (uint32_t)channels_.size() + 1;
+	ring_.assign((size_t)ring_samples * stride_, 0.0);
+	ring_mask_ = ring_samples - 1;
+	head_.store(0, std::memory_order_relaxed);
+	tail_.store(0, std::memory_order_relaxed);
+	dropped_.store(0, std::memory_order_relaxed);
+	write_failed_ = false;
+
+	columns_.assign(stride_, std::vector<double>());
+	for(std::vector<double>& column : columns_)
+	{
+		column.reserve(chunk_samples);
+	}
+
+	running_ = true;
+	writer_ = std::thread(&Recorder::writer_main, this);
+	return true;
+}
+
+bool Recorder::close()
+{
+	if(!file_)
+	{
+		return true;
+	}
+
+	running_ = false;
+	writer_.join();
+
+	const bool ok = fclose(file_) == 0 && !write_failed_;
+	file_ = nullptr;
+	return ok;
+}
+
+void Recorder::record(double time, const Core& core)
+{
+	if(!file_)
+	{
+		return;
+	}
+
+	const uint32_t head = head_.load(std::memory_order_relaxed);
+	if(head - tail_.load(std::memory_order_acquire) > ring_mask_)
+	{
+		dropped_.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	double all[Channel_Count];
+	const Core::State state = core.get_state();
+	const Core::Outputs outputs = core.get_outputs();
+	const Core::Inputs inputs = core.get_inputs();
+	memcpy(all + Channel_N, &state, sizeof(state));
+	memcpy(all + Channel_Wr, &outputs, sizeof(outputs));
+	memcpy(all + Channel_RodPosition, &inputs, sizeof(inputs));
+
+	double* slot = &ring_[(size_t)(head & ring_mask_) * stride_];
+	slot[0] = time;
+	for(size_t c = 0; c < channels_.size(); ++c)
+	{
+		slot[c + 1] = all[channels_[c]];
+	}
+
+	head_.store(head + 1, std::memory_order_release);
+}
+
+void Recorder::writer_main()
+{
+	while(running_)
+	{
+		const uint32_t tail = tail_.load(std::memory_order_relaxed);
+		drain();
+		if(tail == tail_.load(std::memory_order_relaxed))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	// the producer has stopped, pick up whatever it left behind
+	drain();
+	if(!columns_[0].empty())
+	{
+		write_chunk();
+	}
+	if(fflush(file_) != 0)
+	{
+		write_failed_ = true;
+	}
+}
+
+void Recorder::drain()
+{
+	uint32_t tail = tail_.load(std::memory_order_relaxed);
+	const uint32_t head = head_.load(std::memory_order_acquire);
+	while(tail != head)
+	{
+		const double* slot = &ring_[(size_t)(tail & ring_mask_) * stride_];
+		for(uint32_t c = 0; c < stride_; ++c)
+		{
+			columns_[c].push_back(slot[c]);
+		}
+		++tail;
+
+		if(columns_[0].size() == chunk_samples_)
+		{
+			tail_.store(tail, std::memory_order_release);
+			write_chunk();
+		}
+	}
+	tail_.store(tail, std::memory_order_release);
+}
+
+void Recorder::write_chunk()
+{
+	// once a write has failed the file is cut short, the rest is only
+	// drained so the ring keeps moving
+	if(write_failed_)
+	{
+		for(std::vector<double>& column : columns_)
+		{
+			column.clear();
+		}
+		return;
+	}
+
+	std::vector<uint8_t> encoded;
+	encoded.reserve(columns_[0].size() * sizeof(double));
+
+	bool ok = write_u32(file_, (uint32_t)columns_[0].size());
+	for(std::vector<double>& column : columns_)
+	{
+		encode_column(column, encoded);
+		ok = ok && write_u32(file_, (uint32_t)encoded.size()) &&
+			fwrite(encoded.data(), 1, encoded.size(), file_) == encoded.size();
+		column.clear();
+	}
+	write_failed_ = !ok;
+}
+
+bool Recorder::read_channel(const std::string& filename, Channel channel, std::vector<double>& values)
+{
+	FILE* file = fopen(filename.c_str(), "rb");
+	if(!file)
+	{
+		return false;
+	}
+
+	// column sizes are checked against what is left before allocating
+	long file_size = -1;
+	if(fseek(file, 0, SEEK_END) == 0)
+	{
+		file_size = ftell(file);
+	}
+
+	uint32_t magic, version, channel_mask, chunk_samples;
+	bool ok = file_size >= 0 && fseek(file, 0, SEEK_SET) == 0 && read_u32(file, magic) && read_u32(file, version) && read_u32(file, channel_mask) && read_u32(file, chunk_samples);
+	ok = ok && magic == Magic && version == Version;
+
+	// column 0 holds the time, then one per recorded channel
+	uint32_t column = 0;
+	uint32_t column_count = 1;
+	for(uint32_t c = 0; c < Channel_Count; ++c)
+	{
+		if(channel_mask & (1u << c))
+		{
+			if(c < (uint32_t)channel)
+			{
+				++column;
+			}
+			++column_count;
+		}
+	}
+	if(channel == Channel_Count)
+	{
+		column = 0;
+	}
+	else
+	{
+		++column;
+		ok = ok && (channel_mask & (1u << channel));
+	}
+
+	values.clear();
+	std::vector<uint8_t> encoded;
+	uint32_t count;
+	while(ok && read_u32(file, count))
+	{
+		for(uint32_t c = 0; ok && c < column_count; ++c)
+		{
+			uint32_t size;
+			ok = read_u32(file, size);
+			const long at = ok ? ftell(file) : -1;
+			ok = ok && at >= 0 && size <= (uint64_t)(file_size - at);
+			if(ok && c == column)
+			{
+				encoded.resize(size);
+				ok = fread(encoded.data(), 1, size, file) == size && decode_column(encoded, count, values);
+			}
+			else if(ok)
+			{
+				ok = fseek(file, size, SEEK_CUR) == 0;
+			}
+		}
+	}
+
+	fclose(file);
+	return ok;
+}
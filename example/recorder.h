@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core.h"
+
+// Records chosen Core channels to a columnar binary file.
+//
+// record() only copies the sample into a single producer / single consumer
+// ring buffer, so it is cheap enough to call every step from the simulation
+// thread. A background thread drains the ring into per channel columns and
+// writes them out in chunks, each column XOR compressed against its previous
+// value. If the writer falls behind, samples are dropped rather than
+// stalling the simulation; get_dropped() reports how many. A write that
+// fails, e.g. on a full disk, is reported by close().
+//
+// File layout (little endian):
+//   header: uint32 magic "CREC", uint32 version, uint32 channel mask,
+//           uint32 samples per chunk
+//   chunk:  uint32 sample count, then for the time column and each recorded
+//           channel in Channel order: uint32 byte count, compressed bytes
+class Recorder
+{
+public:
+	static constexpr uint32_t Magic = 0x43455243; // "CREC"
+	static constexpr uint32_t Version = 1;
+
+	// Channel numbers follow the field order of Core::State, Core::Outputs
+	// and Core::Inputs
+	enum Channel
+	{
+		Channel_N,
+		Channel_Mpc,
+		Channel_Tpc,
+		Channel_Tpr,
+		Channel_Msg,
+		Channel_Tsg,
+		Channel_Tw,
+
+		Channel_Wr,
+		Channel_Mpr,
+		Channel_Ppr,
+		Channel_Lpr,
+		Channel_Psg,
+		Channel_Tout,
+
+		Channel_RodPosition,
+		Channel_Min,
+		Channel_WheatPR,
+		Channel_Msgin,
+		Channel_MrIn,
+
+		Channel_Count
+	};
+
+	static constexpr uint32_t channel_bit(Channel channel)
+	{
+		return 1u << channel;
+	}
+
+	Recorder();
+	~Recorder();
+
+	Recorder(const Recorder&) = delete;
+	Recorder& operator=(const Recorder&) = delete;
+
+	// Starts recording the channels in channel_mask to filename. The ring
+	// holds ring_samples samples and must be a power of two.
+	bool open(const std::string& filename, uint32_t channel_mask, uint32_t chunk_samples = 4096, uint32_t ring_samples = 1 << 14);
+
+	// Flushes everything recorded so far and stops the writer thread.
+	// Returns false if any of the recording could not be written.
+	bool close();
+
+	inline bool is_open() const
+	{
+		return file_ != nullptr;
+	}
+
+	// Called from the simulation thread, never blocks
+	void record(double time, const Core& core);
+
+	inline uint64_t get_dropped() const
+	{
+		return dropped_.load(std::memory_order_relaxed);
+	}
+
+	// Reads back one column of a recording; pass Channel_Count for the time
+	// column. Returns false if the file is not a recording or the channel
+	// was not recorded.
+	static bool read_channel(const std::string& filename, Channel channel, std::vector<double>& values);
+
+private:
+	FILE* file_;
+	uint32_t chunk_samples_;
+
+	// indices into the flattened State/Outputs/Inputs of each recorded
+	// channel, and the number of doubles per ring entry (time included)
+	std::vector<uint8_t> channels_;
+	uint32_t stride_;
+
+	std::vector<double> ring_;
+	uint32_t ring_mask_;
+	alignas(64) std::atomic<uint32_t> head_;
+	alignas(64) std::atomic<uint32_t> tail_;
+	alignas(64) std::atomic<uint64_t> dropped_;
+
+	std::atomic_bool running_;
+	std::thread writer_;
+
+	// owned by the writer thread, read once it has been joined
+	std::vector<std::vector<double>> columns_;
+	bool write_failed_;
+
+	void writer_main();
+	void drain();
+	void write_chunk();
+};
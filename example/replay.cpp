@@ -0,0 +1,254 @@
+#include "replay.h"
+
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+	constexpr unsigned InputFieldCount = sizeof(Core::Inputs) / sizeof(double);
+	static_assert(sizeof(Core::Inputs) == InputFieldCount * sizeof(double), "Core::Inputs must only hold doubles");
+	static_assert(InputFieldCount <= 8, "InputTimeline stores the changed fields in one byte");
+
+	inline const double* fields(const Core::Inputs& inputs)
+	{
+		return (const double*)&inputs;
+	}
+
+	inline double* fields(Core::Inputs& inputs)
+	{
+		return (double*)&inputs;
+	}
+
+	void write_varint(std::vector<uint8_t>& out, uint64_t value)
+	{
+		while(value >= 0x80)
+		{
+			out.push_back((uint8_t)(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back((uint8_t)value);
+	}
+
+	uint64_t read_varint(const std::vector<uint8_t>& in, size_t& pos)
+	{
+		uint64_t value = 0;
+		unsigned shift = 0;
+		// a uint64_t takes at most ten bytes, stop a corrupt run of
+		// continuation bytes from shifting past the width
+		while(pos < in.size() && shift < 64)
+		{
+			uint8_t byte = in[pos++];
+			value |= (uint64_t)(byte & 0x7F) << shift;
+			if(!(byte & 0x80))
+			{
+				break;
+			}
+			shift += 7;
+		}
+		return value;
+	}
+}
+
+InputTimeline::InputTimeline()
+	: last_step_(0)
+	, event_count_(0)
+{
+	start_ = Core().get_snapshot();
+}
+
+void InputTimeline::begin(const Core& core)
+{
+	start_ = core.get_snapshot();
+	last_step_ = core.get_step_count();
+	event_count_ = 0;
+	events_.clear();
+}
+
+void InputTimeline::record(const Core& core, const Core::Inputs& inputs)
+{
+	const Core::Inputs current = core.get_inputs();
+
+	// compare bit patterns so -0.0 and NaN payloads replay exactly
+	uint8_t mask = 0;
+	for(unsigned i = 0; i < InputFieldCount; ++i)
+	{
+		if(memcmp(fields(current) + i, fields(inputs) + i, sizeof(double)) != 0)
+		{
+			mask |= (uint8_t)(1u << i);
+		}
+	}
+
+	if(!mask)
+	{
+		return;
+	}
+
+	const uint64_t step = core.get_step_count();
+	write_varint(events_, step - last_step_);
+	last_step_ = step;
+
+	events_.push_back(mask);
+	for(unsigned i = 0; i < InputFieldCount; ++i)
+	{
+		if(mask & (1u << i))
+		{
+			const uint8_t* bytes = (const uint8_t*)(fields(inputs) + i);
+			events_.insert(events_.end(), bytes, bytes + sizeof(double));
+		}
+	}
+	++event_count_;
+}
+
+bool InputTimeline::save(const std::string& filename) const
+{
+	FILE* file = fopen(filename.c_str(), "wb");
+	if(!file)
+	{
+		return false;
+	}
+
+	const uint32_t header[2] = { Magic, Version };
+	const uint64_t sizes[2] = { event_count_, events_.size() };
+	bool ok = fwrite(header, sizeof(header), 1, file) == 1
+		&& fwrite(sizes, sizeof(sizes), 1, file) == 1
+		&& fwrite(&start_, sizeof(start_), 1, file) == 1
+		&& fwrite(events_.data(), 1, events_.size(), file) == events_.size();
+
+	return (fclose(file) == 0) && ok;
+}
+
+bool InputTimeline::load(const std::string& filename)
+{
+	FILE* file = fopen(filename.c_str(), "rb");
+	if(!file)
+	{
+		return false;
+	}
+
+	uint32_t header[2];
+	uint64_t sizes[2];
+	Core::Snapshot start;
+	bool ok = fread(header, sizeof(header), 1, file) == 1
+		&& header[0] == Magic && header[1] == Version
+		&& fread(sizes, sizeof(sizes), 1, file) == 1
+		&& fread(&start, sizeof(start), 1, file) == 1;
+
+	// the event bytes are the rest of the file, so a corrupt size fails
+	// here rather than in the allocation
+	long offset = ok ? ftell(file) : -1;
+	ok = ok && offset >= 0 && fseek(file, 0, SEEK_END) == 0;
+	long length = ok ? ftell(file) : -1;
+	ok = ok && length >= offset && sizes[1] == (uint64_t)(length - offset)
+		&& fseek(file, offset, SEEK_SET) == 0;
+
+	std::vector<uint8_t> events;
+	if(ok)
+	{
+		events.resize(sizes[1]);
+		ok = fread(events.data(), 1, events.size(), file) == events.size();
+	}
+	fclose(file);
+
+	if(!ok || !Core().restore_snapshot(start))
+	{
+		return false;
+	}
+
+	// walk the events to check they are whole and find where recording
+	// would resume
+	uint64_t last_step = start.step_count;
+	uint64_t count = 0;
+	size_t pos = 0;
+	while(pos < events.size())
+	{
+		last_step += read_varint(events, pos);
+		if(pos >= events.size())
+		{
+			return false;
+		}
+		// the replay only reads the known fields, a mask naming others
+		// would desync it from the bytes that follow
+		uint8_t mask = events[pos++];
+		if(!mask || (mask >> InputFieldCount))
+		{
+			return false;
+		}
+		pos += sizeof(double) * __builtin_popcount(mask);
+		++count;
+	}
+	if(pos != events.size() || count != sizes[0])
+	{
+		return false;
+	}
+
+	start_ = start;
+	last_step_ = last_step;
+	event_count_ = sizes[0];
+	events_.swap(events);
+	return true;
+}
+
+InputReplay::InputReplay(const InputTimeline& timeline)
+	: timeline_(timeline)
+	, pos_(0)
+	, next_step_(0)
+	, have_next_(false)
+{
+}
+
+bool InputReplay::start(Core& core)
+{
+	if(!core.restore_snapshot(timeline_.start_))
+	{
+		return false;
+	}
+
+	rewind();
+	return true;
+}
+
+void InputReplay::rewind()
+{
+	pos_ = 0;
+	next_step_ = timeline_.start_.step_count;
+	read_step();
+}
+
+void InputReplay::read_step()
+{
+	have_next_ = pos_ < timeline_.events_.size();
+	if(have_next_)
+	{
+		next_step_ += read_varint(timeline_.events_, pos_);
+	}
+}
+
+void InputReplay::apply_pending(Core& core)
+{
+	const std::vector<uint8_t>& events = timeline_.events_;
+	while(have_next_ && next_step_ <= core.get_step_count())
+	{
+		Core::Inputs inputs = core.get_inputs();
+		const uint8_t mask = events[pos_++];
+		for(unsigned i = 0; i < InputFieldCount; ++i)
+		{
+			if(mask & (1u << i))
+			{
+				memcpy(fields(inputs) + i, &events[pos_], sizeof(double));
+				pos_ += sizeof(double);
+			}
+		}
+		core.set_inputs(inputs);
+
+		read_step();
+	}
+}
+
+void InputReplay::run(Core& core, uint64_t steps)
+{
+	for(uint64_t s = 0; s < steps; ++s)
+	{
+		apply_pending(core);
+		core.step();
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "core.h"
+
+// A recorded operator session: the snapshot of the core it started from
+// plus every change made to its inputs, keyed on the step count at which
+// the change was made.
+//
+// Each event stores only the fields that changed: a varint step delta, a
+// byte with one bit per Core::Inputs field, then the new value of each
+// field whose bit is set.
+class InputTimeline
+{
+public:
+	static constexpr uint32_t Magic = 0x504e4943; // "CINP"
+	static constexpr uint32_t Version = 2;
+
+	InputTimeline();
+
+	// Starts a new, empty timeline from the core's current snapshot
+	void begin(const Core& core);
+
+	// Records the fields of inputs that differ from the core's current
+	// inputs. Call it right before core.set_inputs(inputs).
+	void record(const Core& core, const Core::Inputs& inputs);
+
+	inline const Core::Snapshot& get_start() const
+	{
+		return start_;
+	}
+
+	inline uint64_t get_event_count() const
+	{
+		return event_count_;
+	}
+
+	inline size_t get_encoded_size() const
+	{
+		return events_.size();
+	}
+
+	bool save(const std::string& filename) const;
+	bool load(const std::string& filename);
+
+private:
+	friend class InputReplay;
+
+	Core::Snapshot start_;
+	uint64_t last_step_;
+	uint64_t event_count_;
+	std::vector<uint8_t> events_;
+};
+
+// Drives a core from an InputTimeline, applying every recorded change at
+// the same step boundary it was recorded at, so a replayed run matches the
+// original bit for bit.
+class InputReplay
+{
+public:
+	explicit InputReplay(const InputTimeline& timeline);
+
+	// Restores the timeline's starting snapshot into core and rewinds
+	bool start(Core& core);
+
+	// Goes back to the first event without touching any core
+	void rewind();
+
+	// Applies every change recorded at or before the core's current step
+	void apply_pending(Core& core);
+
+	// Applies pending changes and steps the core, steps times
+	void run(Core& core, uint64_t steps);
+
+	inline bool is_finished() const
+	{
+		return !have_next_;
+	}
+
+private:
+	const InputTimeline& timeline_;
+	size_t pos_;
+	uint64_t next_step_;
+	bool have_next_;
+
+	void read_step();
+};
@@ -0,0 +1,481 @@
+// Runs the reactor model as fast as the cpu allows, with no window or
+// renderer, and reports the simulation rate and the final state.
+//
+// usage: sim_headless [options]
+//   --duration <s>      plant time to simulate (default 3600)
+//   --step <s>          step size (default 1/60)
+//   --integrator <name> euler, exp-euler or rosenbrock (default euler)
+//   --substeps <n>      flux substeps per thermal step (default 1)
+//   --instances <n>     independent cores to run (default 1)
+//   --threads <n>       scheduler threads (default: one per cpu)
+//   --load-snapshot <f> start every core from a saved snapshot
+//   --replay <f>        start every core from a recorded input timeline and
+//                       feed it the recorded input changes
+//   --steady            start from the steady state for the starting inputs
+//   --adaptive <tol>    lengthen the step while the plant is settled, keeping
+//                       the step doubling error under tol; advances a second
+//                       of plant time at a time, so cannot be used with
+//                       --replay or --sweep. Needs exp-euler or rosenbrock,
+//                       forward Euler has to keep its steps short anyway
+//   --save-snapshot <f> save the first core when the run finishes
+//   --record <f>        record every channel of the first core at every step
+//   --publish <name>    publish the first core's state to shared memory at
+//                       every step, for state_viewer and the like; fails if
+//                       the name is in use
+//   --publish-replace <name>
+//                       the same, taking the name over from a publisher that
+//                       did not clean up, or from a running one
+//   --sweep <spec>      sweep a plant parameter, as name=first:last:count, e.g.
+//                       Cpsi=1e7:2e7:16; repeat for more axes. Runs one core per
+//                       combination instead of --instances copies.
+//   --table <f>         write the sweep's results to a csv file
+//
+// When starting from a snapshot or a timeline, the step, integrator and
+// substep options only override the stored settings if given.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "scheduler.h"
+
+#include "core.h"
+#include "ensemble.h"
+#include "publisher.h"
+#include "recorder.h"
+#include "replay.h"
+
+namespace
+{
+	struct Options
+	{
+		double duration;
+		double step;
+		Core::Integrator integrator;
+		unsigned substeps;
+		unsigned instances;
+		int threads;
+		bool integrator_set;
+		bool steady;
+		double adaptive;
+		const char* load_snapshot;
+		const char* replay;
+		const char* save_snapshot;
+		const char* record;
+		const char* publish;
+		bool publish_replace;
+		std::vector<Ensemble::Axis> sweep;
+		const char* table;
+	};
+
+	void usage()
+	{
+		fprintf(stderr,
+			"usage: sim_headless [--duration s] [--step s] [--integrator euler|exp-euler|rosenbrock]\n"
+			"                    [--substeps n] [--instances n] [--threads n]\n"
+			"                    [--load-snapshot file] [--replay file] [--steady] [--adaptive tol]\n"
+			"                    [--save-snapshot file]\n"
+			"                    [--record file] [--publish[-replace] name] [--sweep name=first:last:count]... [--table file]\n");
+	}
+
+	bool parse_integrator(const char* name, Core::Integrator& integrator)
+	{
+		if(strcmp(name, "euler") == 0)
+		{
+			integrator = Core::Integrator_Euler;
+		}
+		else if(strcmp(name, "exp-euler") == 0)
+		{
+			integrator = Core::Integrator_ExponentialEuler;
+		}
+		else if(strcmp(name, "rosenbrock") == 0)
+		{
+			integrator = Core::Integrator_Rosenbrock;
+		}
+		else
+		{
+			return false;
+		}
+		return true;
+	}
+
+	bool parse_options(int argc, char** argv, Options& options)
+	{
+		options.duration   = 3600.0;
+		options.step       = 0.0;
+		options.integrator = Core::Integrator_Euler;
+		options.substeps   = 0;
+		options.instances  = 1;
+		options.threads    = SCHED_DEFAULT;
+		options.integrator_set = false;
+		options.steady = false;
+		options.adaptive = 0.0;
+		options.load_snapshot = nullptr;
+		options.replay = nullptr;
+		options.save_snapshot = nullptr;
+		options.record = nullptr;
+		options.publish = nullptr;
+		options.publish_replace = false;
+		options.table = nullptr;
+
+		for(int i = 1; i < argc; ++i)
+		{
+			// the only option without a value
+			if(strcmp(argv[i], "--steady") == 0)
+			{
+				options.steady = true;
+				continue;
+			}
+
+			if(i + 1 >= argc)
+			{
+				return false;
+			}
+
+			const char* value = argv[i + 1];
+			if(strcmp(argv[i], "--duration") == 0)
+			{
+				options.duration = atof(value);
+			}
+			else if(strcmp(argv[i], "--step") == 0)
+			{
+				options.step = atof(value);
+			}
+			else if(strcmp(argv[i], "--integrator") == 0)
+			{
+				if(!parse_integrator(value, options.integrator))
+				{
+					return false;
+				}
+				options.integrator_set = true;
+			}
+			else if(strcmp(argv[i], "--substeps") == 0)
+			{
+				options.substeps = (unsigned)atoi(value);
+			}
+			else if(strcmp(argv[i], "--instances") == 0)
+			{
+				options.instances = (unsigned)atoi(value);
+			}
+			else if(strcmp(argv[i], "--threads") == 0)
+			{
+				options.threads = atoi(value);
+			}
+			else if(strcmp(argv[i], "--adaptive") == 0)
+			{
+				options.adaptive = atof(value);
+				if(options.adaptive <= 0.0)
+				{
+					return false;
+				}
+			}
+			else if(strcmp(argv[i], "--load-snapshot") == 0)
+			{
+				options.load_snapshot = value;
+			}
+			else if(strcmp(argv[i], "--replay") == 0)
+			{
+				options.replay = value;
+			}
+			else if(strcmp(argv[i], "--save-snapshot") == 0)
+			{
+				options.save_snapshot = value;
+			}
+			else if(strcmp(argv[i], "--record") == 0)
+			{
+				options.record = value;
+			}
+			else if(strcmp(argv[i], "--publish") == 0 || strcmp(argv[i], "--publish-replace") == 0)
+			{
+				options.publish = value;
+				options.publish_replace = (strcmp(argv[i], "--publish-replace") == 0);
+			}
+			else if(strcmp(argv[i], "--sweep") == 0)
+			{
+				Ensemble::Axis axis;
+				if(!Ensemble::parse_axis(value, axis))
+				{
+					return false;
+				}
+				options.sweep.push_back(axis);
+			}
+			else if(strcmp(argv[i], "--table") == 0)
+			{
+				options.table = value;
+			}
+			else
+			{
+				return false;
+			}
+			++i;
+		}
+
+		return options.duration > 0.0 && options.step >= 0.0 && options.instances > 0 && options.threads != 0
+			&& !(options.load_snapshot && options.replay)
+			&& !(options.adaptive > 0.0 && (options.replay || !options.sweep.empty()));
+	}
+
+	struct RunArgs
+	{
+		Core* cores;
+		unsigned long long steps;
+		// whole seconds to simulate() instead of steps, in adaptive mode
+		unsigned long long seconds;
+		Recorder* recorder;
+		StatePublisher* publisher;
+		const InputTimeline* timeline;
+	};
+
+	void run_cores(void* pArg, struct scheduler*, sched_uint begin, sched_uint end, sched_uint)
+	{
+		RunArgs* args = (RunArgs*)pArg;
+		for(sched_uint i = begin; i < end; ++i)
+		{
+			Core& core = args->cores[i];
+			Recorder* recorder = (i == 0) ? args->recorder : nullptr;
+			StatePublisher* publisher = (i == 0) ? args->publisher : nullptr;
+
+			if(core.get_adaptive())
+			{
+				for(unsigned long long s = 0; s < args->seconds; ++s)
+				{
+					core.simulate(1.0);
+					if(recorder)
+					{
+						recorder->record(s + 1.0, core);
+					}
+					if(publisher)
+					{
+						publisher->publish(s + 1.0, core);
+					}
+				}
+				continue;
+			}
+
+			InputReplay replay(*args->timeline);
+			replay.rewind();
+
+			for(unsigned long long s = 0; s < args->steps; ++s)
+			{
+				replay.apply_pending(core);
+				core.step();
+				if(recorder)
+				{
+					recorder->record((s + 1) * core.get_timestep(), core);
+				}
+				if(publisher)
+				{
+					publisher->publish((s + 1) * core.get_timestep(), core);
+				}
+			}
+		}
+	}
+
+	int run_sweep(const Options& options, const Core& initial, struct scheduler* sched, void* memory)
+	{
+		Ensemble ensemble;
+		for(const Ensemble::Axis& axis : options.sweep)
+		{
+			ensemble.add_axis(axis);
+		}
+		ensemble.set_start(initial.get_snapshot());
+
+		auto start = std::chrono::steady_clock::now();
+		ensemble.run(options.duration, sched);
+		double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		scheduler_stop(sched);
+		free(memory);
+
+		const std::vector<Ensemble::Result>& results = ensemble.get_results();
+		printf("swept %zu runs of %.3f s of plant time in %.3f s, %.1f runs/s\n",
+			results.size(), options.duration, wall, results.size() / wall);
+
+		size_t peak = 0;
+		for(size_t run = 1; run < results.size(); ++run)
+		{
+			if(results[run].peak_flux > results[peak].peak_flux)
+			{
+				peak = run;
+			}
+		}
+		printf("highest peak flux %.17g at %.3f s, with", results[peak].peak_flux, results[peak].peak_time);
+		for(size_t a = 0; a < ensemble.get_axes().size(); ++a)
+		{
+			printf(" %s=%.9g", Ensemble::parameter_name(ensemble.get_axes()[a].parameter), ensemble.get_axis_value(peak, a));
+		}
+		printf("\n");
+
+		if(options.table && !ensemble.write_table(options.table))
+		{
+			fprintf(stderr, "unable to write table '%s'\n", options.table);
+			return 1;
+		}
+		return 0;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if(!parse_options(argc, argv, options))
+	{
+		usage();
+		return 1;
+	}
+
+	Core initial;
+	if(options.load_snapshot && !initial.load_snapshot(options.load_snapshot))
+	{
+		fprintf(stderr, "unable to load snapshot '%s'\n", options.load_snapshot);
+		return 1;
+	}
+
+	// without --replay the timeline is empty and the replay does nothing
+	InputTimeline timeline;
+	timeline.begin(initial);
+	if(options.replay && !(timeline.load(options.replay) && InputReplay(timeline).start(initial)))
+	{
+		fprintf(stderr, "unable to load input timeline '%s'\n", options.replay);
+		return 1;
+	}
+
+	Core::State steady;
+	if(options.steady)
+	{
+		if(!initial.solve_steady_state(initial.get_inputs(), steady))
+		{
+			fprintf(stderr, "no steady state for the starting inputs\n");
+			return 1;
+		}
+		initial.set_state(steady);
+	}
+
+	if(options.integrator_set)
+	{
+		initial.set_integrator(options.integrator);
+	}
+	if(options.step > 0.0)
+	{
+		initial.set_timestep(options.step);
+	}
+	if(options.substeps > 0)
+	{
+		initial.set_neutronics_substeps(options.substeps);
+	}
+	if(options.adaptive > 0.0)
+	{
+		initial.set_adaptive(true);
+		initial.set_adaptive_tolerance(options.adaptive);
+	}
+
+	// a snapshot or timeline may bring adaptive mode with it
+	if(initial.get_adaptive() && initial.get_integrator() == Core::Integrator_Euler)
+	{
+		fprintf(stderr, "adaptive stepping needs --integrator exp-euler or rosenbrock\n");
+		return 1;
+	}
+	if(initial.get_adaptive() && (options.replay || !options.sweep.empty()))
+	{
+		fprintf(stderr, "adaptive stepping cannot be used with --replay or --sweep\n");
+		return 1;
+	}
+
+	sched_size needed_memory;
+	struct scheduler sched;
+	scheduler_init(&sched, &needed_memory, options.threads, 0);
+	void* memory = calloc(needed_memory, 1);
+	scheduler_start(&sched, memory);
+
+	if(!options.sweep.empty())
+	{
+		return run_sweep(options, initial, &sched, memory);
+	}
+
+	std::vector<Core> cores(options.instances, initial);
+
+	// step whole steps rather than going through the accumulator so the
+	// plant time covered is exact
+	RunArgs args;
+	args.cores = cores.data();
+	args.steps = (unsigned long long)std::llround(options.duration / initial.get_timestep());
+	args.seconds = (unsigned long long)std::llround(options.duration);
+	args.recorder = nullptr;
+	args.publisher = nullptr;
+	args.timeline = &timeline;
+
+	Recorder recorder;
+	if(options.record)
+	{
+		if(!recorder.open(options.record, (1u << Recorder::Channel_Count) - 1))
+		{
+			fprintf(stderr, "unable to record to '%s'\n", options.record);
+			return 1;
+		}
+		args.recorder = &recorder;
+	}
+
+	StatePublisher publisher;
+	if(options.publish)
+	{
+		if(!publisher.open(options.publish, 256, options.publish_replace))
+		{
+			fprintf(stderr, "unable to publish to '%s'%s\n", options.publish,
+				options.publish_replace ? "" : ", it may be in use (see --publish-replace)");
+			return 1;
+		}
+		args.publisher = &publisher;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	struct sched_task task;
+	scheduler_add(&task, &sched, run_cores, &args, (sched_uint)cores.size());
+	scheduler_join(&sched, &task);
+	double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	scheduler_stop(&sched);
+	free(memory);
+
+	if(options.record)
+	{
+		if(!recorder.close())
+		{
+			fprintf(stderr, "unable to write the recording to '%s'\n", options.record);
+			return 1;
+		}
+		if(recorder.get_dropped())
+		{
+			printf("recorder dropped %llu samples\n", (unsigned long long)recorder.get_dropped());
+		}
+	}
+
+	if(options.save_snapshot && !cores[0].save_snapshot(options.save_snapshot))
+	{
+		fprintf(stderr, "unable to save snapshot '%s'\n", options.save_snapshot);
+		return 1;
+	}
+
+	double steps = 0.0;
+	for(const Core& core : cores)
+	{
+		steps += (double)(core.get_step_count() - initial.get_step_count());
+	}
+	const double plant_time = initial.get_adaptive() ? (double)args.seconds : args.steps * initial.get_timestep();
+	printf("simulated %.3f s of plant time on %u core(s) in %.3f s\n", plant_time, options.instances, wall);
+	printf("%.0f steps/s, %.1fx real time\n", steps / wall, plant_time / wall);
+
+	const Core::Inputs inputs = cores[0].get_inputs();
+	const Core::State state = cores[0].get_state();
+	const Core::Outputs outputs = cores[0].get_outputs();
+	printf("final state:\n");
+	printf("  N   %.17g\n  Mpc %.17g\n  Tpc %.17g\n  Tpr %.17g\n  Msg %.17g\n  Tsg %.17g\n  Tw  %.17g\n",
+		state.N, state.Mpc, state.Tpc, state.Tpr, state.Msg, state.Tsg, state.Tw);
+	printf("  RodPosition %.17g\n", inputs.RodPosition);
+	printf("  Wr  %.17g\n  Mpr %.17g\n  Ppr %.17g\n  Lpr %.17g\n  Psg %.17g\n  Tout %.17g\n",
+		outputs.Wr, outputs.Mpr, outputs.Ppr, outputs.Lpr, outputs.Psg, outputs.Tout);
+
+	return 0;
+}
@@ -0,0 +1,105 @@
+// Hosts independent reactor sessions for clients on a Unix domain socket,
+// e.g. one per trainee station of a classroom. See simprotocol.h for the
+// protocol and SimClient in simserver.h for a client.
+//
+// usage: sim_server [options]
+//   --socket <path>     socket to listen on (default /tmp/nuke-sim.sock)
+//   --threads <n>       scheduler threads (default: one per cpu)
+//
+// Runs until interrupted.
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "scheduler.h"
+
+#include "simserver.h"
+
+namespace
+{
+	struct Options
+	{
+		const char* socket;
+		int threads;
+	};
+
+	SimServer* running_server = nullptr;
+
+	void usage()
+	{
+		fprintf(stderr, "usage: sim_server [--socket path] [--threads n]\n");
+	}
+
+	bool parse_options(int argc, char** argv, Options& options)
+	{
+		options.socket  = "/tmp/nuke-sim.sock";
+		options.threads = SCHED_DEFAULT;
+
+		for(int i = 1; i + 1 < argc; i += 2)
+		{
+			const char* value = argv[i + 1];
+			if(strcmp(argv[i], "--socket") == 0)
+			{
+				options.socket = value;
+			}
+			else if(strcmp(argv[i], "--threads") == 0)
+			{
+				options.threads = atoi(value);
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return argc % 2 == 1 && options.threads != 0;
+	}
+
+	void on_signal(int)
+	{
+		if(running_server)
+		{
+			running_server->stop();
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if(!parse_options(argc, argv, options))
+	{
+		usage();
+		return 1;
+	}
+
+	SimServer server;
+	if(!server.open(options.socket))
+	{
+		fprintf(stderr, "unable to listen on '%s'\n", options.socket);
+		return 1;
+	}
+
+	running_server = &server;
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+
+	sched_size needed_memory;
+	struct scheduler sched;
+	scheduler_init(&sched, &needed_memory, options.threads, 0);
+	void* memory = calloc(needed_memory, 1);
+	scheduler_start(&sched, memory);
+
+	printf("listening on %s\n", options.socket);
+	fflush(stdout);
+	server.run(&sched);
+
+	scheduler_stop(&sched);
+	free(memory);
+	server.close();
+
+	printf("served %llu requests, %zu sessions still open\n",
+		(unsigned long long)server.get_requests(), server.get_session_count());
+	return 0;
+}
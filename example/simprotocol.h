@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "core.h"
+
+// The wire format between SimServer and SimClient, over a Unix domain
+// stream socket. Everything is native endian; both ends share a machine.
+//
+// A client sends batches and the server answers each with one response
+// batch, in order:
+//   batch:    uint32 byte count of the rest, uint32 request count, requests
+//   request:  uint8 op, uint32 session, then by op
+//               Op_SetInputs  Core::Inputs
+//               Op_Step       uint32 steps
+//               Op_Restore    Core::Snapshot
+//   response: uint8 status, then if Status_Ok, by op
+//               Op_Create      uint32 session
+//               Op_GetOutputs  Core::Outputs
+//               Op_GetSnapshot Core::Snapshot
+// The session of Op_Create is ignored.
+//
+// A session steps at most MaxStepsPerRound in one server round; an Op_Step
+// past that is answered Status_TooManySteps and not run, so a client
+// waiting on each response gets that many steps per batch. A batch whose
+// response would not fit in MaxBatchBytes is refused like an oversized one.
+namespace SimProtocol
+{
+	enum Op
+	{
+		Op_Create,
+		Op_Destroy,
+		Op_SetInputs,
+		Op_Step,
+		Op_GetOutputs,
+		Op_GetSnapshot,
+		Op_Restore,
+
+		Op_Count
+	};
+
+	enum Status
+	{
+		Status_Ok,
+		Status_NoSession,
+		Status_BadSnapshot,
+		Status_TooManySteps,
+	};
+
+	// Larger batches are refused and the connection closed
+	constexpr uint32_t MaxBatchBytes = 64 << 20;
+
+	// Every session in a round waits for the longest one, ten seconds of
+	// plant time at the fixed step
+	constexpr uint32_t MaxStepsPerRound = 600;
+
+	constexpr size_t HeaderSize = 2 * sizeof(uint32_t);
+	constexpr size_t RequestHeaderSize = sizeof(uint8_t) + sizeof(uint32_t);
+
+	inline size_t request_payload_size(uint8_t op)
+	{
+		switch(op)
+		{
+			case Op_SetInputs: return sizeof(Core::Inputs);
+			case Op_Step:      return sizeof(uint32_t);
+			case Op_Restore:   return sizeof(Core::Snapshot);
+			default:           return 0;
+		}
+	}
+
+	inline size_t response_payload_size(uint8_t op)
+	{
+		switch(op)
+		{
+			case Op_Create:      return sizeof(uint32_t);
+			case Op_GetOutputs:  return sizeof(Core::Outputs);
+			case Op_GetSnapshot: return sizeof(Core::Snapshot);
+			default:             return 0;
+		}
+	}
+
+	inline size_t response_size(uint8_t op)
+	{
+		return sizeof(uint8_t) + response_payload_size(op);
+	}
+
+	template<typename T>
+	inline void put(std::vector<uint8_t>& bytes, const T& value)
+	{
+		const size_t at = bytes.size();
+		bytes.resize(at + sizeof(T));
+		memcpy(&bytes[at], &value, sizeof(T));
+	}
+
+	template<typename T>
+	inline T get(const uint8_t* bytes)
+	{
+		T value;
+		memcpy(&value, bytes, sizeof(T));
+		return value;
+	}
+
+	// Starts a batch in bytes; finish_batch fills in the header
+	inline void begin_batch(std::vector<uint8_t>& bytes)
+	{
+		bytes.clear();
+		bytes.resize(HeaderSize, 0);
+	}
+
+	inline void finish_batch(std::vector<uint8_t>& bytes, uint32_t count)
+	{
+		const uint32_t length = (uint32_t)(bytes.size() - sizeof(uint32_t));
+		memcpy(&bytes[0], &length, sizeof(length));
+		memcpy(&bytes[sizeof(uint32_t)], &count, sizeof(count));
+	}
+}
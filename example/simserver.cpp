@@ -0,0 +1,704 @@
+#include "simserver.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "scheduler.h"
+
+using namespace SimProtocol;
+
+namespace
+{
+	// How long run() waits for a client before checking for stop()
+	constexpr int PollTimeoutMs = 50;
+
+	// A client with more than this many response bytes waiting to be sent
+	// is not reading them and is disconnected
+	constexpr size_t MaxPendingBytes = MaxBatchBytes;
+
+	bool make_address(const std::string& path, sockaddr_un& address)
+	{
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if(path.empty() || path.size() >= sizeof(address.sun_path))
+		{
+			return false;
+		}
+		memcpy(address.sun_path, path.c_str(), path.size());
+		return true;
+	}
+
+	bool send_all(int fd, const uint8_t* bytes, size_t size)
+	{
+		while(size > 0)
+		{
+			const ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+			if(sent <= 0)
+			{
+				return false;
+			}
+			bytes += sent;
+			size -= (size_t)sent;
+		}
+		return true;
+	}
+
+	bool receive_all(int fd, uint8_t* bytes, size_t size)
+	{
+		while(size > 0)
+		{
+			const ssize_t got = recv(fd, bytes, size, 0);
+			if(got <= 0)
+			{
+				return false;
+			}
+			bytes += got;
+			size -= (size_t)got;
+		}
+		return true;
+	}
+}
+
+SimServer::SimServer()
+	: listen_fd_(-1)
+	, running_(false)
+	, live_count_(0)
+	, requests_(0)
+{
+}
+
+SimServer::~SimServer()
+{
+	close();
+}
+
+bool SimServer::open(const std::string& path)
+{
+	close();
+
+	sockaddr_un address;
+	if(!make_address(path, address))
+	{
+		return false;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0)
+	{
+		return false;
+	}
+
+	unlink(path.c_str());
+	if(bind(fd, (const sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 64) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	listen_fd_ = fd;
+	path_ = path;
+	return true;
+}
+
+void SimServer::close()
+{
+	for(Client& client : clients_)
+	{
+		if(client.fd >= 0)
+		{
+			::close(client.fd);
+		}
+	}
+	clients_.clear();
+
+	if(listen_fd_ >= 0)
+	{
+		::close(listen_fd_);
+		unlink(path_.c_str());
+		listen_fd_ = -1;
+	}
+}
+
+void SimServer::run(struct scheduler* sched)
+{
+	running_.store(true);
+
+	std::vector<pollfd> fds;
+	while(running_.load())
+	{
+		fds.clear();
+		fds.push_back(pollfd{listen_fd_, POLLIN, 0});
+		for(const Client& client : clients_)
+		{
+			// a client is not read from while its responses wait to be
+			// sent, so one that never reads only holds itself up
+			fds.push_back(pollfd{client.fd, (short)(client.pending.empty() ? POLLIN : POLLOUT), 0});
+		}
+
+		if(poll(fds.data(), (nfds_t)fds.size(), PollTimeoutMs) <= 0)
+		{
+			continue;
+		}
+
+		// everything that has arrived joins this round
+		for(size_t i = 0; i < clients_.size(); ++i)
+		{
+			const short revents = fds[i + 1].revents;
+			if(((revents & POLLOUT) && !flush(clients_[i])) ||
+				((revents & (POLLIN | POLLHUP | POLLERR)) && !receive(clients_[i])))
+			{
+				::close(clients_[i].fd);
+				clients_[i].fd = -1;
+			}
+		}
+
+		batches_.clear();
+		round_.clear();
+		consumed_.assign(clients_.size(), 0);
+		for(size_t i = 0; i < clients_.size(); ++i)
+		{
+			while(clients_[i].fd >= 0 && parse(i, consumed_[i]))
+			{
+			}
+		}
+
+		if(!round_.empty())
+		{
+			execute(sched);
+			respond();
+		}
+
+		for(size_t i = 0; i < clients_.size(); ++i)
+		{
+			std::vector<uint8_t>& received = clients_[i].received;
+			received.erase(received.begin(), received.begin() + (ptrdiff_t)consumed_[i]);
+		}
+
+		// clients are only dropped between rounds, batches refer to them by index
+		for(size_t i = clients_.size(); i-- > 0;)
+		{
+			if(clients_[i].fd < 0)
+			{
+				clients_.erase(clients_.begin() + (ptrdiff_t)i);
+			}
+		}
+
+		if(fds[0].revents & POLLIN)
+		{
+			accept_clients();
+		}
+	}
+}
+
+void SimServer::accept_clients()
+{
+	int fd = accept(listen_fd_, nullptr, nullptr);
+	if(fd < 0)
+	{
+		return;
+	}
+
+	// responses are sent as far as the client takes them, never waiting
+	const int flags = fcntl(fd, F_GETFL, 0);
+	if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)
+	{
+		::close(fd);
+		return;
+	}
+	clients_.push_back(Client{fd, {}, {}, 0});
+}
+
+bool SimServer::receive(Client& client)
+{
+	uint8_t bytes[64 * 1024];
+	const ssize_t got = recv(client.fd, bytes, sizeof(bytes), 0);
+	if(got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+	{
+		return true;
+	}
+	if(got <= 0)
+	{
+		return false;
+	}
+	client.received.insert(client.received.end(), bytes, bytes + got);
+	return true;
+}
+
+bool SimServer::flush(Client& client)
+{
+	while(client.sent < client.pending.size())
+	{
+		const ssize_t sent = send(client.fd, client.pending.data() + client.sent,
+			client.pending.size() - client.sent, MSG_NOSIGNAL);
+		if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+		{
+			break;
+		}
+		if(sent <= 0)
+		{
+			return false;
+		}
+		client.sent += (size_t)sent;
+	}
+
+	// drop what has gone once it is most of the buffer, rather than
+	// moving the rest down after every send
+	if(client.sent == client.pending.size())
+	{
+		client.pending.clear();
+		client.sent = 0;
+	}
+	else if(client.sent > client.pending.size() / 2)
+	{
+		client.pending.erase(client.pending.begin(), client.pending.begin() + (ptrdiff_t)client.sent);
+		client.sent = 0;
+	}
+	return client.pending.size() - client.sent <= MaxPendingBytes;
+}
+
+bool SimServer::parse(size_t index, size_t& consumed)
+{
+	Client& client = clients_[index];
+	const size_t available = client.received.size() - consumed;
+	if(available < HeaderSize)
+	{
+		return false;
+	}
+
+	const uint8_t* bytes = client.received.data() + consumed;
+	const uint32_t length = get<uint32_t>(bytes);
+	const uint32_t count = get<uint32_t>(bytes + sizeof(uint32_t));
+	if(length > MaxBatchBytes || length < HeaderSize - sizeof(uint32_t))
+	{
+		::close(client.fd);
+		client.fd = -1;
+		return false;
+	}
+	if(available < sizeof(uint32_t) + length)
+	{
+		return false;
+	}
+
+	// check the whole batch before taking any of it, including that its
+	// response can be sent back
+	const uint8_t* end = bytes + sizeof(uint32_t) + length;
+	const uint8_t* at = bytes + HeaderSize;
+	size_t response_length = HeaderSize - sizeof(uint32_t);
+	for(uint32_t i = 0; i < count; ++i)
+	{
+		if(end - at < (ptrdiff_t)RequestHeaderSize || at[0] >= Op_Count)
+		{
+			::close(client.fd);
+			client.fd = -1;
+			return false;
+		}
+		response_length += response_size(at[0]);
+		at += RequestHeaderSize + request_payload_size(at[0]);
+	}
+	if(at != end || response_length > MaxBatchBytes)
+	{
+		::close(client.fd);
+		client.fd = -1;
+		return false;
+	}
+
+	Batch batch;
+	batch.client = index;
+	batch.first = round_.size();
+	batch.count = count;
+
+	at = bytes + HeaderSize;
+	for(uint32_t i = 0; i < count; ++i)
+	{
+		Request request;
+		request.op = at[0];
+		request.status = Status_Ok;
+		request.session = get<uint32_t>(at + 1);
+		request.payload = at + RequestHeaderSize;
+		round_.push_back(request);
+		at += RequestHeaderSize + request_payload_size(request.op);
+	}
+
+	batches_.push_back(batch);
+	consumed += sizeof(uint32_t) + length;
+	return true;
+}
+
+uint32_t SimServer::create_session()
+{
+	uint32_t session;
+	if(!free_.empty())
+	{
+		session = free_.back();
+		free_.pop_back();
+		sessions_[session] = Core();
+	}
+	else
+	{
+		session = (uint32_t)sessions_.size();
+		sessions_.emplace_back();
+		live_.push_back(0);
+		work_of_session_.push_back(-1);
+	}
+	live_[session] = 1;
+	++live_count_;
+	return session;
+}
+
+void SimServer::execute(struct scheduler* sched)
+{
+	requests_ += round_.size();
+
+	// creates first, so the session table does not move under the tasks
+	for(Request& request : round_)
+	{
+		if(request.op == Op_Create)
+		{
+			request.session = create_session();
+		}
+	}
+
+	// gather each session's requests in arrival order
+	size_t work_count = 0;
+	for(uint32_t i = 0; i < (uint32_t)round_.size(); ++i)
+	{
+		Request& request = round_[i];
+		if(request.op == Op_Create)
+		{
+			continue;
+		}
+		if(request.session >= sessions_.size() || !live_[request.session])
+		{
+			request.status = Status_NoSession;
+			continue;
+		}
+		if(request.op == Op_Destroy)
+		{
+			// later requests in the round find the session gone, while the
+			// ones before it still run on it; the slot is reused after the round
+			live_[request.session] = 0;
+			--live_count_;
+			continue;
+		}
+
+		int32_t& slot = work_of_session_[request.session];
+		if(slot < 0)
+		{
+			if(work_count == work_.size())
+			{
+				work_.emplace_back();
+			}
+			slot = (int32_t)work_count++;
+			work_[slot].session = request.session;
+			work_[slot].steps = 0;
+			work_[slot].requests.clear();
+		}
+		if(request.op == Op_Step)
+		{
+			const uint32_t steps = get<uint32_t>(request.payload);
+			if(steps > MaxStepsPerRound - work_[slot].steps)
+			{
+				request.status = Status_TooManySteps;
+				continue;
+			}
+			work_[slot].steps += steps;
+		}
+		work_[slot].requests.push_back(i);
+	}
+
+	if(work_count > 0)
+	{
+		struct sched_task task;
+		scheduler_add(&task, sched, run_work, this, (sched_uint)work_count);
+		scheduler_join(sched, &task);
+	}
+
+	for(size_t i = 0; i < work_count; ++i)
+	{
+		work_of_session_[work_[i].session] = -1;
+	}
+
+	// only an applied destroy is left Ok, a repeated one found no session
+	for(const Request& request : round_)
+	{
+		if(request.op == Op_Destroy && request.status == Status_Ok)
+		{
+			free_.push_back(request.session);
+		}
+	}
+}
+
+void SimServer::run_work(void* pArg, struct scheduler*, unsigned begin, unsigned end, unsigned)
+{
+	SimServer* server = (SimServer*)pArg;
+	for(unsigned i = begin; i < end; ++i)
+	{
+		for(uint32_t request : server->work_[i].requests)
+		{
+			server->run_request(server->round_[request]);
+		}
+	}
+}
+
+void SimServer::run_request(Request& request)
+{
+	Core& core = sessions_[request.session];
+	switch(request.op)
+	{
+		case Op_SetInputs:
+			core.set_inputs(get<Core::Inputs>(request.payload));
+			break;
+
+		case Op_Step:
+		{
+			const uint32_t steps = get<uint32_t>(request.payload);
+			for(uint32_t i = 0; i < steps; ++i)
+			{
+				core.step();
+			}
+			break;
+		}
+
+		case Op_GetOutputs:
+			request.outputs = core.get_outputs();
+			break;
+
+		case Op_GetSnapshot:
+			request.snapshot = core.get_snapshot();
+			break;
+
+		case Op_Restore:
+			if(!core.restore_snapshot(get<Core::Snapshot>(request.payload)))
+			{
+				request.status = Status_BadSnapshot;
+			}
+			break;
+	}
+}
+
+void SimServer::respond()
+{
+	for(const Batch& batch : batches_)
+	{
+		Client& client = clients_[batch.client];
+		if(client.fd < 0)
+		{
+			continue;
+		}
+
+		begin_batch(response_);
+		for(size_t i = batch.first; i < batch.first + batch.count; ++i)
+		{
+			const Request& request = round_[i];
+			put<uint8_t>(response_, request.status);
+			if(request.status != Status_Ok)
+			{
+				continue;
+			}
+
+			switch(request.op)
+			{
+				case Op_Create:      put(response_, request.session); break;
+				case Op_GetOutputs:  put(response_, request.outputs); break;
+				case Op_GetSnapshot: put(response_, request.snapshot); break;
+			}
+		}
+		finish_batch(response_, (uint32_t)batch.count);
+
+		client.pending.insert(client.pending.end(), response_.begin(), response_.end());
+		if(!flush(client))
+		{
+			::close(client.fd);
+			client.fd = -1;
+		}
+	}
+}
+
+SimClient::SimClient()
+	: fd_(-1)
+{
+	begin_batch(batch_);
+}
+
+SimClient::~SimClient()
+{
+	close();
+}
+
+bool SimClient::connect(const std::string& path)
+{
+	close();
+
+	sockaddr_un address;
+	if(!make_address(path, address))
+	{
+		return false;
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0)
+	{
+		return false;
+	}
+	if(::connect(fd, (const sockaddr*)&address, sizeof(address)) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	fd_ = fd;
+	return true;
+}
+
+void SimClient::close()
+{
+	if(fd_ >= 0)
+	{
+		::close(fd_);
+		fd_ = -1;
+	}
+}
+
+unsigned SimClient::add(uint8_t op, uint32_t session)
+{
+	// the previous batch's results are gone once a new one is started
+	if(!results_.empty())
+	{
+		results_.clear();
+		ops_.clear();
+		begin_batch(batch_);
+	}
+
+	put(batch_, op);
+	put(batch_, session);
+	ops_.push_back(op);
+	return (unsigned)(ops_.size() - 1);
+}
+
+unsigned SimClient::create()
+{
+	return add(Op_Create, 0);
+}
+
+unsigned SimClient::destroy(uint32_t session)
+{
+	return add(Op_Destroy, session);
+}
+
+unsigned SimClient::set_inputs(uint32_t session, const Core::Inputs& inputs)
+{
+	unsigned request = add(Op_SetInputs, session);
+	put(batch_, inputs);
+	return request;
+}
+
+unsigned SimClient::step(uint32_t session, uint32_t steps)
+{
+	unsigned request = add(Op_Step, session);
+	put(batch_, steps);
+	return request;
+}
+
+unsigned SimClient::get_outputs(uint32_t session)
+{
+	return add(Op_GetOutputs, session);
+}
+
+unsigned SimClient::get_snapshot(uint32_t session)
+{
+	return add(Op_GetSnapshot, session);
+}
+
+unsigned SimClient::restore(uint32_t session, const Core::Snapshot& snapshot)
+{
+	unsigned request = add(Op_Restore, session);
+	put(batch_, snapshot);
+	return request;
+}
+
+bool SimClient::execute()
+{
+	return send() && receive();
+}
+
+bool SimClient::send()
+{
+	if(fd_ < 0)
+	{
+		return false;
+	}
+
+	finish_batch(batch_, (uint32_t)ops_.size());
+	return send_all(fd_, batch_.data(), batch_.size());
+}
+
+bool SimClient::receive()
+{
+	if(fd_ < 0)
+	{
+		return false;
+	}
+
+	uint32_t length;
+	if(!receive_all(fd_, (uint8_t*)&length, sizeof(length)) || length < sizeof(uint32_t) || length > MaxBatchBytes)
+	{
+		return false;
+	}
+	response_.resize(length);
+	if(!receive_all(fd_, response_.data(), length) || get<uint32_t>(response_.data()) != ops_.size())
+	{
+		return false;
+	}
+
+	// index the responses, keeping the batch so a failed one can be retried
+	results_.clear();
+	size_t at = sizeof(uint32_t);
+	for(uint8_t op : ops_)
+	{
+		if(at >= response_.size())
+		{
+			results_.clear();
+			return false;
+		}
+		results_.push_back(at);
+		at += 1 + (response_[at] == Status_Ok ? response_payload_size(op) : 0);
+	}
+	if(at != response_.size())
+	{
+		results_.clear();
+		return false;
+	}
+
+	// an empty batch leaves nothing to index, start over explicitly
+	if(ops_.empty())
+	{
+		begin_batch(batch_);
+	}
+	return true;
+}
+
+SimProtocol::Status SimClient::get_status(unsigned request) const
+{
+	return (Status)response_[results_[request]];
+}
+
+uint32_t SimClient::get_session(unsigned request) const
+{
+	return get<uint32_t>(&response_[results_[request] + 1]);
+}
+
+Core::Outputs SimClient::get_outputs_result(unsigned request) const
+{
+	return get<Core::Outputs>(&response_[results_[request] + 1]);
+}
+
+Core::Snapshot SimClient::get_snapshot_result(unsigned request) const
+{
+	return get<Core::Snapshot>(&response_[results_[request] + 1]);
+}
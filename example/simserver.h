@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "core.h"
+#include "simprotocol.h"
+
+struct scheduler;
+
+// Hosts independent Core sessions for clients on a Unix domain socket, e.g.
+// one per trainee station of a classroom, speaking SimProtocol.
+//
+// Each round, the server gathers every complete batch from every client.
+// Creates are applied first. Then each session's requests, in the order
+// they arrived, become one task, and all the sessions touched in the round
+// run concurrently on the scheduler. A destroy ends its session where it
+// stands in the round, so requests after it find no session. One client
+// stepping many sessions in a batch, or many clients stepping one each,
+// keep every worker busy either way. Steps are capped per session and round
+// (SimProtocol::MaxStepsPerRound), so no session holds the round up for long.
+//
+// Responses are queued per client and sent as the client reads them. A
+// client is not read from while its responses wait, and one that lets
+// them pile up is disconnected, so it cannot hold up the others.
+class SimServer
+{
+public:
+	SimServer();
+	~SimServer();
+
+	SimServer(const SimServer&) = delete;
+	SimServer& operator=(const SimServer&) = delete;
+
+	// Listens on path, replacing a stale socket file
+	bool open(const std::string& path);
+	void close();
+
+	// Serves clients until stop() is called, from this thread, running the
+	// sessions on sched's workers
+	void run(struct scheduler* sched);
+
+	// May be called from any thread; run() returns within its poll timeout
+	inline void stop()
+	{
+		running_.store(false);
+	}
+
+	inline size_t get_session_count() const
+	{
+		return live_count_;
+	}
+
+	inline uint64_t get_requests() const
+	{
+		return requests_;
+	}
+
+private:
+	struct Client
+	{
+		int fd;
+		std::vector<uint8_t> received;
+		// responses not yet taken by the client, from sent on
+		std::vector<uint8_t> pending;
+		size_t sent;
+	};
+
+	struct Request
+	{
+		uint8_t op;
+		uint8_t status;
+		uint32_t session;
+		// into the client's received bytes
+		const uint8_t* payload;
+		// filled in by the request
+		Core::Outputs outputs;
+		Core::Snapshot snapshot;
+	};
+
+	// The requests of one complete batch
+	struct Batch
+	{
+		size_t client;
+		size_t first;
+		size_t count;
+	};
+
+	// One session's requests this round, in order
+	struct Work
+	{
+		uint32_t session;
+		// asked for so far, up to MaxStepsPerRound
+		uint32_t steps;
+		std::vector<uint32_t> requests;
+	};
+
+	std::string path_;
+	int listen_fd_;
+	std::atomic_bool running_;
+	std::vector<Client> clients_;
+
+	std::vector<Core> sessions_;
+	std::vector<uint8_t> live_;
+	std::vector<uint32_t> free_;
+	size_t live_count_;
+	uint64_t requests_;
+
+	// per round, kept to avoid allocating
+	std::vector<Batch> batches_;
+	std::vector<Request> round_;
+	std::vector<Work> work_;
+	std::vector<size_t> consumed_;
+	std::vector<int32_t> work_of_session_;
+	std::vector<uint8_t> response_;
+
+	void accept_clients();
+	bool receive(Client& client);
+	bool flush(Client& client);
+	bool parse(size_t client, size_t& consumed);
+	void execute(struct scheduler* sched);
+	void respond();
+
+	uint32_t create_session();
+	void run_request(Request& request);
+	static void run_work(void* pArg, struct scheduler*, unsigned begin, unsigned end, unsigned thread);
+};
+
+// A connection to a SimServer. Requests are queued into a batch and sent
+// together by execute(), which waits for the responses.
+class SimClient
+{
+public:
+	SimClient();
+	~SimClient();
+
+	SimClient(const SimClient&) = delete;
+	SimClient& operator=(const SimClient&) = delete;
+
+	bool connect(const std::string& path);
+	void close();
+
+	// Each returns the request's index in the batch, for the accessors
+	// below once execute() has returned
+	unsigned create();
+	unsigned destroy(uint32_t session);
+	unsigned set_inputs(uint32_t session, const Core::Inputs& inputs);
+	unsigned step(uint32_t session, uint32_t steps);
+	unsigned get_outputs(uint32_t session);
+	unsigned get_snapshot(uint32_t session);
+	unsigned restore(uint32_t session, const Core::Snapshot& snapshot);
+
+	// Sends the batch and reads back its responses. Returns false if the
+	// connection failed.
+	bool execute();
+
+	// The two halves of execute(), for a caller with something to do while
+	// the server works on the batch
+	bool send();
+	bool receive();
+
+	inline size_t get_request_count() const
+	{
+		return ops_.size();
+	}
+
+	SimProtocol::Status get_status(unsigned request) const;
+	uint32_t get_session(unsigned request) const;
+	Core::Outputs get_outputs_result(unsigned request) const;
+	Core::Snapshot get_snapshot_result(unsigned request) const;
+
+private:
+	int fd_;
+	std::vector<uint8_t> batch_;
+	std::vector<uint8_t> ops_;
+	std::vector<uint8_t> response_;
+	// where each response starts in response_
+	std::vector<size_t> results_;
+
+	unsigned add(uint8_t op, uint32_t session);
+};
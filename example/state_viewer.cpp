@@ -0,0 +1,140 @@
+// Follows the state a simulation publishes to shared memory (see
+// publisher.h) from a separate process.
+//
+// usage: state_viewer [options]
+//   --name <name>       shared memory object (default /nuke-sim)
+//   --every             print every frame as csv, like a logger, instead of
+//                       the newest frame at each interval
+//   --interval <ms>     time between polls (default 500)
+//   --count <n>         stop after this many polls (default: run until
+//                       interrupted)
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "publisher.h"
+
+namespace
+{
+	struct Options
+	{
+		const char* name;
+		bool every;
+		unsigned interval;
+		unsigned long count;
+	};
+
+	void usage()
+	{
+		fprintf(stderr, "usage: state_viewer [--name name] [--every] [--interval ms] [--count n]\n");
+	}
+
+	bool parse_options(int argc, char** argv, Options& options)
+	{
+		options.name     = "/nuke-sim";
+		options.every    = false;
+		options.interval = 500;
+		options.count    = 0;
+
+		for(int i = 1; i < argc; ++i)
+		{
+			// the only option without a value
+			if(strcmp(argv[i], "--every") == 0)
+			{
+				options.every = true;
+				continue;
+			}
+
+			if(i + 1 >= argc)
+			{
+				return false;
+			}
+
+			const char* value = argv[i + 1];
+			if(strcmp(argv[i], "--name") == 0)
+			{
+				options.name = value;
+			}
+			else if(strcmp(argv[i], "--interval") == 0)
+			{
+				options.interval = (unsigned)atoi(value);
+			}
+			else if(strcmp(argv[i], "--count") == 0)
+			{
+				options.count = strtoul(value, nullptr, 10);
+			}
+			else
+			{
+				return false;
+			}
+			++i;
+		}
+		return true;
+	}
+
+	void print_frame(const StateSubscriber::Frame& frame)
+	{
+		printf("frame %llu  step %llu  t %.3f s  N %.6g  Wr %.6g W  rods %.4f\n",
+			(unsigned long long)frame.frame, (unsigned long long)frame.step_count, frame.time,
+			frame.state.N, frame.outputs.Wr, frame.inputs.RodPosition);
+	}
+
+	void print_row(const StateSubscriber::Frame& frame)
+	{
+		printf("%llu,%llu,%.17g,%.17g,%.17g,%.17g\n",
+			(unsigned long long)frame.frame, (unsigned long long)frame.step_count, frame.time,
+			frame.state.N, frame.outputs.Wr, frame.inputs.RodPosition);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	if(!parse_options(argc, argv, options))
+	{
+		usage();
+		return 1;
+	}
+
+	StateSubscriber subscriber;
+	if(!subscriber.open(options.name))
+	{
+		fprintf(stderr, "no publisher at '%s'\n", options.name);
+		return 1;
+	}
+
+	if(options.every)
+	{
+		printf("frame,step,time,N,Wr,RodPosition\n");
+	}
+
+	StateSubscriber::Frame frame;
+	uint64_t last_frame = ~0ull;
+	for(unsigned long poll = 0; options.count == 0 || poll < options.count; ++poll)
+	{
+		if(options.every)
+		{
+			while(subscriber.read_next(frame))
+			{
+				print_row(frame);
+			}
+		}
+		else if(subscriber.read_latest(frame) && frame.frame != last_frame)
+		{
+			print_frame(frame);
+			last_frame = frame.frame;
+		}
+		fflush(stdout);
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(options.interval));
+	}
+
+	if(subscriber.get_dropped())
+	{
+		fprintf(stderr, "dropped %llu frames\n", (unsigned long long)subscriber.get_dropped());
+	}
+	return 0;
+}
@@ -12,6 +12,7 @@
 #include "logging.h"
 
 #include "core.h"
+#include "publisher.h"
 
 #include "color.h"
 #include "renderer_gl.h"
@@ -61,6 +62,14 @@ int main(int argc, char** argv)
     memory = calloc(needed_memory, 1);
     scheduler_start(&sched, memory);
 
+	// out of process viewers follow the core through shared memory
+	StatePublisher publisher;
+	if(!publisher.open("/nuke-sim"))
+	{
+		LOG_F(WARNING, "/nuke-sim is in use by another simulation, not publishing\n");
+	}
+	double plant_time = 0.0;
+
     renderer = new RendererGL(1024, 768);
     renderer->load_font("font.ttf", {10, 12, 14});
 
@@ -72,12 +81,15 @@ int main(int argc, char** argv)
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		core.simulate(1.0);
+		plant_time += 1.0;
+		publisher.publish(plant_time, core);
 
 		renderer->begin();
 
 		LOG_F(INFO, "Reactor flux: %f\n", core.get_flux());
 
-        scheduler_add(&task, &sched, game_frame, 0, 1);
+        // draws through the GL context, which belongs to this thread
+        scheduler_add_pinned(&task, &sched, game_frame, 0, 0);
         scheduler_join(&sched, &task);
 
     	renderer->end();
@@ -3,8 +3,11 @@
 
 ABOUT:
     This is a permissively licensed ANSI C Task Scheduler for
-    creating parallel programs. Note - this is a pure ANSI C single header
+    creating parallel programs. Note - this is a single header C
     conversion of Doug Binks enkiTS library (https://github.com/dougbinks/enkiTS).
+    The default work stealing deque needs C11 atomics (or C++11 <atomic>
+    when compiled as C++). Older C compilers get the ANSI C pipe of the
+    original implementation instead, see SCHED_USE_PIPE.
 
     Project Goals
     - ANSI C: Designed to be easy to embed into other languages
@@ -50,11 +53,40 @@ DEFINE:
         You can change this to set the maximum number of spins for worker
         threads to stop looking for work and go into a sleeping state.
 
+    SCHED_DEQUE_SIZE_LOG2
+        You can change this to set the starting size of each worker thread
+        deque. The value is in power of two. A deque that fills up grows to
+        twice its size.
+
+    SCHED_MALLOC
+    SCHED_FREE
+        You can define these to your own allocator for the memory a deque
+        grows into. If not, sched.h uses malloc and free. Nothing is
+        allocated once the deques have grown to the peak load, and all of
+        it is freed by scheduler_stop.
+
+    SCHED_USE_PIPE
+        Use the fixed size pipe of the original implementation for each
+        worker thread instead of a deque. A task added to a full pipe is run
+        directly by the thread adding it. Nothing is ever allocated. This
+        is the ANSI C path, and is defined automatically for C compilers
+        before C11 or without <stdatomic.h>.
+
     SCHED_PIPE_SIZE_LOG2
         You can change this to set the size of each worker thread pipe.
         The value is in power of two and needs to smaller than 32 otherwise
         the atomic integer type will overflow.
 
+    SCHED_PRIORITIES_NUM
+        You can change this to set the number of task priorities, 3 by
+        default. Every worker thread has a queue per priority. Has to be
+        the same wherever sched.h is included.
+
+    SCHED_PRIORITY_AGING
+        You can change this to set how many more urgent tasks a thread runs
+        while a less urgent priority waits before it looks at that priority
+        first once.
+
 
 LICENSE: (zlib)
     Copyright (c) 2016 Doug Binks
@@ -154,6 +186,14 @@ struct scheduler;
 typedef void(*sched_run)(void*, struct scheduler*, unsigned int begin,
     unsigned int end, unsigned int thread_num);
 
+#ifndef SCHED_PRIORITIES_NUM
+#define SCHED_PRIORITIES_NUM 3
+#endif
+#define SCHED_PRIORITY_HIGH 0
+#define SCHED_PRIORITY_LOW (SCHED_PRIORITIES_NUM-1)
+#define SCHED_ANY_THREAD ((sched_uint)-1)
+
+struct sched_dependency;
 struct sched_task {
     void *userdata;
     /* custum userdata to use in callback userdata */
@@ -161,11 +201,36 @@ struct sched_task {
     /* function working on the task owner structure */
     sched_uint size;
     /* number of elements inside the set */
+    sched_uint min_range;
+    /* fewest elements handed to one call of exec, 1 unless set after
+     * scheduler_prepare or given to scheduler_add_range */
+    sched_uint priority;
+    /* from SCHED_PRIORITY_HIGH (0), drained first, to SCHED_PRIORITY_LOW.
+     * SCHED_PRIORITY_HIGH unless set after scheduler_prepare */
+    sched_uint thread;
+    /* thread to run the whole set on in one call, or SCHED_ANY_THREAD.
+     * SCHED_ANY_THREAD unless set after scheduler_prepare or given to
+     * scheduler_add_pinned */
     volatile sched_int run_count;
     /* INTERNAL ONLY */
+    volatile sched_int predecessors_left;
+    /* INTERNAL ONLY: unfinished predecessors, plus one until submitted */
+    struct sched_dependency *volatile dependents;
+    /* INTERNAL ONLY: tasks waiting for this one to finish */
+    struct sched_task *next_pinned;
+    /* INTERNAL ONLY: next task pinned to the same thread */
+    struct sched_task *next_finished;
+    /* INTERNAL ONLY: next task whose dependents are still to be started */
 };
 #define sched_task_done(t) (!(t)->run_count)
 
+struct sched_dependency {
+    struct sched_task *task;
+    /* INTERNAL ONLY: the waiting task */
+    struct sched_dependency *next;
+    /* INTERNAL ONLY: next task waiting on the same predecessor */
+};
+
 typedef void (*sched_profiler_callback_f)(void*, sched_uint thread_id);
 struct sched_profiling {
     void *userdata;
@@ -182,11 +247,11 @@ struct sched_profiling {
 
 struct sched_event;
 struct sched_thread_args;
-struct sched_pipe;
+struct sched_queue;
 
 struct scheduler {
-    struct sched_pipe *pipes;
-    /* pipe for every worker thread */
+    struct sched_queue *queues;
+    /* work queue for every worker thread */
     unsigned int threads_num;
     /* number of worker threads */
     struct sched_thread_args *args;
@@ -199,8 +264,6 @@ struct scheduler {
     /* number of thread that are currently running */
     volatile sched_int thread_active;
     /* number of thread that are currently active */
-    unsigned partitions_num;
-    /* divider for the array handled by a task */
     struct sched_event *event;
     /* os event to signal work */
     sched_int have_threads;
@@ -230,9 +293,10 @@ SCHED_API void scheduler_start(struct scheduler*, void *memory);
     -   previously allocated memory to run the scheduler with
 */
 SCHED_API void scheduler_add(struct sched_task*, struct scheduler*, sched_run func, void *pArg, sched_uint size);
-/*  this function adds a task into the scheduler to execute and directly returns
- *  if the pipe is not full. Otherwise the task is run directly. Should only be
- *  called from main thread or within task handler.
+/*  this function adds a task into the scheduler to execute and directly returns.
+ *  The deque of the adding thread grows to take it; with SCHED_USE_PIPE a task
+ *  added to a full pipe is run directly instead. Should only be called from
+ *  main thread or within task handler.
     Input:
     -   function to execute to process the task
     -   userdata to call the execution function with
@@ -241,14 +305,72 @@ SCHED_API void scheduler_add(struct sched_task*, struct scheduler*, sched_run fu
     -   task handle used to wait for the task to finish or check if done. Needs
         to be persistent over the process of the task
 */
+SCHED_API void scheduler_add_range(struct sched_task*, struct scheduler*, sched_run func,
+                                    void *pArg, sched_uint size, sched_uint min_range);
+/*  this function adds a task like scheduler_add, but never hands fewer than
+ *  min_range elements to one call of func. Tasks are split lazily: a range is
+ *  first divided between the threads and only halved further when a thread
+ *  runs out of other work, so a large min_range is only needed when the
+ *  elements are so cheap that a call per handful of them would show.
+    Input:
+    -   function to execute to process the task
+    -   userdata to call the execution function with
+    -   array size that will be divided over multible threads
+    -   fewest elements to run in one call
+*/
+SCHED_API void scheduler_add_pinned(struct sched_task*, struct scheduler*, sched_run func,
+                                    void *pArg, sched_uint thread_num);
+/*  this function adds a task which only runs on the given thread, for work
+ *  like OpenGL calls which are tied to one thread. Any thread may add it, and
+ *  it is queued for the target thread without waiting for it. Worker threads
+ *  run their pinned tasks before any other work. Thread 0, the thread which
+ *  started the scheduler, runs them inside scheduler_join, scheduler_wait and
+ *  scheduler_run_pinned, so it has to call one of these now and then.
+    Input:
+    -   function to execute to process the task, called once with the range 0 to 1
+    -   userdata to call the execution function with
+    -   number of the thread to run the task on
+*/
+SCHED_API void scheduler_prepare(struct sched_task*, sched_run func, void *pArg, sched_uint size);
+/*  this function sets up a task without starting it, so it can be made to
+ *  wait for other tasks with scheduler_depend. The task counts as not done
+ *  from here on, so it can be joined on before it has been submitted.
+    Input:
+    -   function to execute to process the task
+    -   userdata to call the execution function with
+    -   array size that will be divided over multible threads
+*/
+SCHED_API void scheduler_depend(struct sched_task *task, struct sched_task *predecessor,
+                                struct sched_dependency*);
+/*  this function makes a prepared task wait for predecessor to finish. The
+ *  predecessor has to have been prepared or added, and may be queued, running
+ *  or already done. Has to be called before the task is submitted.
+    Input:
+    -   prepared task which should wait
+    -   task to wait for
+    -   dependency record, needs to be persistent until the task is started
+*/
+SCHED_API void scheduler_submit(struct sched_task*, struct scheduler*);
+/*  this function hands a prepared task to the scheduler. It is started as
+ *  soon as all of its predecessors have finished, by whichever thread
+ *  finishes the last of them, so no thread has to wait for the
+ *  predecessors. Can be called from any thread that may add tasks.
+    Input:
+    -   prepared task to start
+*/
 SCHED_API void scheduler_join(struct scheduler*, struct sched_task*);
 /*  this function waits for a previously started task to finish. Should only be
  *  called from thread which created the task scheduler, or within a task
  *  handler. if called with NULL it will try to run task and return if none
- *  available.
+ *  available. While waiting it only runs tasks at least as urgent as the
+ *  one waited for, once that has been started.
     Input:
     -   previously started task to wait until it is finished
 */
+SCHED_API void scheduler_run_pinned(struct scheduler*);
+/*  this function runs the tasks pinned to the calling thread which have been
+ *  started, and none other, so the main thread can pick up its pinned tasks
+ *  between frames without being held up by unrelated work. */
 SCHED_API void scheduler_wait(struct scheduler*);
 /*  this function waits for all task inside the scheduler to finish. Not
  *  guaranteed to work unless we know we are in a situation where task aren't
@@ -294,6 +416,12 @@ typedef int sched__check_ptr_int32[(sizeof(sched_int) == 4) ? 1 : -1];
 #define SCHED_GLOBAL static
 #define SCHED_STORAGE static
 
+/* the deque needs C11 atomics, older C compilers get the pipe */
+#if !defined(SCHED_USE_PIPE) && !defined(__cplusplus) && \
+    (!defined(__STDC_VERSION__) || (__STDC_VERSION__ < 201112L) || defined(__STDC_NO_ATOMICS__))
+#define SCHED_USE_PIPE
+#endif
+
 #ifdef __cplusplus
 /* C++ hates the C align of makro form so have to resort to templates */
 template<typename T> struct sched_alignof;
@@ -415,6 +543,7 @@ sched_zero_size(void *ptr, sched_size size)
     #define SCHED_BASE_ALIGN(x) __attribute__((aligned(x)))
 #endif
 
+#ifdef SCHED_USE_PIPE
 SCHED_INTERN sched_uint
 sched_atomic_cmp_swp(volatile sched_uint *dst, sched_uint swap, sched_uint cmp)
 {
@@ -427,18 +556,31 @@ sched_atomic_cmp_swp(volatile sched_uint *dst, sched_uint swap, sched_uint cmp)
     return __sync_val_compare_and_swap(dst, cmp, swap);
 #endif
 }
+#endif
 
 SCHED_INTERN sched_int
 sched_atomic_add(volatile sched_int *dst, sched_int value)
 {
-/* Atomically performs: tmp = *dst: *dst += value; return tmp; */
+/* Atomically performs: *dst += value; return *dst; */
 #if defined(_WIN32) && !(defined(__MINGW32__) || defined(__MINGW64__))
-    return _InterlockedExchangeAdd((long*)dst, value);
+    return _InterlockedExchangeAdd((long*)dst, value) + value;
 #else
     return (sched_int)__sync_add_and_fetch(dst, value);
 #endif
 }
 
+SCHED_INTERN void*
+sched_atomic_cmp_swp_ptr(void *volatile *dst, void *swap, void *cmp)
+{
+/* Atomically performs: if (*dst == cmp){ *dst = swap;}
+ * return old *dst (so if sucessfull return cmp) */
+#if defined(_WIN32) && !(defined(__MINGW32__) || defined(__MINGW64__))
+    return _InterlockedCompareExchangePointer(dst, swap, cmp);
+#else
+    return __sync_val_compare_and_swap(dst, cmp, swap);
+#endif
+}
+
 /* ---------------------------------------------------------------
  *                          THREAD
  * ---------------------------------------------------------------*/
@@ -490,18 +632,27 @@ sched_event_close(struct sched_event *eventid)
     CloseHandle(eventid->event);
 }
 
+SCHED_INTERN sched_uint
+sched_event_signals(struct sched_event *eventid)
+{
+    /* a manual reset event stays set for a waiter which comes late */
+    SCHED_UNUSED(eventid);
+    return 0;
+}
+
 SCHED_INTERN void
-sched_event_wait(struct sched_event *eventid, sched_int ms)
+sched_event_wait(struct sched_event *eventid, sched_uint signals, sched_int ms)
 {
     DWORD ret_val;
-    sched_int prev;
+    sched_int left;
+    SCHED_UNUSED(signals);
     sched_atomic_add(&eventid->count_waiters, 1);
     ret_val = WaitForSingleObject(eventid->event, ms);
-    prev = sched_atomic_add(&eventid->count_waiters, -1);
-    if (prev == 1) /* we were the last to awaken, so reset event. */
+    left = sched_atomic_add(&eventid->count_waiters, -1);
+    if (left == 0) /* we were the last to awaken, so reset event. */
         ResetEvent(eventid->event);
     SCHED_ASSERT(ret_val != WAIT_FAILED);
-    SCHED_ASSERT(prev != 0);
+    SCHED_ASSERT(left >= 0);
 }
 
 SCHED_INTERN void
@@ -525,6 +676,7 @@ typedef pthread_t sched_thread;
 struct sched_event {
     pthread_cond_t cond;
     pthread_mutex_t mutex;
+    sched_uint signals;
 };
 const sched_int SCHED_INFINITE = -1;
 
@@ -547,7 +699,7 @@ sched_thread_term(sched_thread threadid)
 SCHED_INTERN struct sched_event
 sched_event_create(void)
 {
-    struct sched_event event = {PTHREAD_COND_INITIALIZER, PTHREAD_MUTEX_INITIALIZER};
+    struct sched_event event = {PTHREAD_COND_INITIALIZER, PTHREAD_MUTEX_INITIALIZER, 0};
     return event;
 }
 
@@ -558,14 +710,26 @@ sched_event_close(struct sched_event *eventid)
     SCHED_UNUSED(eventid);
 }
 
+SCHED_INTERN sched_uint
+sched_event_signals(struct sched_event *eventid)
+{
+    /* read before looking for work, a signal after that ends the wait */
+    sched_uint signals;
+    pthread_mutex_lock(&eventid->mutex);
+    signals = eventid->signals;
+    pthread_mutex_unlock(&eventid->mutex);
+    return signals;
+}
+
 SCHED_INTERN void
-sched_event_wait(struct sched_event *eventid, sched_int ms)
+sched_event_wait(struct sched_event *eventid, sched_uint signals, sched_int ms)
 {
     SCHED_ASSERT(eventid);
     pthread_mutex_lock(&eventid->mutex);
     if (ms == SCHED_INFINITE) {
-        pthread_cond_wait(&eventid->cond, &eventid->mutex);
-    } else {
+        while (eventid->signals == signals)
+            pthread_cond_wait(&eventid->cond, &eventid->mutex);
+    } else if (eventid->signals == signals) {
         struct timespec waittime;
         waittime.tv_sec = ms/1000;
         ms -= (sched_int)waittime.tv_sec*1000;
@@ -580,6 +744,7 @@ sched_event_signal(struct sched_event *eventid)
 {
     SCHED_ASSERT(eventid);
     pthread_mutex_lock(&eventid->mutex);
+    ++eventid->signals;
     pthread_cond_broadcast(&eventid->cond);
     pthread_mutex_unlock(&eventid->mutex);
 }
@@ -598,6 +763,17 @@ sched_num_hw_threads(void)
 
 #endif
 
+struct sched_task_partition {
+    sched_uint start;
+    sched_uint end;
+};
+
+struct sched_subset_task {
+    struct sched_task *task;
+    struct sched_task_partition partition;
+};
+
+#ifdef SCHED_USE_PIPE
 /* ---------------------------------------------------------------
  *                          PIPE
  * ---------------------------------------------------------------*/
@@ -625,16 +801,6 @@ typedef int sched__check_pipe_size[(SCHED_PIPE_SIZE_LOG2 < 32) ? 1 : -1];
 #define SCHED_PIPE_CAN_WRITE  0x00000000
 #define SCHED_PIPE_CAN_READ   0x11111111
 
-struct sched_task_partition {
-    sched_uint start;
-    sched_uint end;
-};
-
-struct sched_subset_task {
-    struct sched_task *task;
-    struct sched_task_partition partition;
-};
-
 struct sched_pipe {
     struct sched_subset_task buffer[SCHED_PIPE_SIZE];
     /* read and write index allow fast access to the pipe
@@ -774,6 +940,239 @@ sched_pipe_write(struct sched_pipe *pipe, const struct sched_subset_task *src)
     return 1;
 }
 
+struct sched_queue {
+    struct sched_pipe pipe[SCHED_PRIORITIES_NUM];
+};
+
+#define SCHED_QUEUE_SLOTS 0
+#define sched_queue_is_empty(q, p) sched_pipe_is_empty(&(q)->pipe[p])
+#define sched_queue_push(q, p, src) sched_pipe_write(&(q)->pipe[p], src)
+#define sched_queue_take(q, p, dst) sched_pipe_read_front(&(q)->pipe[p], dst)
+#define sched_queue_steal(q, p, dst) sched_pipe_read_back(&(q)->pipe[p], dst)
+
+#else
+/* ---------------------------------------------------------------
+ *                          DEQUE
+ * ---------------------------------------------------------------*/
+/*  DEQUE
+    Work stealing deque after Chase and Lev, in the C11 formulation of Le,
+    Pop, Cohen and Zappa Nardelli (Correct and Efficient Work-Stealing for
+    Weak Memory Models, PPoPP 2013). The owning thread pushes and takes at
+    the bottom, any other thread steals from the top.
+    Unlike the pipe it never fills: when the ring is full the owner copies
+    it into one twice the size. Thieves may still be reading the old ring,
+    so every ring a deque has had is kept until scheduler_stop. The first
+    ring comes out of the scheduler memory, and once the rings have grown
+    to the peak load nothing more is allocated.
+    Indices start at one so the owner can step the bottom below the top
+    without the unsigned index wrapping.
+*/
+#ifndef SCHED_DEQUE_SIZE_LOG2
+#define SCHED_DEQUE_SIZE_LOG2 8
+#endif
+#define SCHED_DEQUE_SIZE (1 << SCHED_DEQUE_SIZE_LOG2)
+
+#ifndef SCHED_MALLOC
+#include <stdlib.h>
+#define SCHED_MALLOC(size) malloc(size)
+#define SCHED_FREE(ptr) free(ptr)
+#endif
+
+#ifdef __cplusplus
+#include <atomic>
+#define SCHED_ATOMIC(t) std::atomic<t>
+#define sched_atomic_init(p, v) std::atomic_init(p, v)
+#define sched_atomic_load(p, o) std::atomic_load_explicit(p, std::o)
+#define sched_atomic_store(p, v, o) std::atomic_store_explicit(p, v, std::o)
+#define sched_atomic_cas(p, e, v, s, f) std::atomic_compare_exchange_strong_explicit(p, e, v, std::s, std::f)
+#define sched_atomic_fence(o) std::atomic_thread_fence(std::o)
+#else
+#include <stdatomic.h>
+#define SCHED_ATOMIC(t) _Atomic(t)
+#define sched_atomic_init(p, v) atomic_init(p, v)
+#define sched_atomic_load(p, o) atomic_load_explicit(p, o)
+#define sched_atomic_store(p, v, o) atomic_store_explicit(p, v, o)
+#define sched_atomic_cas(p, e, v, s, f) atomic_compare_exchange_strong_explicit(p, e, v, s, f)
+#define sched_atomic_fence(o) atomic_thread_fence(o)
+#endif
+
+struct sched_deque_slot {
+    /* a thief may read a slot the owner is overwriting, it then loses
+     * the race for the top and throws the copy away */
+    SCHED_ATOMIC(struct sched_task*) task;
+    SCHED_ATOMIC(sched_uint) start;
+    SCHED_ATOMIC(sched_uint) end;
+};
+
+struct sched_deque_ring {
+    sched_size mask;
+    struct sched_deque_slot *slots;
+    struct sched_deque_ring *retired;
+    /* the ring this one replaced */
+};
+
+struct sched_deque {
+    SCHED_ATOMIC(sched_size) SCHED_BASE_ALIGN(64) top;
+    /* thieves take from here */
+    SCHED_ATOMIC(sched_size) SCHED_BASE_ALIGN(64) bottom;
+    /* the owner pushes and takes here */
+    SCHED_ATOMIC(struct sched_deque_ring*) ring;
+    struct sched_deque_ring first;
+};
+
+SCHED_INTERN void
+sched_deque_init(struct sched_deque *deque, struct sched_deque_slot *slots)
+{
+    deque->first.mask = SCHED_DEQUE_SIZE - 1;
+    deque->first.slots = slots;
+    deque->first.retired = 0;
+    sched_atomic_init(&deque->top, (sched_size)1);
+    sched_atomic_init(&deque->bottom, (sched_size)1);
+    sched_atomic_init(&deque->ring, &deque->first);
+}
+
+SCHED_INTERN void
+sched_deque_free(struct sched_deque *deque)
+{
+    struct sched_deque_ring *ring = sched_atomic_load(&deque->ring, memory_order_relaxed);
+    while (ring != &deque->first) {
+        struct sched_deque_ring *retired = ring->retired;
+        SCHED_FREE(ring);
+        ring = retired;
+    }
+    sched_atomic_store(&deque->ring, &deque->first, memory_order_relaxed);
+}
+
+SCHED_INTERN void
+sched_deque_read(const struct sched_deque_ring *ring, sched_size index,
+    struct sched_subset_task *dst)
+{
+    struct sched_deque_slot *slot = &ring->slots[index & ring->mask];
+    dst->task = sched_atomic_load(&slot->task, memory_order_relaxed);
+    dst->partition.start = sched_atomic_load(&slot->start, memory_order_relaxed);
+    dst->partition.end = sched_atomic_load(&slot->end, memory_order_relaxed);
+}
+
+SCHED_INTERN void
+sched_deque_write(struct sched_deque_ring *ring, sched_size index,
+    const struct sched_subset_task *src)
+{
+    struct sched_deque_slot *slot = &ring->slots[index & ring->mask];
+    sched_atomic_store(&slot->task, src->task, memory_order_relaxed);
+    sched_atomic_store(&slot->start, src->partition.start, memory_order_relaxed);
+    sched_atomic_store(&slot->end, src->partition.end, memory_order_relaxed);
+}
+
+SCHED_INTERN struct sched_deque_ring*
+sched_deque_grow(struct sched_deque *deque, struct sched_deque_ring *ring,
+    sched_size top, sched_size bottom)
+{
+    /* only the owner grows the deque, thieves just see the new ring */
+    struct sched_subset_task task;
+    sched_size size = (ring->mask + 1) * 2;
+    sched_size i;
+    struct sched_deque_ring *grown = (struct sched_deque_ring*)SCHED_MALLOC(
+        sizeof(struct sched_deque_ring) + size * sizeof(struct sched_deque_slot));
+    if (!grown) return 0;
+
+    grown->mask = size - 1;
+    grown->slots = (struct sched_deque_slot*)(void*)(grown + 1);
+    grown->retired = ring;
+    for (i = top; i != bottom; ++i) {
+        sched_deque_read(ring, i, &task);
+        sched_deque_write(grown, i, &task);
+    }
+    sched_atomic_store(&deque->ring, grown, memory_order_release);
+    return grown;
+}
+
+SCHED_INTERN sched_int
+sched_deque_push(struct sched_deque *deque, const struct sched_subset_task *src)
+{
+    /* only called by the owner, returns false if the deque could not grow */
+    sched_size bottom = sched_atomic_load(&deque->bottom, memory_order_relaxed);
+    sched_size top = sched_atomic_load(&deque->top, memory_order_acquire);
+    struct sched_deque_ring *ring = sched_atomic_load(&deque->ring, memory_order_relaxed);
+    if (bottom - top > ring->mask) {
+        ring = sched_deque_grow(deque, ring, top, bottom);
+        if (!ring) return 0;
+    }
+
+    sched_deque_write(ring, bottom, src);
+    sched_atomic_fence(memory_order_release);
+    sched_atomic_store(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return 1;
+}
+
+SCHED_INTERN sched_int
+sched_deque_take(struct sched_deque *deque, struct sched_subset_task *dst)
+{
+    /* only called by the owner, takes the newest task */
+    sched_size bottom = sched_atomic_load(&deque->bottom, memory_order_relaxed) - 1;
+    struct sched_deque_ring *ring = sched_atomic_load(&deque->ring, memory_order_relaxed);
+    sched_size top;
+    sched_int have_task = 1;
+
+    sched_atomic_store(&deque->bottom, bottom, memory_order_relaxed);
+    sched_atomic_fence(memory_order_seq_cst);
+    top = sched_atomic_load(&deque->top, memory_order_relaxed);
+    if (top > bottom) {
+        /* empty, put the bottom back */
+        sched_atomic_store(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return 0;
+    }
+
+    sched_deque_read(ring, bottom, dst);
+    if (top == bottom) {
+        /* the last task, a thief may be after it too */
+        if (!sched_atomic_cas(&deque->top, &top, top + 1,
+                memory_order_seq_cst, memory_order_relaxed))
+            have_task = 0;
+        sched_atomic_store(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return have_task;
+}
+
+SCHED_INTERN sched_int
+sched_deque_steal(struct sched_deque *deque, struct sched_subset_task *dst)
+{
+    /* takes the oldest task, returns false if there is none or another
+     * thread got to it first */
+    sched_size top = sched_atomic_load(&deque->top, memory_order_acquire);
+    sched_size bottom;
+    struct sched_deque_ring *ring;
+
+    sched_atomic_fence(memory_order_seq_cst);
+    bottom = sched_atomic_load(&deque->bottom, memory_order_acquire);
+    if (top >= bottom)
+        return 0;
+
+    ring = sched_atomic_load(&deque->ring, memory_order_acquire);
+    sched_deque_read(ring, top, dst);
+    return sched_atomic_cas(&deque->top, &top, top + 1,
+        memory_order_seq_cst, memory_order_relaxed);
+}
+
+SCHED_INTERN sched_int
+sched_deque_is_empty(struct sched_deque *deque)
+{
+    sched_size bottom = sched_atomic_load(&deque->bottom, memory_order_relaxed);
+    sched_size top = sched_atomic_load(&deque->top, memory_order_relaxed);
+    return top >= bottom;
+}
+
+struct sched_queue {
+    struct sched_deque deque[SCHED_PRIORITIES_NUM];
+};
+
+#define SCHED_QUEUE_SLOTS (SCHED_DEQUE_SIZE * SCHED_PRIORITIES_NUM)
+#define sched_queue_is_empty(q, p) sched_deque_is_empty(&(q)->deque[p])
+#define sched_queue_push(q, p, src) sched_deque_push(&(q)->deque[p], src)
+#define sched_queue_take(q, p, dst) sched_deque_take(&(q)->deque[p], dst)
+#define sched_queue_steal(q, p, dst) sched_deque_steal(&(q)->deque[p], dst)
+
+#endif /* SCHED_USE_PIPE */
+
 /* ---------------------------------------------------------------
  *                          SCHEDULER
  * ---------------------------------------------------------------*/
@@ -783,64 +1182,297 @@ sched_pipe_write(struct sched_pipe *pipe, const struct sched_subset_task *src)
 #define SCHED_SPIN_COUNT_MAX 100
 #endif
 
+/* IMPORTANT: Define this to control how many more urgent tasks a thread runs
+ * before it gives a waiting less urgent priority a turn */
+#ifndef SCHED_PRIORITY_AGING
+#define SCHED_PRIORITY_AGING 32
+#endif
+
 struct sched_thread_args {
     sched_uint thread_num;
     struct scheduler *scheduler;
+    sched_uint passed_over[SCHED_PRIORITIES_NUM];
+    /* more urgent tasks run by the thread since it last looked at each
+     * priority first */
+    struct sched_task *volatile pinned;
+    /* tasks pinned to the thread, newest first, pushed by any thread */
+    struct sched_task *volatile pinned_taken;
+    /* tasks taken off pinned, oldest first, only popped by the thread */
 };
 
-SCHED_GLOBAL const sched_size sched_pipe_align = SCHED_ALIGNOF(struct sched_pipe);
+SCHED_GLOBAL const sched_size sched_queue_align = SCHED_ALIGNOF(struct sched_queue);
+#ifndef SCHED_USE_PIPE
+SCHED_GLOBAL const sched_size sched_slot_align = SCHED_ALIGNOF(struct sched_deque_slot);
+#endif
 SCHED_GLOBAL const sched_size sched_arg_align = SCHED_ALIGNOF(struct sched_thread_args);
 SCHED_GLOBAL const sched_size sched_thread_align = SCHED_ALIGNOF(sched_thread);
 SCHED_GLOBAL const sched_size sched_event_align = SCHED_ALIGNOF(struct sched_event);
 SCHED_GLOBAL SCHED_THREAD_LOCAL sched_uint gtl_thread_num = 0;
 
+/* A finished task's dependents list is swapped for this, so a task made to
+ * depend on it afterwards knows not to wait */
+SCHED_GLOBAL struct sched_dependency sched_dependents_closed;
+#define SCHED_DEPENDENTS_CLOSED (&sched_dependents_closed)
+
+SCHED_INTERN void sched_task_finished(struct scheduler*, struct sched_task*);
+
+SCHED_INTERN sched_int
+sched_queue_has_work(struct sched_queue *queue)
+{
+    sched_uint p;
+    for (p = 0; p < SCHED_PRIORITIES_NUM; ++p) {
+        if (!sched_queue_is_empty(queue, p))
+            return 1;
+    }
+    return 0;
+}
+
+#define sched_has_pinned(args) ((args)->pinned || (args)->pinned_taken)
+
+SCHED_INTERN void
+sched_pin(struct scheduler *s, struct sched_task *task)
+{
+    /* multiple producer, single consumer: any thread pushes onto the
+     * target's list, and only the target takes it */
+    struct sched_thread_args *target = &s->args[task->thread];
+    struct sched_task *head;
+    do {
+        head = target->pinned;
+        task->next_pinned = head;
+    } while (sched_atomic_cmp_swp_ptr((void*volatile*)&target->pinned, task, head) != head);
+}
+
+SCHED_INTERN sched_int
+sched_try_running_pinned(struct scheduler *s, sched_uint thread_num)
+{
+    struct sched_thread_args *args = &s->args[thread_num];
+    struct sched_task *task = args->pinned_taken;
+    if (!task && args->pinned) {
+        /* take everything pushed so far and turn it around, so tasks run
+         * in the order they were pinned */
+        struct sched_task *pushed;
+        do {
+            pushed = args->pinned;
+        } while (sched_atomic_cmp_swp_ptr((void*volatile*)&args->pinned, 0, pushed) != pushed);
+        while (pushed) {
+            struct sched_task *next = pushed->next_pinned;
+            pushed->next_pinned = task;
+            task = pushed;
+            pushed = next;
+        }
+    }
+    if (!task) return 0;
+
+    /* popped before running, a join inside the task may run the next one */
+    args->pinned_taken = task->next_pinned;
+    task->exec(task->userdata, s, 0, task->size, thread_num);
+    if (sched_atomic_add(&task->run_count, -1) == 1)
+        sched_task_finished(s, task);
+    return 1;
+}
+
+SCHED_INTERN sched_int
+sched_launch(struct scheduler *s, struct sched_task *task)
+{
+    /* Returns 1 if the task already ran in full, in which case the caller
+     * has to finish it. Finishing it here would start its dependents from
+     * inside this call, one stack frame per link of a chain of such tasks. */
+    struct sched_subset_task subtask;
+    sched_uint min_range = SCHEDULER_MAX(1, task->min_range);
+    sched_uint pieces;
+    sched_uint i;
+    sched_uint num_added = 0;
+
+    subtask.task = task;
+    task->run_count = -1;
+
+    /* divide task up between the threads, sched_run_subtask splits it
+     * further if some of them run out of work. A pinned task is handed
+     * whole to its thread. */
+    pieces = s->threads_num;
+    if (pieces > task->size / min_range)
+        pieces = (task->size) ? SCHEDULER_MAX(1, task->size / min_range) : 0;
+    if (task->thread != SCHED_ANY_THREAD) {
+        SCHED_ASSERT(task->thread < s->threads_num);
+        sched_pin(s, task);
+        ++num_added;
+        pieces = 0;
+    }
+    for (i = 0; i < pieces; ++i) {
+        subtask.partition.start = (sched_uint)((sched_size)task->size * i / pieces);
+        subtask.partition.end = (sched_uint)((sched_size)task->size * (i + 1) / pieces);
+
+        /* add partition to queue */
+        ++num_added;
+        if (!sched_queue_push(&s->queues[gtl_thread_num], task->priority, &subtask)) {
+            /* queue is full therefore directly call it */
+            subtask.task->exec(subtask.task->userdata, s, subtask.partition.start,
+                subtask.partition.end, gtl_thread_num);
+            --num_added;
+        }
+    }
+
+    /* increment running count by number added plus one to account for start
+     * value, and one more held until the dependents are started. Whoever
+     * brings it down to that last one finishes the task. */
+    if (sched_atomic_add(&task->run_count, (sched_int)(num_added+2)) == 1)
+        return 1;
+    if (s->thread_active < s->thread_running)
+        sched_event_signal(s->event);
+    return 0;
+}
+
+SCHED_INTERN void
+sched_task_finished(struct scheduler *s, struct sched_task *task)
+{
+    /* dependents that run in full when started are finished in turn from
+     * this loop rather than by recursion. Each is held open until then, so
+     * its next_finished is free to use. */
+    struct sched_task *finished = task;
+    task->next_finished = 0;
+    while (finished) {
+        struct sched_dependency *dependency;
+        task = finished;
+        finished = task->next_finished;
+
+        do {
+            dependency = task->dependents;
+        } while (sched_atomic_cmp_swp_ptr((void*volatile*)&task->dependents,
+            SCHED_DEPENDENTS_CLOSED, dependency) != dependency);
+
+        while (dependency) {
+            /* the record belongs to the waiting task, which may finish and
+             * be reused as soon as it is started */
+            struct sched_dependency *next = dependency->next;
+            struct sched_task *waiting = dependency->task;
+            if (sched_atomic_add(&waiting->predecessors_left, -1) == 0 &&
+                sched_launch(s, waiting)) {
+                waiting->next_finished = finished;
+                finished = waiting;
+            }
+            dependency = next;
+        }
+
+        /* only now can a join on the task return */
+        sched_atomic_add(&task->run_count, -1);
+    }
+}
+
+SCHED_INTERN void
+sched_run_subtask(struct scheduler *s, struct sched_subset_task *subtask, sched_uint thread_num)
+{
+    /* lazy binary splitting: a thread whose own queue is empty when it
+     * starts on a range has had everything else stolen, so others want work.
+     * It keeps the lower half and queues the upper half, which is either
+     * stolen or taken back and split again. */
+    struct sched_task *task = subtask->task;
+    sched_uint range = subtask->partition.end - subtask->partition.start;
+    if (s->threads_num > 1 && range >= 2 * SCHEDULER_MAX(1, task->min_range) &&
+        sched_queue_is_empty(&s->queues[thread_num], task->priority)) {
+        struct sched_subset_task half;
+        half.task = task;
+        half.partition.start = subtask->partition.start + range / 2;
+        half.partition.end = subtask->partition.end;
+
+        /* the running half holds the task open, so this cannot finish it */
+        sched_atomic_add(&task->run_count, 1);
+        if (sched_queue_push(&s->queues[thread_num], task->priority, &half)) {
+            subtask->partition.end = half.partition.start;
+            /* read through an atomic add so the push is visible before the
+             * read, as the run_count add does in scheduler_add. A worker
+             * that went inactive before this then finds the half, one going
+             * inactive after is counted and signaled. */
+            if (sched_atomic_add(&s->thread_active, 0) < s->thread_running)
+                sched_event_signal(s->event);
+        } else {
+            sched_atomic_add(&task->run_count, -1);
+        }
+    }
+
+    task->exec(task->userdata, s, subtask->partition.start,
+        subtask->partition.end, thread_num);
+    if (sched_atomic_add(&task->run_count, -1) == 1)
+        sched_task_finished(s, task);
+}
+
 SCHED_INTERN sched_int
-sched_try_running_task(struct scheduler *s, sched_uint thread_num, sched_uint *pipe_hint)
+sched_try_running_priority(struct scheduler *s, sched_uint thread_num,
+    sched_uint priority, sched_uint *pipe_hint)
 {
     /* check for tasks */
     struct sched_subset_task subtask;
-    sched_int have_task = sched_pipe_read_front(&s->pipes[thread_num], &subtask);
+    sched_int have_task = sched_queue_take(&s->queues[thread_num], priority, &subtask);
     sched_uint thread_to_check = *pipe_hint;
     sched_uint check_count = 0;
 
     while (!have_task && check_count < s->threads_num) {
         thread_to_check = (*pipe_hint + check_count) % s->threads_num;
         if (thread_to_check != thread_num)
-            have_task = sched_pipe_read_back(&s->pipes[thread_to_check], &subtask);
+            have_task = sched_queue_steal(&s->queues[thread_to_check], priority, &subtask);
         ++check_count;
     }
 
     if (have_task) {
         /* update hint, will preserve value unless actually got task from another thread */
         *pipe_hint = thread_to_check;
-        /* the task has already been divided up by scheduler_add, so just run */
-        subtask.task->exec(subtask.task->userdata, s, subtask.partition.start,
-                subtask.partition.end, thread_num);
-        sched_atomic_add(&subtask.task->run_count, -1);
+        sched_run_subtask(s, &subtask, thread_num);
     }
     return have_task;
 }
 
+SCHED_INTERN sched_int
+sched_try_running_task(struct scheduler *s, sched_uint thread_num,
+    sched_uint *pipe_hint, sched_uint max_priority)
+{
+    /* runs the most urgent task up to max_priority. A priority passed over
+     * for SCHED_PRIORITY_AGING more urgent tasks is looked at first once,
+     * so a steady stream of urgent work cannot starve it. */
+    sched_uint *passed_over = s->args[thread_num].passed_over;
+    sched_uint p, q;
+
+    /* no other thread can run the pinned tasks, so whatever the priority
+     * they go first */
+    if (sched_try_running_pinned(s, thread_num))
+        return 1;
+    for (p = 1; p <= max_priority; ++p) {
+        if (passed_over[p] >= SCHED_PRIORITY_AGING) {
+            passed_over[p] = 0;
+            if (sched_try_running_priority(s, thread_num, p, pipe_hint))
+                return 1;
+        }
+    }
+    for (p = 0; p <= max_priority; ++p) {
+        if (sched_try_running_priority(s, thread_num, p, pipe_hint)) {
+            for (q = p + 1; q < SCHED_PRIORITIES_NUM; ++q)
+                ++passed_over[q];
+            return 1;
+        }
+    }
+    return 0;
+}
+
 SCHED_INTERN void
 scheduler_wait_for_work(struct scheduler *s, sched_uint thread_num)
 {
     sched_uint i = 0;
-    sched_int have_tasks = 0;
-    for (i = 0; i < s->threads_num; ++i) {
-        if (!sched_pipe_is_empty(&s->pipes[i])) {
-            have_tasks = 1;
-            break;
-        }
-    }
+    sched_uint signals = sched_event_signals(s->event);
+    sched_int have_tasks;
+
+    /* counted as inactive before looking, so whoever adds a task after the
+     * look signals the event, which then does not wait. A task pinned to
+     * this thread has no one else to run it. */
+    sched_atomic_add(&s->thread_active, -1);
+    have_tasks = sched_has_pinned(&s->args[thread_num]);
+    for (i = 0; i < s->threads_num && !have_tasks; ++i)
+        have_tasks = sched_queue_has_work(&s->queues[i]);
     if (!have_tasks) {
         if (s->profiling.wait_start)
             s->profiling.wait_start(s->profiling.userdata, thread_num);
-        sched_atomic_add(&s->thread_active, -1);
-        sched_event_wait(s->event, SCHED_INFINITE);
-        sched_atomic_add(&s->thread_active, +1);
+        sched_event_wait(s->event, signals, SCHED_INFINITE);
         if (s->profiling.wait_stop)
             s->profiling.wait_stop(s->profiling.userdata, thread_num);
     }
+    sched_atomic_add(&s->thread_active, +1);
 }
 
 SCHED_INTERN SCHED_THREAD_FUNC_DECL
@@ -858,7 +1490,7 @@ sched_tasking_thread_f(void *pArgs)
 
     hint_pipe = thread_num + 1;
     while (s->running) {
-        if (!sched_try_running_task(s, thread_num, &hint_pipe)) {
+        if (!sched_try_running_task(s, thread_num, &hint_pipe, SCHED_PRIORITY_LOW)) {
             ++spin_count;
             if (spin_count > SCHED_SPIN_COUNT_MAX)
                 scheduler_wait_for_work(s, thread_num);
@@ -884,18 +1516,20 @@ scheduler_init(struct scheduler *s, sched_size *memory,
      * first start as we awant to be able to runtime change it.*/
     s->threads_num = (thread_count == SCHED_DEFAULT)?
         sched_num_hw_threads() : (sched_uint)thread_count;
-    s->partitions_num = (s->threads_num == 1) ?
-        1: (s->threads_num * (s->threads_num - 1));
     if (prof) s->profiling = *prof;
 
     /* calculate needed memory */
     SCHED_ASSERT(s->threads_num > 0);
     *memory = 0;
-    *memory += sizeof(struct sched_pipe) * s->threads_num;
+    *memory += sizeof(struct sched_queue) * s->threads_num;
+#ifndef SCHED_USE_PIPE
+    *memory += sizeof(struct sched_deque_slot) * SCHED_QUEUE_SLOTS * s->threads_num;
+    *memory += sched_slot_align;
+#endif
     *memory += sizeof(struct sched_thread_args) * s->threads_num;
     *memory += sizeof(sched_thread) * s->threads_num;
     *memory += sizeof(struct sched_event);
-    *memory += sched_pipe_align + sched_arg_align;
+    *memory += sched_queue_align + sched_arg_align;
     *memory += sched_thread_align + sched_event_align;
     s->memory = *memory;
 }
@@ -911,8 +1545,22 @@ scheduler_start(struct scheduler *s, void *memory)
 
     /* setup scheduler memory */
     sched_zero_size(memory, s->memory);
-    s->pipes = (struct sched_pipe*)SCHED_ALIGN_PTR(memory, sched_pipe_align);
-    s->threads = SCHED_ALIGN_PTR(s->pipes + s->threads_num, sched_thread_align);
+    s->queues = (struct sched_queue*)SCHED_ALIGN_PTR(memory, sched_queue_align);
+#ifdef SCHED_USE_PIPE
+    s->threads = SCHED_ALIGN_PTR(s->queues + s->threads_num, sched_thread_align);
+#else
+    {
+        struct sched_deque_slot *slots = (struct sched_deque_slot*)SCHED_ALIGN_PTR(
+            s->queues + s->threads_num, sched_slot_align);
+        for (i = 0; i < s->threads_num; ++i) {
+            sched_uint p;
+            for (p = 0; p < SCHED_PRIORITIES_NUM; ++p)
+                sched_deque_init(&s->queues[i].deque[p],
+                    slots + i * SCHED_QUEUE_SLOTS + p * SCHED_DEQUE_SIZE);
+        }
+        s->threads = SCHED_ALIGN_PTR(slots + s->threads_num * SCHED_QUEUE_SLOTS, sched_thread_align);
+    }
+#endif
     s->args = (struct sched_thread_args*) SCHED_ALIGN_PTR(
         SCHED_PTR_ADD(void, s->threads, sizeof(sched_thread) * s->threads_num), sched_arg_align);
     s->event = (struct sched_event*)SCHED_ALIGN_PTR(s->args + s->threads_num, sched_event_align);
@@ -940,53 +1588,100 @@ scheduler_start(struct scheduler *s, void *memory)
 }
 
 SCHED_API void
-scheduler_add(struct sched_task *task, struct scheduler *s,
-    sched_run func, void *pArg, sched_uint size)
+scheduler_prepare(struct sched_task *task, sched_run func, void *pArg, sched_uint size)
 {
-    struct sched_subset_task subtask;
-    sched_uint range_to_run;
-    sched_uint range_left;
-    sched_uint num_added = 0;
-
-    SCHED_ASSERT(s);
     SCHED_ASSERT(task);
     SCHED_ASSERT(func);
 
     task->userdata = pArg;
     task->exec = func;
     task->size = size;
+    task->min_range = 1;
+    task->priority = SCHED_PRIORITY_HIGH;
+    task->thread = SCHED_ANY_THREAD;
+    task->run_count = 1;
+    task->predecessors_left = 1;
+    task->dependents = 0;
+}
 
-    subtask.task = task;
-    subtask.partition.start = 0;
-    subtask.partition.end = task->size;
-    task->run_count = -1;
+SCHED_API void
+scheduler_depend(struct sched_task *task, struct sched_task *predecessor,
+    struct sched_dependency *dependency)
+{
+    struct sched_dependency *head;
+    SCHED_ASSERT(task);
+    SCHED_ASSERT(predecessor);
+    SCHED_ASSERT(dependency);
+    SCHED_ASSERT(task->predecessors_left > 0);
 
-    /* divide task up and add to pipe */
-    range_to_run = SCHEDULER_MAX(1, task->size / s->partitions_num);
-    range_left = subtask.partition.end - subtask.partition.start;
-    num_added = 0;
-    while (range_left) {
-        if (range_to_run > range_left)
-            range_to_run = range_left;
+    dependency->task = task;
+    sched_atomic_add(&task->predecessors_left, 1);
+    do {
+        head = predecessor->dependents;
+        if (head == SCHED_DEPENDENTS_CLOSED) {
+            /* already finished, nothing to wait for */
+            sched_atomic_add(&task->predecessors_left, -1);
+            return;
+        }
+        dependency->next = head;
+    } while (sched_atomic_cmp_swp_ptr((void*volatile*)&predecessor->dependents,
+        dependency, head) != head);
+}
 
-        subtask.partition.start = task->size - range_left;
-        subtask.partition.end = subtask.partition.start + range_to_run;
-        range_left -= range_to_run;
+SCHED_API void
+scheduler_submit(struct sched_task *task, struct scheduler *s)
+{
+    SCHED_ASSERT(s);
+    SCHED_ASSERT(task);
+    SCHED_ASSERT(task->priority < SCHED_PRIORITIES_NUM);
+    if (sched_atomic_add(&task->predecessors_left, -1) == 0 && sched_launch(s, task))
+        sched_task_finished(s, task);
+}
 
-        /* add partition to pipe */
-        ++num_added;
-        if (!sched_pipe_write(&s->pipes[gtl_thread_num], &subtask)) {
-            /* pipe is full therefore directly call it */
-            subtask.task->exec(subtask.task->userdata, s, subtask.partition.start,
-                subtask.partition.end, gtl_thread_num);
-            --num_added;
-        }
-    }
+SCHED_API void
+scheduler_add(struct sched_task *task, struct scheduler *s,
+    sched_run func, void *pArg, sched_uint size)
+{
+    SCHED_ASSERT(s);
+    SCHED_ASSERT(task);
+    SCHED_ASSERT(func);
 
-    /* increment running count by number added plus one to account for start value */
-    sched_atomic_add(&task->run_count, (sched_int)(num_added+1));
-    if (s->thread_active < s->thread_running)
-        sched_event_signal(s->event);
+    scheduler_prepare(task, func, pArg, size);
+    scheduler_submit(task, s);
+}
+
+SCHED_API void
+scheduler_add_range(struct sched_task *task, struct scheduler *s,
+    sched_run func, void *pArg, sched_uint size, sched_uint min_range)
+{
+    SCHED_ASSERT(s);
+    SCHED_ASSERT(task);
+    SCHED_ASSERT(func);
+
+    scheduler_prepare(task, func, pArg, size);
+    task->min_range = SCHEDULER_MAX(1, min_range);
+    scheduler_submit(task, s);
+}
+
+SCHED_API void
+scheduler_add_pinned(struct sched_task *task, struct scheduler *s,
+    sched_run func, void *pArg, sched_uint thread_num)
+{
+    SCHED_ASSERT(s);
+    SCHED_ASSERT(task);
+    SCHED_ASSERT(func);
+    SCHED_ASSERT(thread_num < s->threads_num);
+
+    scheduler_prepare(task, func, pArg, 1);
+    task->thread = thread_num;
+    scheduler_submit(task, s);
+}
+
+SCHED_API void
+scheduler_run_pinned(struct scheduler *s)
+{
+    SCHED_ASSERT(s);
+    while (sched_try_running_pinned(s, gtl_thread_num));
 }
 
 SCHED_API void
@@ -995,10 +1690,16 @@ scheduler_join(struct scheduler *s, struct sched_task *task)
     sched_uint pipe_to_check = gtl_thread_num+1;
     SCHED_ASSERT(s);
     if (task) {
-        while (task->run_count)
-            sched_try_running_task(s, gtl_thread_num, &pipe_to_check);
+        while (task->run_count) {
+            /* a less urgent task picked up here could hold the join up long
+             * after the task is done, unless the task is still waiting for
+             * predecessors which may be less urgent themselves */
+            sched_uint max_priority = (task->predecessors_left) ?
+                SCHED_PRIORITY_LOW : task->priority;
+            sched_try_running_task(s, gtl_thread_num, &pipe_to_check, max_priority);
+        }
     } else {
-        sched_try_running_task(s, gtl_thread_num, &pipe_to_check);
+        sched_try_running_task(s, gtl_thread_num, &pipe_to_check, SCHED_PRIORITY_LOW);
     }
 }
 
@@ -1011,10 +1712,10 @@ scheduler_wait(struct scheduler *s)
 
     while (have_task || s->thread_active > 1) {
         sched_uint i = 0;
-        sched_try_running_task(s, gtl_thread_num, &pipe_hint);
+        sched_try_running_task(s, gtl_thread_num, &pipe_hint, SCHED_PRIORITY_LOW);
         have_task = 0;
         for (i = 0; i < s->threads_num; ++i) {
-            if (!sched_pipe_is_empty(&s->pipes[i])) {
+            if (sched_queue_has_work(&s->queues[i]) || sched_has_pinned(&s->args[i])) {
                 have_task = 1;
                 break;
             }
@@ -1030,9 +1731,10 @@ scheduler_stop(struct scheduler *s)
     if (!s->have_threads)
         return;
 
-    /* wait for threads to quit and terminate them */
-    s->running = 0;
+    /* wait for threads to quit and terminate them, only once the work is
+     * done since tasks may be pinned to them */
     scheduler_wait(s);
+    s->running = 0;
     while (s->thread_running > 1) {
         /* keep firing event to ensure all threads pick uo state of running*/
         sched_event_signal(s->event);
@@ -1041,11 +1743,18 @@ scheduler_stop(struct scheduler *s)
         sched_thread_term(((sched_thread*)(s->threads))[i]);
 
     sched_event_close(s->event);
+#ifndef SCHED_USE_PIPE
+    for (i = 0; i < s->threads_num; ++i) {
+        sched_uint p;
+        for (p = 0; p < SCHED_PRIORITIES_NUM; ++p)
+            sched_deque_free(&s->queues[i].deque[p]);
+    }
+#endif
     s->thread_running = 0;
     s->thread_active = 0;
     s->have_threads = 0;
     s->threads = 0;
-    s->pipes = 0;
+    s->queues = 0;
     s->event = 0;
     s->args = 0;
 }